@@ -8,6 +8,35 @@
 #include <unordered_map>
 #include <set>
 #include <climits>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <sstream>
+#include <cstdio>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <map>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <array>
+#include <cstdlib>
+#include <pthread.h>
+#include <sched.h>
 
 using namespace std;
 
@@ -24,24 +53,694 @@ struct Point {
     Point(string adr = "") : adress(adr) {}
 };
 
+// компактное представление графа (CSR): рёбра вершины v лежат
+// в target/weight на позициях [offset[v], offset[v+1])
+struct CSR {
+    vector<int> offset;  // размер n+1
+    vector<int> target;  // индексы вершин назначения
+    vector<int> weight;  // веса рёбер
+
+    int vertexCount() const { return offset.empty() ? 0 : (int)offset.size() - 1; }
+    int edgeCount() const { return (int)target.size(); }
+};
+
+// ребро, заданное индексами вершин
+struct IndexedEdge { int u, v, w; };
+
+// что делать с параллельными рёбрами (одинаковые u, v) в каноническом списке рёбер
+enum class EdgeMerge {
+    Min,   // оставить одно ребро с наименьшим весом (остов, кратчайшие пути)
+    Sum,   // одно ребро с суммой весов (пропускные способности)
+    Keep   // оставить все в порядке списков смежности (экспорт)
+};
+
+// способ перенумерации вершин (для локальности обращений к памяти при обходах)
+enum class VertexOrder { Original, Random, Degree, BFS, RCM, Gorder };
+
+const char* vertexOrderName(VertexOrder o) {
+    switch (o) {
+        case VertexOrder::Original: return "original";
+        case VertexOrder::Random: return "random";
+        case VertexOrder::Degree: return "degree";
+        case VertexOrder::BFS: return "bfs";
+        case VertexOrder::RCM: return "rcm";
+        case VertexOrder::Gorder: return "gorder";
+    }
+    return "?";
+}
+
+VertexOrder parseVertexOrder(const string& s) {
+    for (VertexOrder o : {VertexOrder::Original, VertexOrder::Random, VertexOrder::Degree,
+                          VertexOrder::BFS, VertexOrder::RCM, VertexOrder::Gorder})
+        if (s == vertexOrderName(o)) return o;
+    if (s == "none") return VertexOrder::Original;
+    throw runtime_error("Неизвестный порядок вершин: " + s);
+}
+
+// результат перенумерации: соответствие индексов и разрыв |u - v| по рёбрам до и после
+struct Relabeling {
+    VertexOrder order = VertexOrder::Original;
+    vector<int> newToOld;   // newToOld[новый индекс] = прежний индекс
+    vector<int> oldToNew;
+    double gapBefore = 0, gapAfter = 0;
+    int bandwidthBefore = 0, bandwidthAfter = 0;
+    double ms = 0;
+};
+
+// ===== Инструментирование: счётчики, таймеры, пики памяти =====
+// Отключается при сборке: -DGRAPH_STATS=0 (макросы STAT_* превращаются в пустые).
+// Счётчики пишутся в массив своего потока без блокировок и суммируются
+// только при выдаче статистики (Stats::dump).
+#ifndef GRAPH_STATS
+#define GRAPH_STATS 1
+#endif
+
+enum StatCounter {
+    STAT_FIND_VERTEX,        // вызовы findVertex
+    STAT_RELAXATIONS,        // успешные релаксации рёбер
+    STAT_HEAP_PUSHES,        // вставки в кучу (Дейкстра)
+    STAT_EDGES_SCANNED,      // просмотренные рёбра в обходах
+    STAT_BF_SWEEPS,          // проходы Беллмана–Форда
+    STAT_AUGMENTING_PATHS,   // увеличивающие пути Эдмондса–Карпа
+    STAT_BFS_RUNS,           // запуски BFS
+    STAT_BFS_VISITED,        // вершины, извлечённые из очереди BFS
+    STAT_DSU_UNIONS,         // объединения в DSU
+    STAT_DYN_TOUCHED,        // вершины, пересчитанные динамическими кратчайшими путями
+    STAT_COUNTER_COUNT
+};
+
+static const char* const statCounterNames[STAT_COUNTER_COUNT] = {
+    "find_vertex", "relaxations", "heap_pushes", "edges_scanned", "bellman_ford_sweeps",
+    "augmenting_paths", "bfs_runs", "bfs_visited", "dsu_unions",
+    "dynamic_touched"
+};
+
+class Stats {
+public:
+    // слот таймера одной фазы (алгоритма)
+    struct Timer {
+        string name;
+        atomic<uint64_t> calls{0}, totalNs{0}, maxNs{0};
+        atomic<bool> memory{false};            // замерять память (только по запросу, см. trackMemory)
+        atomic<uint64_t> rssGrowthKb{0};       // наибольший прирост VmRSS за вызов
+        atomic<uint64_t> peakGrowthKb{0};      // наибольший подъём пика процесса (VmHWM) за вызов
+    };
+
+    static void add(StatCounter c, uint64_t n = 1) {
+        auto& slot = local().v[c];
+        slot.store(slot.load(memory_order_relaxed) + n, memory_order_relaxed);
+    }
+
+    static Timer& timer(const string& name) {
+        lock_guard<mutex> lock(registry().m);
+        return timerLocked(name);
+    }
+
+    // замерять память фазы (или всех фаз — "*"). Замер — два чтения /proc/self/status
+    // на вызов, поэтому по умолчанию выключен; пик ядра не сбрасывается, так что
+    // getrusage и соседние фазы в других потоках не искажаются
+    static void trackMemory(const string& name) {
+        lock_guard<mutex> lock(registry().m);
+        if (name == "*") {
+            registry().trackAll = true;
+            for (auto& t : registry().timers) t->memory = true;
+        } else timerLocked(name).memory = true;
+    }
+
+    static uint64_t counter(StatCounter c) {
+        lock_guard<mutex> lock(registry().m);
+        uint64_t sum = 0;
+        for (auto& t : registry().threads) sum += t->v[c].load(memory_order_relaxed);
+        return sum;
+    }
+
+    // текущий резидентный размер (VmRSS) и пик процесса (VmHWM), КБ — одним чтением
+    static void memoryKb(uint64_t& rss, uint64_t& hwm) {
+        rss = hwm = 0;
+        ifstream f("/proc/self/status");
+        string line;
+        while (getline(f, line)) {
+            if (line.rfind("VmRSS:", 0) == 0) rss = stoull(line.substr(6));
+            else if (line.rfind("VmHWM:", 0) == 0) hwm = stoull(line.substr(6));
+        }
+    }
+
+    static void reset() {
+        lock_guard<mutex> lock(registry().m);
+        for (auto& t : registry().threads)
+            for (auto& c : t->v) c.store(0, memory_order_relaxed);
+        for (auto& t : registry().timers) {
+            t->calls = 0; t->totalNs = 0; t->maxNs = 0; t->rssGrowthKb = 0; t->peakGrowthKb = 0;
+        }
+    }
+
+    // текстовый формат Prometheus
+    static void dump(ostream& out) {
+#if GRAPH_STATS
+        out << "# TYPE graph_counter_total counter\n";
+        for (int c = 0; c < STAT_COUNTER_COUNT; ++c)
+            out << "graph_counter_total{name=\"" << statCounterNames[c] << "\"} "
+                << counter((StatCounter)c) << "\n";
+        lock_guard<mutex> lock(registry().m);
+        out << "# TYPE graph_phase_calls_total counter\n";
+        for (auto& t : registry().timers)
+            out << "graph_phase_calls_total{phase=\"" << t->name << "\"} " << t->calls << "\n";
+        out << "# TYPE graph_phase_seconds_total counter\n";
+        for (auto& t : registry().timers)
+            out << "graph_phase_seconds_total{phase=\"" << t->name << "\"} " << t->totalNs / 1e9 << "\n";
+        out << "# TYPE graph_phase_max_seconds gauge\n";
+        for (auto& t : registry().timers)
+            out << "graph_phase_max_seconds{phase=\"" << t->name << "\"} " << t->maxNs / 1e9 << "\n";
+        out << "# TYPE graph_phase_rss_growth_bytes gauge\n";
+        for (auto& t : registry().timers)
+            if (t->memory)
+                out << "graph_phase_rss_growth_bytes{phase=\"" << t->name << "\"} " << t->rssGrowthKb * 1024 << "\n";
+        out << "# TYPE graph_phase_peak_growth_bytes gauge\n";
+        for (auto& t : registry().timers)
+            if (t->memory)
+                out << "graph_phase_peak_growth_bytes{phase=\"" << t->name << "\"} " << t->peakGrowthKb * 1024 << "\n";
+#else
+        out << "# graph stats disabled at build time (GRAPH_STATS=0)\n";
+#endif
+    }
+
+    // замер фазы: время, а для фаз из trackMemory — приращения VmRSS и VmHWM
+    // между входом и выходом (счётчики процесса только читаются)
+    class Scope {
+    public:
+        explicit Scope(Timer& t) : timer(t), memory(t.memory.load(memory_order_relaxed)),
+                                   start(chrono::steady_clock::now()) {
+            if (memory) memoryKb(rss0, hwm0);
+        }
+        ~Scope() {
+            uint64_t ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+            timer.calls.fetch_add(1, memory_order_relaxed);
+            timer.totalNs.fetch_add(ns, memory_order_relaxed);
+            atomicMax(timer.maxNs, ns);
+            if (memory) {
+                uint64_t rss, hwm;
+                memoryKb(rss, hwm);
+                atomicMax(timer.rssGrowthKb, rss > rss0 ? rss - rss0 : 0);
+                atomicMax(timer.peakGrowthKb, hwm > hwm0 ? hwm - hwm0 : 0);
+            }
+        }
+    private:
+        Timer& timer;
+        bool memory;
+        uint64_t rss0 = 0, hwm0 = 0;
+        chrono::steady_clock::time_point start;
+    };
+
+private:
+    struct ThreadCounters { atomic<uint64_t> v[STAT_COUNTER_COUNT]; };
+    struct Registry {
+        mutex m;
+        vector<unique_ptr<ThreadCounters>> threads; // живут до конца процесса
+        vector<unique_ptr<Timer>> timers;
+        bool trackAll = false;
+    };
+
+    static Timer& timerLocked(const string& name) {
+        for (auto& t : registry().timers) if (t->name == name) return *t;
+        registry().timers.emplace_back(new Timer());
+        registry().timers.back()->name = name;
+        registry().timers.back()->memory = registry().trackAll;
+        return *registry().timers.back();
+    }
+
+    static Registry& registry() {
+        static Registry r;
+        return r;
+    }
+
+    static ThreadCounters& local() {
+        thread_local ThreadCounters* mine = nullptr;
+        if (!mine) {
+            auto* tc = new ThreadCounters();
+            for (auto& c : tc->v) c.store(0, memory_order_relaxed);
+            lock_guard<mutex> lock(registry().m);
+            registry().threads.emplace_back(tc);
+            mine = tc;
+        }
+        return *mine;
+    }
+
+    static void atomicMax(atomic<uint64_t>& a, uint64_t v) {
+        uint64_t cur = a.load(memory_order_relaxed);
+        while (v > cur && !a.compare_exchange_weak(cur, v, memory_order_relaxed)) {}
+    }
+};
+
+#define STAT_CONCAT_(a, b) a##b
+#define STAT_CONCAT(a, b) STAT_CONCAT_(a, b)
+#if GRAPH_STATS
+#define STAT_ADD(counter, n) Stats::add(counter, (uint64_t)(n))
+#define STAT_INC(counter) Stats::add(counter)
+#define STAT_PHASE(name) \
+    static Stats::Timer& STAT_CONCAT(statTimer_, __LINE__) = Stats::timer(name); \
+    Stats::Scope STAT_CONCAT(statScope_, __LINE__)(STAT_CONCAT(statTimer_, __LINE__))
+#else
+#define STAT_ADD(counter, n) ((void)0)
+#define STAT_INC(counter) ((void)0)
+#define STAT_PHASE(name) ((void)0)
+#endif
+
+// ===== Пул потоков с перехватом задач (work stealing) =====
+// У каждого рабочего потока своя очередь: он берёт задачи с её конца,
+// а простаивающие потоки "крадут" с начала чужих очередей. Поток, ожидающий
+// группу задач, тоже выполняет задачи, поэтому вложенный параллелизм безопасен.
+// Исключение из задачи не роняет рабочий поток: первое из них перебрасывается из wait().
+class ThreadPool {
+public:
+    struct Group {
+        atomic<int> pending{0};
+        mutex m;
+        condition_variable done;   // pending стал 0
+        exception_ptr error;       // первое исключение из задач группы
+    };
+
+    explicit ThreadPool(int workers) : queues(workers + 1) {
+        for (int i = 0; i < workers; ++i)
+            threads.emplace_back([this, i]() { workerLoop(i + 1); });
+    }
+
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : threads) t.join();
+    }
+
+    // общий пул для заданной степени параллелизма (вызывающий поток — один из них)
+    static ThreadPool& get(int threads) {
+        static mutex m;
+        static unordered_map<int, unique_ptr<ThreadPool>> pools;
+        lock_guard<mutex> lock(m);
+        auto& p = pools[threads];
+        if (!p) p.reset(new ThreadPool(threads - 1));
+        return *p;
+    }
+
+    void submit(Group& g, function<void()> fn) {
+        g.pending.fetch_add(1);
+        int q = workerId >= 0 && workerId < (int)queues.size() && currentPool == this
+              ? workerId : (int)(nextQueue.fetch_add(1) % queues.size());
+        {
+            lock_guard<mutex> lock(queues[q].m);
+            queues[q].tasks.push_back({move(fn), &g});
+        }
+        wake.notify_one();
+    }
+
+    // дождаться группы, помогая выполнять задачи; когда красть нечего — спать до
+    // завершения группы (с коротким тайм-аутом: могут появиться вложенные задачи)
+    void wait(Group& g) {
+        int self = currentPool == this ? workerId : 0;
+        while (g.pending.load() > 0) {
+            if (runOne(self)) continue;
+            unique_lock<mutex> lock(g.m);
+            g.done.wait_for(lock, chrono::milliseconds(1), [&]() { return g.pending.load() == 0; });
+        }
+        lock_guard<mutex> lock(g.m);
+        if (g.error) {
+            exception_ptr e = g.error;
+            g.error = nullptr;
+            rethrow_exception(e);
+        }
+    }
+
+private:
+    struct Task { function<void()> fn; Group* group; };
+    struct Queue { mutex m; deque<Task> tasks; };
+
+    vector<Queue> queues;          // [0] — очередь внешних потоков
+    vector<thread> threads;
+    atomic<unsigned> nextQueue{0};
+    mutex sleepMutex;
+    condition_variable wake;
+    bool stopping = false;
+
+    static thread_local int workerId;
+    static thread_local ThreadPool* currentPool;
+
+    bool runOne(int self) {
+        Task task;
+        bool found = false;
+        {
+            lock_guard<mutex> lock(queues[self].m);
+            if (!queues[self].tasks.empty()) {
+                task = move(queues[self].tasks.back());
+                queues[self].tasks.pop_back();
+                found = true;
+            }
+        }
+        for (size_t k = 1; !found && k < queues.size(); ++k) {
+            auto& victim = queues[(self + k) % queues.size()];
+            lock_guard<mutex> lock(victim.m);
+            if (!victim.tasks.empty()) {
+                task = move(victim.tasks.front());
+                victim.tasks.pop_front();
+                found = true;
+            }
+        }
+        if (!found) return false;
+        Group& g = *task.group;
+        exception_ptr error;
+        try {
+            task.fn();
+        } catch (...) {
+            error = current_exception();
+        }
+        lock_guard<mutex> lock(g.m);
+        if (error && !g.error) g.error = error;
+        if (g.pending.fetch_sub(1) == 1) g.done.notify_all();
+        return true;
+    }
+
+    void workerLoop(int id) {
+        workerId = id;
+        currentPool = this;
+        while (true) {
+            if (runOne(id)) continue;
+            unique_lock<mutex> lock(sleepMutex);
+            if (stopping) return;
+            wake.wait_for(lock, chrono::milliseconds(1));
+            if (stopping) return;
+        }
+    }
+};
+
+thread_local int ThreadPool::workerId = 0;
+thread_local ThreadPool* ThreadPool::currentPool = nullptr;
+
+int resolveThreads(int threads) {
+    return threads > 0 ? threads : max(1, (int)thread::hardware_concurrency());
+}
+
+// f(lo, hi) для отрезков [begin, end) длиной grain; разбиение не зависит от числа потоков
+template <class F>
+void parallelForRange(int threads, int begin, int end, F f, int grain = 1024) {
+    threads = resolveThreads(threads);
+    if (threads == 1 || end - begin <= grain) {
+        for (int lo = begin; lo < end; lo += grain) f(lo, min(end, lo + grain));
+        return;
+    }
+    ThreadPool& pool = ThreadPool::get(threads);
+    ThreadPool::Group group;
+    for (int lo = begin; lo < end; lo += grain) {
+        int hi = min(end, lo + grain);
+        pool.submit(group, [&f, lo, hi]() { f(lo, hi); });
+    }
+    pool.wait(group);
+}
+
+template <class F>
+void parallelFor(int threads, int begin, int end, F f, int grain = 1024) {
+    parallelForRange(threads, begin, end, [&f](int lo, int hi) { for (int i = lo; i < hi; ++i) f(i); }, grain);
+}
+
+// разбиение вершин по числу рёбер (offset — префиксные суммы степеней, как в CSR):
+// вершины-хабы степенно-распределённых графов не попадают все в один кусок
+template <class F>
+void parallelForWeighted(int threads, const vector<int>& offset, F f, long long grainEdges = 4096) {
+    int n = offset.empty() ? 0 : (int)offset.size() - 1;
+    vector<int> bounds{0};
+    long long acc = 0;
+    for (int v = 0; v < n; ++v) {
+        acc += offset[v + 1] - offset[v] + 1;
+        if (acc >= grainEdges) { bounds.push_back(v + 1); acc = 0; }
+    }
+    if (bounds.back() != n) bounds.push_back(n);
+    parallelFor(threads, 0, (int)bounds.size() - 1,
+                [&](int c) { f(bounds[c], bounds[c + 1]); }, 1);
+}
+
+// свёртка: map(lo, hi) по фиксированным кускам, combine — строго слева направо
+template <class T, class Map, class Combine>
+T parallelReduce(int threads, int begin, int end, T identity, Map map, Combine combine, int grain = 1024) {
+    int chunks = end > begin ? (end - begin + grain - 1) / grain : 0;
+    vector<T> part(chunks, identity);
+    parallelFor(threads, 0, chunks, [&](int c) {
+        int lo = begin + c * grain;
+        part[c] = map(lo, min(end, lo + grain));
+    }, 1);
+    T res = identity;
+    for (auto& p : part) res = combine(res, p);
+    return res;
+}
+
+// сортировка: устойчиво сортируем куски, затем попарно сливаем;
+// результат совпадает со stable_sort при любом числе потоков
+template <class T, class Cmp>
+void parallelSort(int threads, vector<T>& a, Cmp cmp, int grain = 1 << 14) {
+    int n = (int)a.size();
+    if (resolveThreads(threads) == 1 || n <= grain) {
+        stable_sort(a.begin(), a.end(), cmp);
+        return;
+    }
+    parallelForRange(threads, 0, n, [&](int lo, int hi) {
+        stable_sort(a.begin() + lo, a.begin() + hi, cmp);
+    }, grain);
+    vector<T> buf(n);
+    for (long long width = grain; width < n; width *= 2) {
+        int pairs = (int)((n + 2 * width - 1) / (2 * width));
+        parallelFor(threads, 0, pairs, [&](int p) {
+            long long lo = p * 2 * width;
+            long long mid = min<long long>(n, lo + width), hi = min<long long>(n, lo + 2 * width);
+            merge(make_move_iterator(a.begin() + lo), make_move_iterator(a.begin() + mid),
+                  make_move_iterator(a.begin() + mid), make_move_iterator(a.begin() + hi),
+                  buf.begin() + lo, cmp);
+        }, 1);
+        a.swap(buf);
+    }
+}
+
+// поразрядная сортировка (LSD, по 8 бит) по 64-битному ключу key(x). Гистограммы
+// и раскладка считаются по фиксированным кускам параллельно, поэтому сортировка
+// устойчива и не зависит от числа потоков. Байты, одинаковые у всех ключей, не
+// сортируются: для упакованных пар (u << 32 | v) на малом графе это половина проходов
+template <class T, class Key>
+void parallelRadixSort(int threads, vector<T>& a, Key key, int grain = 1 << 16) {
+    int n = (int)a.size();
+    if (n <= 1) return;
+    // какие биты вообще различаются: OR ^ AND по всем ключам
+    auto bits = parallelReduce(threads, 0, n, pair<uint64_t, uint64_t>{0, ~0ULL},
+        [&](int lo, int hi) {
+            pair<uint64_t, uint64_t> r{0, ~0ULL};
+            for (int i = lo; i < hi; ++i) { uint64_t k = key(a[i]); r.first |= k; r.second &= k; }
+            return r;
+        },
+        [](pair<uint64_t, uint64_t> x, pair<uint64_t, uint64_t> y) {
+            return make_pair(x.first | y.first, x.second & y.second);
+        }, grain);
+    uint64_t differ = bits.first ^ bits.second;
+
+    int chunks = (n + grain - 1) / grain;
+    vector<array<int, 256>> cnt(chunks);
+    vector<T> buf(n);
+    for (int shift = 0; shift < 64; shift += 8) {
+        if (((differ >> shift) & 255) == 0) continue;
+        parallelFor(threads, 0, chunks, [&](int c) {
+            auto& h = cnt[c];
+            h.fill(0);
+            for (int i = c * grain, hi = min(n, i + grain); i < hi; ++i) h[(key(a[i]) >> shift) & 255]++;
+        }, 1);
+        // начало каждого куска в каждой корзине: корзины по порядку, внутри — куски по порядку
+        int pos = 0;
+        for (int d = 0; d < 256; ++d)
+            for (int c = 0; c < chunks; ++c) { int t = cnt[c][d]; cnt[c][d] = pos; pos += t; }
+        parallelFor(threads, 0, chunks, [&](int c) {
+            auto& h = cnt[c];
+            for (int i = c * grain, hi = min(n, i + grain); i < hi; ++i)
+                buf[h[(key(a[i]) >> shift) & 255]++] = move(a[i]);
+        }, 1);
+        a.swap(buf);
+    }
+}
+
+// ===== BFS с переключением направления (direction-optimizing BFS) =====
+// Пока фронт мал — шаг «сверху вниз» по исходящим рёбрам фронта. Когда у фронта
+// рёбер больше, чем у непосещённых вершин (mf > mu / ALPHA), — шаг «снизу вверх»:
+// каждая непосещённая вершина ищет родителя среди входящих соседей в битовой
+// карте фронта и останавливается на первом найденном. Обратно — когда фронт
+// меньше n / BETA. Шаг снизу вверх параллелен по вершинам (куски кратны 64,
+// поэтому слова битовой карты не делятся между потоками); результат, включая
+// родителей, от числа потоков не зависит.
+
+struct BfsResult {
+    vector<int> dist;               // число рёбер от источника, -1 — недостижима
+    vector<int> parent;             // -1 у источника и недостижимых
+    vector<long long> levelSizes;   // levelSizes[d] — вершин на расстоянии d
+    long long reached = 0;
+    int last = -1;                  // одна из самых дальних вершин
+    int topDownSteps = 0, bottomUpSteps = 0;
+};
+
+// in — обратный CSR (для неориентированного — сам out); nullptr — только сверху вниз.
+// maxDepth — не идти дальше этого расстояния
+BfsResult directionOptimizingBFS(const CSR& out, const CSR* in, int s, int threads = 1, int maxDepth = INT_MAX) {
+    const long long ALPHA = 14, BETA = 24;
+    int n = out.vertexCount();
+    BfsResult r;
+    r.dist.assign(n, -1);
+    r.parent.assign(n, -1);
+    if (s < 0 || s >= n) return r;
+    STAT_INC(STAT_BFS_RUNS);
+
+    auto deg = [&](int v) { return (long long)out.offset[v + 1] - out.offset[v]; };
+    size_t words = ((size_t)n + 63) / 64;
+    vector<uint64_t> frontBits, nextBits;
+    vector<int> frontier{s}, next;
+    bool bottomUp = false;
+
+    r.dist[s] = 0;
+    r.levelSizes.push_back(1);
+    r.reached = 1;
+    r.last = s;
+    long long mf = deg(s), mu = out.edgeCount() - deg(s);
+
+    for (int level = 0; level < maxDepth; ++level) {
+        long long nf = r.levelSizes.back();
+        if (in && !bottomUp && mf > mu / ALPHA) {
+            bottomUp = true;
+            frontBits.assign(words, 0);
+            for (int v : frontier) frontBits[v >> 6] |= 1ULL << (v & 63);
+        } else if (bottomUp && nf < n / BETA) {
+            bottomUp = false;
+            frontier.clear();
+            for (size_t w = 0; w < words; ++w)
+                for (uint64_t bits = frontBits[w]; bits; bits &= bits - 1)
+                    frontier.push_back((int)(w * 64 + __builtin_ctzll(bits)));
+        }
+
+        long long found = 0, nextDeg = 0;
+        if (!bottomUp) {
+            next.clear();
+            for (int v : frontier) {
+                STAT_ADD(STAT_EDGES_SCANNED, deg(v));
+                for (int k = out.offset[v]; k < out.offset[v + 1]; ++k) {
+                    int to = out.target[k];
+                    if (r.dist[to] != -1) continue;
+                    r.dist[to] = level + 1;
+                    r.parent[to] = v;
+                    next.push_back(to);
+                    nextDeg += deg(to);
+                }
+            }
+            frontier.swap(next);
+            found = (long long)frontier.size();
+            if (found) r.last = frontier.back();
+            r.topDownSteps++;
+        } else {
+            nextBits.assign(words, 0);
+            struct Part { long long found = 0, deg = 0, scanned = 0; int last = -1; };
+            Part p = parallelReduce(threads, 0, n, Part(), [&](int lo, int hi) {
+                Part part;
+                for (int v = lo; v < hi; ++v) {
+                    if (r.dist[v] != -1) continue;
+                    for (int k = in->offset[v]; k < in->offset[v + 1]; ++k) {
+                        int u = in->target[k];
+                        part.scanned++;
+                        if (!(frontBits[u >> 6] >> (u & 63) & 1)) continue;
+                        r.dist[v] = level + 1;
+                        r.parent[v] = u;
+                        nextBits[v >> 6] |= 1ULL << (v & 63);
+                        part.found++;
+                        part.deg += deg(v);
+                        part.last = v;
+                        break;
+                    }
+                }
+                return part;
+            }, [](Part a, const Part& b) {
+                a.found += b.found;
+                a.deg += b.deg;
+                a.scanned += b.scanned;
+                if (b.last != -1) a.last = b.last;
+                return a;
+            }, 4096);
+            STAT_ADD(STAT_EDGES_SCANNED, p.scanned);
+            frontBits.swap(nextBits);
+            found = p.found;
+            nextDeg = p.deg;
+            if (found) r.last = p.last;
+            r.bottomUpSteps++;
+        }
+
+        if (found == 0) break;
+        STAT_ADD(STAT_BFS_VISITED, found);
+        r.levelSizes.push_back(found);
+        r.reached += found;
+        mu -= nextDeg;
+        mf = nextDeg;
+    }
+    return r;
+}
+
+// ===== Наблюдатели изменений графа =====
+// Вызываются после успешного изменения; индексы — уже в новой нумерации, кроме
+// onRemovePoint, куда передаётся прежний индекс удалённой вершины. Наблюдатели
+// не копируются вместе с графом и должны отписаться до его уничтожения.
+class Graph;
+
+class GraphListener {
+public:
+    virtual ~GraphListener() = default;
+    virtual void onAddPoint(const Graph&, int /*v*/) {}
+    virtual void onRemovePoint(const Graph&, int /*oldIndex*/, const string& /*name*/) {}
+    virtual void onAddEdge(const Graph&, int /*from*/, int /*to*/, int /*weight*/) {}
+    virtual void onRemoveEdge(const Graph&, int /*from*/, int /*to*/) {}
+    virtual void onSetEdgeWeight(const Graph&, int /*from*/, int /*to*/, int /*oldWeight*/, int /*newWeight*/) {}
+    // массовое изменение (перенумерация вершин): состояние нужно построить заново
+    virtual void onRebuild(const Graph&) {}
+};
+
 class Graph {
 private:
     bool directed;   
+    int threads = 0;  // число потоков для параллельных алгоритмов (0 = по числу ядер)
+    bool verbose = true;                  // печатать сообщения addPoint/addEdge/...
+    unordered_map<string, int> nameIndex; // имя вершины -> индекс в adjList
+    vector<GraphListener*> listeners;     // не копируются
+
+    void rebuildIndex();
 public:    
     vector<Point> adjList;
 
     // конструкторы
     Graph(bool dir = false) : directed(dir) {}               
-    Graph(const string& filePath, bool dir = false);         
+    Graph(const string& filePath, bool dir = false, bool verb = true,
+          VertexOrder order = VertexOrder::Original);
     Graph(const Graph& other);                               
+    Graph& operator=(const Graph& other);    // наблюдатели остаются свои и получают onRebuild
+
+    bool isDirected() const { return directed; }
+
+    // степень параллелизма; результаты алгоритмов от неё не зависят
+    void setThreads(int t) { threads = max(0, t); }
+    int threadCount() const { return resolveThreads(threads); }
+
+    void setVerbose(bool v) { verbose = v; }
+
+    void addListener(GraphListener* l) { listeners.push_back(l); }
+    void removeListener(GraphListener* l) { listeners.erase(remove(listeners.begin(), listeners.end(), l), listeners.end()); }
 
     void addPoint(const string& name);
     void addEdge(const string& from, const string& to, int weight = 1);
+    // быстрое добавление по индексам без проверки дубликатов (для генераторов)
+    void addEdgeByIndex(int i, int j, int weight = 1);
     void removePoint(const string& name);
     void removeEdge(const string& from, const string& to);
+    void setEdgeWeight(const string& from, const string& to, int weight);
     void printAdjList(const string& filePath) const;
     void saveToFile(const string& filePath) const;
     int findVertex(const string& name) const;
+    const unordered_map<string, int>& indexMap() const { return nameIndex; }
+    CSR toCSR(bool reversed = false) const;
+    // рёбра по индексам, отсортированные по (u, v); у неориентированного графа — по разу (u <= v)
+    vector<IndexedEdge> canonicalEdges(EdgeMerge merge) const;
 
     void findCommonTarget(const string& u, const string& v) const;
     void printDegrees() const;
@@ -49,13 +748,25 @@ public:
     Graph getReversed() const;
 
     void kruskalMST() const;
+    vector<IndexedEdge> kruskalEdges() const;
 
     void verticesAllDistances() const;
+    vector<long long> dijkstraDistances(int start, vector<int>* parent = nullptr) const;
     void bellmanFord(const string& start);
+    bool bellmanFordDistances(int start, vector<long long>& dist) const;
     void floydPeriphery(const string& start, int N) const;
 
     int edmondsKarp(const string& sourceName, const string& sinkName) const;
 
+    // BFS по числу рёбер (с переключением направления, см. directionOptimizingBFS)
+    BfsResult bfs(int start, int maxDepth = INT_MAX) const;
+    int maxFlow(int s, int t) const;
+
+    // перенумерация вершин для локальности (см. VertexOrder)
+    vector<int> computeOrder(VertexOrder method, unsigned seed = 1) const;
+    Relabeling reorder(VertexOrder method, unsigned seed = 1);
+    double averageEdgeGap(int* bandwidth = nullptr) const;
+
     // вспомогательные: подсчёт числа вершин и рёбер 
     // (для неориентированного учитываем каждое неориентир. ребро 1 раз)
     int vertexCount() const {
@@ -69,24 +780,35 @@ public:
         return cnt;
     }
 
-    // DFS для подсчёта компонент (рассматриваем граф как неориентированный)
+    // DFS для подсчёта компонент (рассматриваем граф как неориентированный);
+    // с явным стеком, чтобы длинные цепочки не переполняли стек вызовов
     void dfsUndir(int v, vector<char>& used) const {
+        vector<int> st{v};
         used[v] = 1;
-        for (const auto& e : adjList[v].adj) {
-            int to = findVertex(e.to);
-            if (to != -1 && !used[to]) dfsUndir(to, used);
+        while (!st.empty()) {
+            int u = st.back(); st.pop_back();
+            for (const auto& e : adjList[u].adj) {
+                int to = findVertex(e.to);
+                if (to != -1 && !used[to]) { used[to] = 1; st.push_back(to); }
+            }
         }
     }
 
     // проверка на циклы в неориентированном графе (DFS с родителем)
     bool hasCycleUndirUtil(int v, int parent, vector<char>& used) const {
+        // кадр стека: (вершина, родитель, номер следующего ребра)
+        struct Frame { int v, parent; size_t next; };
+        vector<Frame> st{{v, parent, 0}};
         used[v] = 1;
-        for (const auto& e : adjList[v].adj) {
-            int to = findVertex(e.to);
+        while (!st.empty()) {
+            Frame& f = st.back();
+            if (f.next == adjList[f.v].adj.size()) { st.pop_back(); continue; }
+            int to = findVertex(adjList[f.v].adj[f.next++].to);
             if (to == -1) continue;
             if (!used[to]) {
-                if (hasCycleUndirUtil(to, v, used)) return true;
-            } else if (to != parent) {
+                used[to] = 1;
+                st.push_back({to, f.v, 0});
+            } else if (to != f.parent) {
                 // нашли обратное посещённое ребро (и не родитель) -> цикл
                 return true;
             }
@@ -108,18 +830,25 @@ public:
     // проверка на циклы в ориентированном графе 
     // (DFS с раскраской: 0=white,1=gray,2=black)
     bool hasCycleDirUtil(int v, vector<int>& color) const {
+        vector<pair<int, size_t>> st{{v, 0}}; // (вершина, номер следующего ребра)
         color[v] = 1; // gray
-        for (const auto& e : adjList[v].adj) {
-            int to = findVertex(e.to);
+        while (!st.empty()) {
+            auto& [u, next] = st.back();
+            if (next == adjList[u].adj.size()) {
+                color[u] = 2; // black
+                st.pop_back();
+                continue;
+            }
+            int to = findVertex(adjList[u].adj[next++].to);
             if (to == -1) continue;
             if (color[to] == 0) {
-                if (hasCycleDirUtil(to, color)) return true;
+                color[to] = 1;
+                st.push_back({to, 0});
             } else if (color[to] == 1) {
                 // нашли обратную (серую) вершину -> цикл
                 return true;
             }
         }
-        color[v] = 2; // black
         return false;
     }
 
@@ -151,13 +880,16 @@ public:
     // подсчёт входных степеней (для ориентированного графа)
     vector<int> indegrees() const {
         int n = vertexCount();
-        vector<int> indeg(n, 0);
-        for (int i = 0; i < n; ++i) {
+        const auto& idx = indexMap();
+        vector<atomic<int>> cnt(n);
+        parallelFor(threadCount(), 0, n, [&](int i) {
             for (const auto& e : adjList[i].adj) {
-                int to = findVertex(e.to);
-                if (to != -1) indeg[to]++;
+                auto it = idx.find(e.to);
+                if (it != idx.end()) cnt[it->second].fetch_add(1, memory_order_relaxed);
             }
-        }
+        }, 256);
+        vector<int> indeg(n);
+        for (int i = 0; i < n; ++i) indeg[i] = cnt[i].load();
         return indeg;
     }
 
@@ -196,22 +928,7 @@ public:
         // 3) корень должен быть способен достичь все вершины (проверим достижимость из найденного корня)
         int root = -1;
         for (int i = 0; i < n; ++i) if (indeg[i] == 0) { root = i; break; }
-        // BFS/DFS по ориентированным рёбрам
-        vector<char> used(n, 0);
-        // простой стек DFS:
-        vector<int> st; st.push_back(root); used[root] = 1;
-        while (!st.empty()) {
-            int v = st.back(); st.pop_back();
-            for (const auto& e : adjList[v].adj) {
-                int to = findVertex(e.to);
-                if (to != -1 && !used[to]) {
-                    used[to] = 1;
-                    st.push_back(to);
-                }
-            }
-        }
-        for (int i = 0; i < n; ++i) if (!used[i]) return false;
-        return true;
+        return bfs(root).reached == n;
     }
 
     // ориентированный лес арборесценций: нет ориентированных циклов и indeg <= 1 for all vertices
@@ -238,45 +955,41 @@ public:
     }
 
     vector<string> verticesWithinK(int k) const {
+    STAT_PHASE("verticesWithinK");
     vector<string> result;
     int n = vertexCount();
+    if (k < 0) return result;
+
+    // BFS от каждой вершины, не глубже k: все ли вершины достигнуты.
+    // Параллельно по источникам, каждый BFS — в одном потоке
+    CSR out = toCSR();
+    CSR in = directed ? toCSR(true) : CSR();
+    const CSR* rev = directed ? &in : &out;
+    vector<char> ok(n, 0);
+    parallelFor(threadCount(), 0, n, [&](int i) {
+        ok[i] = directionOptimizingBFS(out, rev, i, 1, k).reached == n;
+    }, 1);
 
-    for (int i = 0; i < n; ++i) {
-        vector<int> dist(n, -1); // -1 = не достигнута
-        queue<int> q;
-        dist[i] = 0;
-        q.push(i);
-
-        while (!q.empty()) {
-            int v = q.front(); q.pop();
-            for (const auto& e : adjList[v].adj) {
-                int to = findVertex(e.to);
-                if (to != -1 && dist[to] == -1) {
-                    dist[to] = dist[v] + 1;
-                    q.push(to);
-                }
-            }
-        }
-
-        // проверяем, все расстояния ≤ k
-        bool ok = true;
-        for (int d : dist) {
-            if (d == -1 || d > k) {
-                ok = false;
-                break;
-            }
-        }
-
-        if (ok) result.push_back(adjList[i].adress);
-    }
-
+    for (int i = 0; i < n; ++i)
+        if (ok[i]) result.push_back(adjList[i].adress);
     return result;
     }
     };
 
+// игровой граф с секциями "nodes:" и "edges:" (см. PursuitGame)
+bool isGameGraphFile(const string& filePath);
+Graph loadGameGraph(const string& filePath, bool directed = false, vector<pair<int, int>>* coords = nullptr);
+
 // реализация
 
-Graph::Graph(const string& filePath, bool dir) : directed(dir) {
+Graph::Graph(const string& filePath, bool dir, bool verb, VertexOrder order) : directed(dir), verbose(verb) {
+    STAT_PHASE("load");
+    if (isGameGraphFile(filePath)) {
+        *this = loadGameGraph(filePath, dir);
+        verbose = verb;
+        if (order != VertexOrder::Original) reorder(order);
+        return;
+    }
     ifstream fin(filePath);
     if (!fin.is_open()) throw runtime_error("Не удалось открыть файл");
 
@@ -287,24 +1000,152 @@ Graph::Graph(const string& filePath, bool dir) : directed(dir) {
         addPoint(to);
         addEdge(from, to, w);
     }
+    if (order != VertexOrder::Original) reorder(order);
 }
 
-Graph::Graph(const Graph& other) : directed(other.directed), adjList(other.adjList) {}
+Graph::Graph(const Graph& other)
+    : directed(other.directed), threads(other.threads), verbose(other.verbose),
+      nameIndex(other.nameIndex), adjList(other.adjList) {}
+
+Graph& Graph::operator=(const Graph& other) {
+    directed = other.directed;
+    threads = other.threads;
+    verbose = other.verbose;
+    nameIndex = other.nameIndex;
+    adjList = other.adjList;
+    for (auto* l : listeners) l->onRebuild(*this);
+    return *this;
+}
 
 int Graph::findVertex(const string& name) const {
-    for (int i = 0; i < (int)adjList.size(); i++)
-        if (adjList[i].adress == name) return i;
-    return -1;
+    STAT_INC(STAT_FIND_VERTEX);
+    auto it = nameIndex.find(name);
+    return it == nameIndex.end() ? -1 : it->second;
+}
+
+// пересчитать индекс имён после сдвига вершин в adjList
+void Graph::rebuildIndex() {
+    nameIndex.clear();
+    nameIndex.reserve(adjList.size());
+    for (int i = 0; i < (int)adjList.size(); ++i)
+        nameIndex[adjList[i].adress] = i;
+}
+
+// построить CSR по списку смежности (reversed = рёбра в обратную сторону)
+CSR Graph::toCSR(bool reversed) const {
+    int n = vertexCount();
+    const auto& idx = indexMap();
+
+    CSR csr;
+    csr.offset.assign(n + 1, 0);
+
+    // 1) считаем количество рёбер у каждой вершины
+    vector<pair<int,int>> ends; // (from, to) для каждого ребра в порядке обхода
+    ends.reserve(edgeCount() * (directed ? 1 : 2));
+    for (int i = 0; i < n; ++i) {
+        for (const auto& e : adjList[i].adj) {
+            auto it = idx.find(e.to);
+            if (it == idx.end()) { ends.push_back({-1, -1}); continue; }
+            int u = reversed ? it->second : i;
+            int v = reversed ? i : it->second;
+            ends.push_back({u, v});
+            csr.offset[u + 1]++;
+        }
+    }
+    for (int i = 0; i < n; ++i) csr.offset[i + 1] += csr.offset[i];
+
+    // 2) раскладываем рёбра по позициям
+    csr.target.resize(csr.offset[n]);
+    csr.weight.resize(csr.offset[n]);
+    vector<int> pos(csr.offset.begin(), csr.offset.end() - 1);
+    size_t k = 0;
+    for (int i = 0; i < n; ++i) {
+        for (const auto& e : adjList[i].adj) {
+            auto [u, v] = ends[k++];
+            if (u == -1) continue;
+            csr.target[pos[u]] = v;
+            csr.weight[pos[u]] = e.weight;
+            pos[u]++;
+        }
+    }
+    return csr;
+}
+
+// канонический список рёбер: общий для экспорта, остова и потоков.
+// Сбор — параллельно по вершинам (число рёбер, префиксные суммы, запись на свои места),
+// порядок — поразрядной сортировкой ключей (u << 32 | v), слияние кратных рёбер —
+// параллельно по кускам. Результат не зависит от числа потоков
+vector<IndexedEdge> Graph::canonicalEdges(EdgeMerge merge) const {
+    STAT_PHASE("canonical_edges");
+    int n = vertexCount();
+    int threads = threadCount();
+    const auto& idx = indexMap();
+
+    // 1) сбор: имена концов переводятся в индексы за один проход (места — по длинам списков),
+    // затем подсчёт и запись на свои позиции. Неориентированное ребро хранится в обоих
+    // списках — берём экземпляр с u <= v
+    vector<int> adjPos(n + 1, 0);
+    for (int i = 0; i < n; ++i) adjPos[i + 1] = adjPos[i] + (int)adjList[i].adj.size();
+    vector<int> target(adjPos[n]);
+    vector<int> pos(n + 1, 0);
+    parallelFor(threads, 0, n, [&](int i) {
+        int k = adjPos[i];
+        for (const auto& e : adjList[i].adj) {
+            auto it = idx.find(e.to);
+            int j = it == idx.end() ? -1 : it->second;
+            target[k++] = j;
+            if (j != -1 && (directed || i <= j)) pos[i + 1]++;
+        }
+    }, 256);
+    for (int i = 0; i < n; ++i) pos[i + 1] += pos[i];
+    vector<IndexedEdge> edges(pos[n]);
+    parallelFor(threads, 0, n, [&](int i) {
+        int k = pos[i], a = adjPos[i];
+        for (const auto& e : adjList[i].adj) {
+            int j = target[a++];
+            if (j != -1 && (directed || i <= j)) edges[k++] = {i, j, e.weight};
+        }
+    }, 256);
+
+    // 2) сортировка по (u, v); устойчивая — кратные рёбра остаются в порядке списка смежности
+    auto key = [](const IndexedEdge& e) { return (uint64_t)(uint32_t)e.u << 32 | (uint32_t)e.v; };
+    parallelRadixSort(threads, edges, key);
+    if (merge == EdgeMerge::Keep) return edges;
+
+    // 3) слияние: каждый кусок пишет головы своих серий, серия может продолжаться в следующем куске
+    const int grain = 1 << 16;
+    int m = (int)edges.size();
+    int chunks = (m + grain - 1) / grain;
+    auto isHead = [&](int i) { return i == 0 || key(edges[i - 1]) != key(edges[i]); };
+    vector<int> outPos(chunks + 1, 0);
+    parallelFor(threads, 0, chunks, [&](int c) {
+        for (int i = c * grain, hi = min(m, i + grain); i < hi; ++i) outPos[c + 1] += isHead(i);
+    }, 1);
+    for (int c = 0; c < chunks; ++c) outPos[c + 1] += outPos[c];
+    vector<IndexedEdge> merged(outPos[chunks]);
+    parallelFor(threads, 0, chunks, [&](int c) {
+        int k = outPos[c];
+        for (int i = c * grain, hi = min(m, i + grain); i < hi; ++i) {
+            if (!isHead(i)) continue;
+            IndexedEdge r = edges[i];
+            for (int j = i + 1; j < m && key(edges[j]) == key(r); ++j)
+                r.w = merge == EdgeMerge::Min ? min(r.w, edges[j].w) : r.w + edges[j].w;
+            merged[k++] = r;
+        }
+    }, 1);
+    return merged;
 }
 
 // добавить вершину
 void Graph::addPoint(const string& name) {
     if (findVertex(name) != -1) {
-        cout << "Вершина \"" << name << "\" уже существует.\n";
+        if (verbose) cout << "Вершина \"" << name << "\" уже существует.\n";
         return;
     }
+    nameIndex[name] = (int)adjList.size();
     adjList.push_back(Point(name));
-    cout << "Вершина \"" << name << "\" успешно добавлена.\n";
+    for (auto* l : listeners) l->onAddPoint(*this, (int)adjList.size() - 1);
+    if (verbose) cout << "Вершина \"" << name << "\" успешно добавлена.\n";
 }
 
 // добавить ребро
@@ -314,13 +1155,13 @@ void Graph::addEdge(const string& from, const string& to, int weight) {
 
     // проверяем существование вершин
     if (i == -1 && j == -1) {
-        cout << "Вершины \"" << from << "\" и \"" << to << "\" не существуют. Ребро добавить невозможно.\n";
+        if (verbose) cout << "Вершины \"" << from << "\" и \"" << to << "\" не существуют. Ребро добавить невозможно.\n";
         return;
     } else if (i == -1) {
-        cout << "Вершина \"" << from << "\" не существует. Ребро добавить невозможно.\n";
+        if (verbose) cout << "Вершина \"" << from << "\" не существует. Ребро добавить невозможно.\n";
         return;
     } else if (j == -1) {
-        cout << "Вершина \"" << to << "\" не существует. Ребро добавить невозможно.\n";
+        if (verbose) cout << "Вершина \"" << to << "\" не существует. Ребро добавить невозможно.\n";
         return;
     }
 
@@ -329,7 +1170,7 @@ void Graph::addEdge(const string& from, const string& to, int weight) {
     bool exists = any_of(edges.begin(), edges.end(), [&](const Edge& e) { return e.to == to; });
 
     if (exists) {
-        cout << "Ребро \"" << from << " -> " << to << "\" уже существует. Добавление не выполнено.\n";
+        if (verbose) cout << "Ребро \"" << from << " -> " << to << "\" уже существует. Добавление не выполнено.\n";
         return;
     }
 
@@ -340,19 +1181,27 @@ void Graph::addEdge(const string& from, const string& to, int weight) {
         adjList[j].adj.push_back(Edge(from, weight));
     }
 
-    cout << "Ребро \"" << from << " -> " << to << "\" добавлено.\n";
+    for (auto* l : listeners) l->onAddEdge(*this, i, j, weight);
+    if (verbose) cout << "Ребро \"" << from << " -> " << to << "\" добавлено.\n";
 }
 
 
+void Graph::addEdgeByIndex(int i, int j, int weight) {
+    adjList[i].adj.push_back(Edge(adjList[j].adress, weight));
+    if (!directed && i != j) adjList[j].adj.push_back(Edge(adjList[i].adress, weight));
+    for (auto* l : listeners) l->onAddEdge(*this, i, j, weight);
+}
+
 // удалить вершину
 void Graph::removePoint(const string& name) {
     int idx = findVertex(name);
     if (idx == -1) {
-        cout << "Вершина \"" << name << "\" не существует.\n";
+        if (verbose) cout << "Вершина \"" << name << "\" не существует.\n";
         return;
     }
 
     adjList.erase(adjList.begin() + idx);
+    rebuildIndex();
 
     // удаляем все рёбра, ведущие к этой вершине
     for (auto& v : adjList) {
@@ -361,7 +1210,8 @@ void Graph::removePoint(const string& name) {
                     v.adj.end());
     }
 
-    cout << "Вершина \"" << name << "\" удалена.\n";
+    for (auto* l : listeners) l->onRemovePoint(*this, idx, name);
+    if (verbose) cout << "Вершина \"" << name << "\" удалена.\n";
 }
 
 
@@ -372,24 +1222,25 @@ void Graph::removeEdge(const string& from, const string& to) {
 
     // проверяем существование вершин
     if (i == -1 && j == -1) {
-        cout << "Вершины \"" << from << "\" и \"" << to << "\" не существуют. Ребро удалить невозможно.\n";
+        if (verbose) cout << "Вершины \"" << from << "\" и \"" << to << "\" не существуют. Ребро удалить невозможно.\n";
         return;
     } else if (i == -1) {
-        cout << "Вершина \"" << from << "\" не существует. Ребро удалить невозможно.\n";
+        if (verbose) cout << "Вершина \"" << from << "\" не существует. Ребро удалить невозможно.\n";
         return;
     } else if (j == -1) {
-        cout << "Вершина \"" << to << "\" не существует. Ребро удалить невозможно.\n";
+        if (verbose) cout << "Вершина \"" << to << "\" не существует. Ребро удалить невозможно.\n";
         return;
     }
 
     auto& edgesFrom = adjList[i].adj;
     auto it = remove_if(edgesFrom.begin(), edgesFrom.end(), [&](Edge& e) { return e.to == to; });
 
-    if (it == edgesFrom.end()) { // ребро не найдено
-        cout << "Ребро \"" << from << " -> " << to << "\" не существует.\n";
+    bool found = it != edgesFrom.end();
+    if (!found) { // ребро не найдено
+        if (verbose) cout << "Ребро \"" << from << " -> " << to << "\" не существует.\n";
     } else {
         edgesFrom.erase(it, edgesFrom.end());
-        cout << "Ребро \"" << from << " -> " << to << "\" удалено.\n";
+        if (verbose) cout << "Ребро \"" << from << " -> " << to << "\" удалено.\n";
     }
 
     if (!directed) {
@@ -397,6 +1248,33 @@ void Graph::removeEdge(const string& from, const string& to) {
         edgesTo.erase(remove_if(edgesTo.begin(), edgesTo.end(), [&](Edge& e) { return e.to == from; }),
                       edgesTo.end());
     }
+    if (found)
+        for (auto* l : listeners) l->onRemoveEdge(*this, i, j);
+}
+
+// изменить вес существующего ребра (для неориентированного — в обе стороны)
+void Graph::setEdgeWeight(const string& from, const string& to, int weight) {
+    int i = findVertex(from);
+    int j = findVertex(to);
+    if (i == -1 || j == -1) {
+        if (verbose) cout << "Вершина \"" << (i == -1 ? from : to) << "\" не существует.\n";
+        return;
+    }
+
+    auto& edges = adjList[i].adj;
+    auto it = find_if(edges.begin(), edges.end(), [&](const Edge& e) { return e.to == to; });
+    if (it == edges.end()) {
+        if (verbose) cout << "Ребро \"" << from << " -> " << to << "\" не существует.\n";
+        return;
+    }
+    int old = it->weight;
+    it->weight = weight;
+    if (!directed && i != j)
+        for (auto& e : adjList[j].adj)
+            if (e.to == from) e.weight = weight;
+
+    for (auto* l : listeners) l->onSetEdgeWeight(*this, i, j, old, weight);
+    if (verbose) cout << "Вес ребра \"" << from << " -> " << to << "\" изменён: " << old << " -> " << weight << ".\n";
 }
 
 // найти общую вершину назначения для двух вершин-источников
@@ -443,20 +1321,26 @@ void Graph::saveToFile(const string& filePath) const {
     ofstream fout(filePath);
     if (!fout.is_open()) throw runtime_error("Не удалось открыть файл");
 
-    for (const auto& v : adjList) {
-        for (const auto& e : v.adj) {
-            if (directed) {
-                // для ориентированного графа сохраняем всё
-                fout << v.adress << " " << e.to << " " << e.weight << "\n";
-            } else {
-                // для неориентированного графа:
-                // записываем ребро, если from < to или это петля (from == to)
-                if (v.adress < e.to || v.adress == e.to) {
-                    fout << v.adress << " " << e.to << " " << e.weight << "\n";
-                }
-            }
+    // ориентированный граф сохраняется целиком, неориентированный — по разу на ребро
+    // (from <= to по индексам, петли один раз); кратные рёбра сохраняются все.
+    // Строки формируются параллельно по кускам и пишутся по порядку
+    auto edges = canonicalEdges(EdgeMerge::Keep);
+    const int grain = 1 << 14;
+    int m = (int)edges.size();
+    vector<string> text((m + grain - 1) / grain);
+    parallelFor(threadCount(), 0, (int)text.size(), [&](int c) {
+        string& s = text[c];
+        for (int i = c * grain, hi = min(m, i + grain); i < hi; ++i) {
+            const auto& e = edges[i];
+            s += adjList[e.u].adress;
+            s += ' ';
+            s += adjList[e.v].adress;
+            s += ' ';
+            s += to_string(e.w);
+            s += '\n';
         }
-    }
+    }, 1);
+    for (const auto& s : text) fout << s;
 }
 
 // вывести список смежности в файл
@@ -475,18 +1359,13 @@ void Graph::printAdjList(const string& filePath) const {
 void Graph::printDegrees() const {
     cout << "\nСтепени вершин:\n";
 
-    for (const auto& v : adjList) {
-        int outDeg = v.adj.size(); // исходящая степень
-        int inDeg = 0;             // входящая степень
+    // входящие степени считаются параллельно за один проход по рёбрам
+    auto indeg = indegrees();
 
-        // считаем входящие рёбра
-        for (const auto& u : adjList) {
-            for (const auto& e : u.adj) {
-                if (e.to == v.adress) {
-                    inDeg++;
-                }
-            }
-        }
+    for (int i = 0; i < vertexCount(); ++i) {
+        const auto& v = adjList[i];
+        int outDeg = v.adj.size(); // исходящая степень
+        int inDeg = indeg[i];      // входящая степень
 
         if (directed) {
             cout << v.adress << ": входящая = " << inDeg 
@@ -524,49 +1403,27 @@ Graph Graph::getReversed() const {
     return reversed;
 }
 
-void Graph::kruskalMST() const {
-    // Алгоритм Краскала работает только для неориентированных графов
-    if (directed) {
-        cout << "Kruskal: граф ориентированный — алгоритм применим только к неориентированным графам.\n";
-        return;
-    }
-
-    // вспомогательная запись ребра: индексы вершин + вес
-    struct ERec { int u, v, w; };
-
+// рёбра минимального остова (леса) в порядке добавления алгоритмом Краскала
+vector<IndexedEdge> Graph::kruskalEdges() const {
+    STAT_PHASE("kruskal");
     int n = (int)adjList.size();
-    if (n == 0) {
-        cout << "Граф пустой.\n";
-        return;
-    }
-
-    // 1) Собираем все рёбра (для неориентированного — только один раз: i < j)
-    vector<ERec> edges;
-    for (int i = 0; i < n; ++i) {
-        for (const auto& e : adjList[i].adj) {
-            int j = findVertex(e.to);
-            if (j == -1) continue; // защита на случай неконсистентности
-            if (i < j) { // добавляем только один экземпляр ребра для неориентированного графа
-                edges.push_back({i, j, e.weight});
-            }
-        }
-    }
 
-    if (edges.empty()) {
-        cout << "В графе нет рёбер.\n";
-        return;
-    }
+    // 1) Канонический список: по разу на ребро, из кратных — самое лёгкое; петли в остов не входят
+    auto edges = canonicalEdges(EdgeMerge::Min);
+    edges.erase(remove_if(edges.begin(), edges.end(), [](const IndexedEdge& e) { return e.u == e.v; }),
+                edges.end());
 
-    // 2) Сортируем рёбра по весу
-    sort(edges.begin(), edges.end(), [](const ERec& a, const ERec& b) {
-        return a.w < b.w;
+    // 2) Сортируем рёбра по весу поразрядно (знаковый вес -> беззнаковый ключ с тем же порядком);
+    // сортировка устойчивая — при равных весах порядок (u, v), от числа потоков не зависит
+    parallelRadixSort(threadCount(), edges, [](const IndexedEdge& e) {
+        return (uint64_t)((uint32_t)e.w ^ 0x80000000u);
     });
 
     // 3) DSU (Union-Find) по индексам 0..n-1
     struct DSU {
         vector<int> p, r;
         DSU(int n=0) { p.resize(n); r.assign(n,0); for (int i=0;i<n;++i) p[i]=i; }
-        int find(int a) { return p[a]==a ? a : p[a]=find(p[a]); }
+        int find(int a) { while (p[a] != a) a = p[a] = p[p[a]]; return a; }
         bool unite(int a, int b) {
             a = find(a); b = find(b);
             if (a==b) return false;
@@ -577,27 +1434,50 @@ void Graph::kruskalMST() const {
         }
     } dsu(n);
 
-    // 4) Построим MST в новом графе mst
-    Graph mst(false); // неориентированный
-    for (const auto& pt : adjList) mst.addPoint(pt.adress); // добавим все вершины в MST
-
-    int totalWeight = 0;
-    vector<ERec> mstEdges;
-
-    cout << "\n--- Алгоритм Краскала ---\n";
-    for (const auto& er : edges) {
-        if (dsu.find(er.u) != dsu.find(er.v)) {
-            dsu.unite(er.u, er.v);
-            mst.addEdge(adjList[er.u].adress, adjList[er.v].adress, er.w);
+    vector<IndexedEdge> mstEdges;
+    for (const auto& er : edges)
+        if (dsu.unite(er.u, er.v)) {
             mstEdges.push_back(er);
-            totalWeight += er.w;
-            cout << "Добавлено ребро: " << adjList[er.u].adress 
-                 << " - " << adjList[er.v].adress 
-                 << " (вес = " << er.w << ")\n";
+            STAT_INC(STAT_DSU_UNIONS);
         }
+    return mstEdges;
+}
+
+void Graph::kruskalMST() const {
+    // Алгоритм Краскала работает только для неориентированных графов
+    if (directed) {
+        cout << "Kruskal: граф ориентированный — алгоритм применим только к неориентированным графам.\n";
+        return;
     }
 
-    cout << "Суммарный вес минимального остова: " << totalWeight << "\n";
+    int n = (int)adjList.size();
+    if (n == 0) {
+        cout << "Граф пустой.\n";
+        return;
+    }
+    if (edgeCount() == 0) {
+        cout << "В графе нет рёбер.\n";
+        return;
+    }
+
+    auto mstEdges = kruskalEdges();
+
+    // Построим MST в новом графе mst
+    Graph mst(false); // неориентированный
+    for (const auto& pt : adjList) mst.addPoint(pt.adress); // добавим все вершины в MST
+
+    int totalWeight = 0;
+
+    cout << "\n--- Алгоритм Краскала ---\n";
+    for (const auto& er : mstEdges) {
+        mst.addEdge(adjList[er.u].adress, adjList[er.v].adress, er.w);
+        totalWeight += er.w;
+        cout << "Добавлено ребро: " << adjList[er.u].adress 
+             << " - " << adjList[er.v].adress 
+             << " (вес = " << er.w << ")\n";
+    }
+
+    cout << "Суммарный вес минимального остова: " << totalWeight << "\n";
 
     // Сохраним результат в файл
     try {
@@ -608,6 +1488,39 @@ void Graph::kruskalMST() const {
     }
 }
 
+// Дейкстра из start: расстояния (LLONG_MAX / 4 — недостижима) и, по желанию, родители
+vector<long long> Graph::dijkstraDistances(int start, vector<int>* parent) const {
+    STAT_PHASE("dijkstra");
+    const long long INF = LLONG_MAX / 4;
+    int n = vertexCount();
+    vector<long long> dist(n, INF);
+    if (parent) parent->assign(n, -1);
+    dist[start] = 0;
+
+    // min-куча: (dist, vertex_index)
+    priority_queue<pair<long long,int>, vector<pair<long long,int>>, greater<pair<long long,int>>> pq;
+    pq.push({0, start});
+
+    while (!pq.empty()) {
+        auto [d, v] = pq.top(); pq.pop();
+        if (d != dist[v]) continue; // устаревшая запись в куче
+
+        // проходим все вершины-соседи v (используем adjList)
+        for (const auto& e : adjList[v].adj) {
+            int to = findVertex(e.to);
+            if (to == -1) continue; // защита от неконсистентности
+            if (d + e.weight < dist[to]) {
+                dist[to] = d + e.weight;
+                if (parent) (*parent)[to] = v;
+                pq.push({dist[to], to});
+                STAT_INC(STAT_RELAXATIONS);
+                STAT_INC(STAT_HEAP_PUSHES);
+            }
+        }
+    }
+    return dist;
+}
+
 void Graph::verticesAllDistances() const {
     if (adjList.empty()) {
         cout << "Граф пуст.\n";
@@ -624,245 +1537,5874 @@ void Graph::verticesAllDistances() const {
         return;
     }
 
-    const int INF = INT_MAX / 4;
+    const long long INF = LLONG_MAX / 4;
     int n = vertexCount();
-    vector<int> dist(n, INF);
-    vector<int> parent(n, -1); // опционально: чтобы восстановить пути
-    dist[s] = 0;
+    auto dist = dijkstraDistances(s);
 
-    // min-куча: (dist, vertex_index)
-    priority_queue<pair<int,int>, vector<pair<int,int>>, greater<pair<int,int>>> pq;
-    pq.push({0, s});
+    // вывод расстояний
+    cout << "\nКратчайшие расстояния от вершины " << startName << ":\n";
+    for (int i = 0; i < n; ++i) {
+        cout << adjList[i].adress << " : ";
+        if (dist[i] == INF) cout << "недостижима\n";
+        else cout << dist[i] << "\n";
+    }
+
+    // если тебе нужно проверить условие "все расстояния <= N",
+    // можно спросить N и проверить:
+    char ask;
+    cout << "\nПроверить, что все расстояния ≤ N? (y/n): ";
+    cin >> ask;
+    if (ask == 'y' || ask == 'Y') {
+        int N;
+        cout << "Введите N: ";
+        cin >> N;
+        bool ok = true;
+        for (int i = 0; i < n; ++i) {
+            if (i == s) continue;
+            if (dist[i] == INF || dist[i] > N) { ok = false; break; }
+        }
+        if (ok) cout << "Все расстояния от " << startName << " до остальных ≤ " << N << "\n";
+        else cout << "Не все расстояния ≤ " << N << "\n";
+    }
+}
+
+// Беллман–Форд по "тянущей" схеме: на каждом проходе каждая вершина
+// берёт минимум по входящим рёбрам из расстояний предыдущего прохода.
+// Вершины обрабатываются параллельно, результат от числа потоков не зависит.
+// Возвращает false, если из start достижим цикл отрицательного веса.
+bool Graph::bellmanFordDistances(int start, vector<long long>& dist) const {
+    STAT_PHASE("bellmanFord");
+    int n = vertexCount();
+    const long long INF = LLONG_MAX / 4;
+    CSR in = toCSR(true);
+    dist.assign(n, INF);
+    dist[start] = 0;
+    vector<long long> next(dist);
+
+    // n-1 проходов достаточно; n-й проход проверяет отрицательные циклы
+    for (int i = 0; i < n; ++i) {
+        atomic<bool> updated(false);
+        STAT_INC(STAT_BF_SWEEPS);
+        parallelForWeighted(threadCount(), in.offset, [&](int lo, int hi) {
+            bool local = false;
+            uint64_t relaxed = 0;
+            for (int v = lo; v < hi; ++v) {
+                long long best = dist[v];
+                for (int k = in.offset[v]; k < in.offset[v + 1]; ++k) {
+                    long long du = dist[in.target[k]];
+                    if (du != INF && du + in.weight[k] < best) { best = du + in.weight[k]; ++relaxed; }
+                }
+                next[v] = best;
+                if (best != dist[v]) local = true;
+            }
+            STAT_ADD(STAT_EDGES_SCANNED, in.offset[hi] - in.offset[lo]);
+            STAT_ADD(STAT_RELAXATIONS, relaxed);
+            if (local) updated = true;
+        });
+        if (!updated) return true; // оптимизация
+        dist.swap(next);
+    }
+    return false;
+}
+
+void Graph::bellmanFord(const string& start) {
+    int n = vertexCount();
+    int startIndex = findVertex(start);
+
+    if (startIndex == -1) {
+        cout << "Вершина " << start << " не найдена.\n";
+        return;
+    }
+
+    const long long INF = LLONG_MAX / 4;
+    vector<long long> dist;
+    if (!bellmanFordDistances(startIndex, dist)) {
+        cout << "Граф содержит цикл отрицательного веса!\n";
+        return;
+    }
+
+    // Вывод результатов
+    cout << "Кратчайшие расстояния от вершины " << start << ":\n";
+    for (int i = 0; i < n; ++i) {
+        cout << adjList[i].adress << " : ";
+        if (dist[i] == INF)
+            cout << "недостижима\n";
+        else
+            cout << dist[i] << "\n";
+    }
+}
+
+int Graph::edmondsKarp(const string& sourceName, const string& sinkName) const {
+    int s = findVertex(sourceName);
+    int t = findVertex(sinkName);
+    if (s == -1 || t == -1) {
+        cout << "Ошибка: источник или сток не найдены.\n";
+        return 0;
+    }
+
+    int result = maxFlow(s, t);
+    cout << "Максимальный поток из " << sourceName << " в " << sinkName << " = " << result << "\n";
+    return result;
+}
+
+int Graph::maxFlow(int s, int t) const {
+    STAT_PHASE("edmondsKarp");
+    int n = vertexCount();
+
+    // Матрица пропускных способностей: кратные рёбра суммируются в каноническом списке,
+    // неориентированное ребро даёт ёмкость в обе стороны. Пары (u, v) в списке различны,
+    // поэтому параллельная запись не пересекается
+    auto edges = canonicalEdges(EdgeMerge::Sum);
+    vector<vector<int>> capacity(n);
+    parallelFor(threadCount(), 0, n, [&](int i) { capacity[i].assign(n, 0); }, 16);
+    parallelFor(threadCount(), 0, (int)edges.size(), [&](int k) {
+        const auto& e = edges[k];
+        capacity[e.u][e.v] = e.w;
+        if (!directed && e.u != e.v) capacity[e.v][e.u] = e.w;
+    }, 4096);
+
+    vector<vector<int>> flow(n, vector<int>(n, 0));
+    int total = 0;
+
+    while (true) {
+        // BFS для поиска пути с остаточной ёмкостью
+        vector<int> parent(n, -1);
+        queue<int> q;
+        q.push(s);
+        parent[s] = s;
+        STAT_INC(STAT_BFS_RUNS);
+
+        while (!q.empty() && parent[t] == -1) {
+            int u = q.front();
+            q.pop();
+            STAT_INC(STAT_BFS_VISITED);
+            STAT_ADD(STAT_EDGES_SCANNED, n);
+            for (int v = 0; v < n; ++v) {
+                if (parent[v] == -1 && capacity[u][v] - flow[u][v] > 0) {
+                    parent[v] = u;
+                    q.push(v);
+                }
+            }
+        }
+
+        // если пути нет — всё, закончили
+        if (parent[t] == -1)
+            break;
+
+        // находим минимальную пропускную способность по пути
+        int increment = INT_MAX;
+        for (int v = t; v != s; v = parent[v]) {
+            int u = parent[v];
+            increment = min(increment, capacity[u][v] - flow[u][v]);
+        }
+
+        // обновляем потоки вдоль пути
+        for (int v = t; v != s; v = parent[v]) {
+            int u = parent[v];
+            flow[u][v] += increment;
+            flow[v][u] -= increment; // обратное ребро
+        }
+
+        total += increment;
+        STAT_INC(STAT_AUGMENTING_PATHS);
+    }
+
+    return total;
+}
+
+BfsResult Graph::bfs(int start, int maxDepth) const {
+    STAT_PHASE("bfs");
+    CSR out = toCSR();
+    if (!directed) return directionOptimizingBFS(out, &out, start, threadCount(), maxDepth);
+    CSR in = toCSR(true);
+    return directionOptimizingBFS(out, &in, start, threadCount(), maxDepth);
+}
 
+// ===== Динамические кратчайшие пути =====
+// Деревья кратчайших путей от зарегистрированных источников поддерживаются при
+// изменениях графа (в духе Рамалингама–Репса), через наблюдатель GraphListener:
+//  - новое ребро или уменьшение веса: Дейкстра от конца ребра, только по вершинам,
+//    чьё расстояние улучшилось;
+//  - удаление ребра дерева или увеличение его веса: поддерево под ребром
+//    сбрасывается, получает лучшие входящие рёбра от незатронутых вершин и
+//    пересчитывается Дейкстрой внутри себя.
+// Работа пропорциональна затронутым вершинам и их рёбрам, а не размеру графа.
+// Веса должны быть неотрицательными: пока в графе есть отрицательное ребро,
+// деревья не поддерживаются и пересчитываются полностью, когда оно исчезнет.
+
+class DynamicSSSP : public GraphListener {
+public:
+    static constexpr long long INF = LLONG_MAX / 4;   // как в dijkstraDistances
+
+    struct Update {
+        int touched = 0;       // пересчитанные вершины (по всем источникам)
+        double ms = 0;
+    };
+
+    explicit DynamicSSSP(Graph& g);
+    ~DynamicSSSP() override { g.removeListener(this); }
+    DynamicSSSP(const DynamicSSSP&) = delete;
+    DynamicSSSP& operator=(const DynamicSSSP&) = delete;
+
+    void addSource(int s);
+    void removeSource(int s);
+    vector<int> sources() const;
+    bool valid() const { return negativeEdges == 0; }
+
+    // расстояние от источника (INF — недостижима) и путь по дереву
+    long long distance(int source, int v) const { return tree(source).dist[v]; }
+    vector<int> path(int source, int v) const;
+
+    const Update& lastUpdate() const { return last; }
+    long long totalTouched() const { return total; }
+
+    void onAddPoint(const Graph& g, int v) override;
+    void onRemovePoint(const Graph& g, int oldIndex, const string& name) override;
+    void onAddEdge(const Graph& g, int from, int to, int weight) override;
+    void onRemoveEdge(const Graph& g, int from, int to) override;
+    void onSetEdgeWeight(const Graph& g, int from, int to, int oldWeight, int newWeight) override;
+    void onRebuild(const Graph& g) override;
+
+private:
+    struct Arc { int v, w; };
+    struct Tree {
+        int source;
+        string name;               // для поиска источника после перенумерации
+        vector<long long> dist;
+        vector<int> parent;
+    };
+    using HeapItem = pair<long long, int>;
+    using MinHeap = priority_queue<HeapItem, vector<HeapItem>, greater<HeapItem>>;
+
+    Graph& g;
+    vector<vector<Arc>> out, in;   // копия рёбер по индексам; in — только для орграфа
+    vector<Tree> trees;
+    int negativeEdges = 0;
+    bool stale = false;            // деревья устарели из-за отрицательного ребра
+    vector<unsigned> mark;         // метки поддерева без очистки: mark[v] == stamp
+    unsigned stamp = 0;
+    Update last;
+    long long total = 0;
+
+    const vector<Arc>& incoming(int v) const { return g.isDirected() ? in[v] : out[v]; }
+    const Tree& tree(int source) const;
+    void loadArcs();
+    void setArc(int u, int v, int w);      // добавить или изменить дугу
+    void eraseArc(int u, int v);
+    int arcWeight(int u, int v) const;
+    void computeTree(Tree& t);
+    void decrease(Tree& t, int u, int v, int w);
+    vector<int> subtree(const Tree& t, int root);
+    void repair(Tree& t, const vector<int>& affected);
+    bool prepare();                         // общее начало обработчиков
+    void finish(chrono::steady_clock::time_point t0);
+};
+
+DynamicSSSP::DynamicSSSP(Graph& graph) : g(graph) {
+    loadArcs();
+    g.addListener(this);
+}
+
+void DynamicSSSP::loadArcs() {
+    int n = g.vertexCount();
+    CSR csr = g.toCSR();
+    out.assign(n, {});
+    in.assign(g.isDirected() ? n : 0, {});
+    mark.assign(n, 0);
+    negativeEdges = 0;
+    for (int u = 0; u < n; ++u)
+        for (int k = csr.offset[u]; k < csr.offset[u + 1]; ++k) {
+            int v = csr.target[k], w = csr.weight[k];
+            if (u == v) continue;
+            out[u].push_back({v, w});
+            if (g.isDirected()) in[v].push_back({u, w});
+            if (w < 0 && (g.isDirected() || u < v)) negativeEdges++;
+        }
+}
+
+void DynamicSSSP::setArc(int u, int v, int w) {
+    auto put = [](vector<Arc>& arcs, int x, int w) {
+        for (auto& a : arcs) if (a.v == x) { a.w = w; return; }
+        arcs.push_back({x, w});
+    };
+    put(out[u], v, w);
+    if (g.isDirected()) put(in[v], u, w);
+    else put(out[v], u, w);
+}
+
+void DynamicSSSP::eraseArc(int u, int v) {
+    auto drop = [](vector<Arc>& arcs, int x) {
+        arcs.erase(remove_if(arcs.begin(), arcs.end(), [&](const Arc& a) { return a.v == x; }), arcs.end());
+    };
+    drop(out[u], v);
+    if (g.isDirected()) drop(in[v], u);
+    else drop(out[v], u);
+}
+
+int DynamicSSSP::arcWeight(int u, int v) const {
+    for (const auto& a : out[u]) if (a.v == v) return a.w;
+    return 0;
+}
+
+const DynamicSSSP::Tree& DynamicSSSP::tree(int source) const {
+    if (!valid()) throw runtime_error("В графе есть отрицательные веса: динамические кратчайшие пути недоступны");
+    for (const auto& t : trees) if (t.source == source) return t;
+    throw runtime_error("Вершина не зарегистрирована как источник");
+}
+
+vector<int> DynamicSSSP::sources() const {
+    vector<int> res;
+    for (const auto& t : trees) res.push_back(t.source);
+    return res;
+}
+
+vector<int> DynamicSSSP::path(int source, int v) const {
+    const Tree& t = tree(source);
+    vector<int> p;
+    if (t.dist[v] == INF) return p;
+    for (int x = v; x != -1; x = t.parent[x]) p.push_back(x);
+    reverse(p.begin(), p.end());
+    return p;
+}
+
+// полная Дейкстра — при регистрации источника и после массовых изменений
+void DynamicSSSP::computeTree(Tree& t) {
+    int n = (int)out.size();
+    t.dist.assign(n, INF);
+    t.parent.assign(n, -1);
+    t.dist[t.source] = 0;
+    MinHeap pq;
+    pq.push({0, t.source});
     while (!pq.empty()) {
-        auto [d, v] = pq.top(); pq.pop();
-        if (d != dist[v]) continue; // устаревшая запись в куче
+        auto [d, u] = pq.top();
+        pq.pop();
+        if (d != t.dist[u]) continue;
+        for (const auto& a : out[u])
+            if (d + a.w < t.dist[a.v]) {
+                t.dist[a.v] = d + a.w;
+                t.parent[a.v] = u;
+                pq.push({t.dist[a.v], a.v});
+                STAT_INC(STAT_RELAXATIONS);
+                STAT_INC(STAT_HEAP_PUSHES);
+            }
+    }
+    last.touched += n;
+}
 
-        // проходим все вершины-соседи v (используем adjList)
-        for (const auto& e : adjList[v].adj) {
-            int to = findVertex(e.to);
-            if (to == -1) continue; // защита от неконсистентности
-            int w = e.weight;
-            if (dist[v] != INF && dist[v] + w < dist[to]) {
-                dist[to] = dist[v] + w;
-                parent[to] = v;
-                pq.push({dist[to], to});
+void DynamicSSSP::addSource(int s) {
+    if (!valid()) throw runtime_error("В графе есть отрицательные веса: динамические кратчайшие пути недоступны");
+    for (const auto& t : trees) if (t.source == s) return;
+    auto t0 = chrono::steady_clock::now();
+    last = Update();
+    trees.push_back({s, g.adjList[s].adress, {}, {}});
+    computeTree(trees.back());
+    finish(t0);
+}
+
+void DynamicSSSP::removeSource(int s) {
+    trees.erase(remove_if(trees.begin(), trees.end(), [&](const Tree& t) { return t.source == s; }), trees.end());
+}
+
+// дуга u -> v появилась или подешевела до w: улучшаем расстояния вниз от v
+void DynamicSSSP::decrease(Tree& t, int u, int v, int w) {
+    if (u == v || t.dist[u] == INF || t.dist[u] + w >= t.dist[v]) return;
+    t.dist[v] = t.dist[u] + w;
+    t.parent[v] = u;
+    MinHeap pq;
+    pq.push({t.dist[v], v});
+    while (!pq.empty()) {
+        auto [d, x] = pq.top();
+        pq.pop();
+        if (d != t.dist[x]) continue;
+        last.touched++;
+        for (const auto& a : out[x])
+            if (d + a.w < t.dist[a.v]) {
+                t.dist[a.v] = d + a.w;
+                t.parent[a.v] = x;
+                pq.push({t.dist[a.v], a.v});
+                STAT_INC(STAT_RELAXATIONS);
+                STAT_INC(STAT_HEAP_PUSHES);
+            }
+    }
+}
+
+// вершины поддерева root в дереве кратчайших путей
+vector<int> DynamicSSSP::subtree(const Tree& t, int root) {
+    vector<int> res;
+    if (t.dist[root] == INF) return res;
+    ++stamp;
+    res.push_back(root);
+    mark[root] = stamp;
+    for (size_t i = 0; i < res.size(); ++i)
+        for (const auto& a : out[res[i]])
+            if (t.parent[a.v] == res[i] && mark[a.v] != stamp) {
+                mark[a.v] = stamp;
+                res.push_back(a.v);
+            }
+    return res;
+}
+
+// пересчитать расстояния вершин affected; остальные вершины не меняются
+void DynamicSSSP::repair(Tree& t, const vector<int>& affected) {
+    if (affected.empty()) return;
+    ++stamp;
+    for (int v : affected) {
+        mark[v] = stamp;
+        t.dist[v] = INF;
+        t.parent[v] = -1;
+    }
+    // лучшие входящие рёбра от незатронутых вершин
+    MinHeap pq;
+    for (int v : affected)
+        for (const auto& a : incoming(v))
+            if (mark[a.v] != stamp && t.dist[a.v] != INF && t.dist[a.v] + a.w < t.dist[v]) {
+                t.dist[v] = t.dist[a.v] + a.w;
+                t.parent[v] = a.v;
+            }
+    for (int v : affected)
+        if (t.dist[v] != INF) pq.push({t.dist[v], v});
+    while (!pq.empty()) {
+        auto [d, x] = pq.top();
+        pq.pop();
+        if (d != t.dist[x]) continue;
+        for (const auto& a : out[x])
+            if (mark[a.v] == stamp && d + a.w < t.dist[a.v]) {
+                t.dist[a.v] = d + a.w;
+                t.parent[a.v] = x;
+                pq.push({t.dist[a.v], a.v});
+                STAT_INC(STAT_RELAXATIONS);
+                STAT_INC(STAT_HEAP_PUSHES);
+            }
+    }
+    last.touched += (int)affected.size();
+}
+
+// false — деревья не поддерживаются (отрицательные веса); после исчезновения
+// последнего отрицательного ребра деревья строятся заново
+bool DynamicSSSP::prepare() {
+    if (!valid()) { stale = true; return false; }
+    if (stale) {
+        stale = false;
+        for (auto& t : trees) computeTree(t);
+        return false;
+    }
+    return true;
+}
+
+void DynamicSSSP::finish(chrono::steady_clock::time_point t0) {
+    last.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    total += last.touched;
+    STAT_ADD(STAT_DYN_TOUCHED, last.touched);
+}
+
+void DynamicSSSP::onAddPoint(const Graph&, int) {
+    last = Update();
+    out.emplace_back();
+    if (g.isDirected()) in.emplace_back();
+    mark.push_back(0);
+    for (auto& t : trees) {
+        t.dist.push_back(INF);
+        t.parent.push_back(-1);
+    }
+}
+
+void DynamicSSSP::onAddEdge(const Graph&, int from, int to, int weight) {
+    STAT_PHASE("dynamicSSSP");
+    auto t0 = chrono::steady_clock::now();
+    last = Update();
+    if (from != to) {
+        setArc(from, to, weight);
+        if (weight < 0) negativeEdges++;
+        if (prepare())
+            for (auto& t : trees) {
+                decrease(t, from, to, weight);
+                if (!g.isDirected()) decrease(t, to, from, weight);
+            }
+    }
+    finish(t0);
+}
+
+void DynamicSSSP::onRemoveEdge(const Graph&, int from, int to) {
+    STAT_PHASE("dynamicSSSP");
+    auto t0 = chrono::steady_clock::now();
+    last = Update();
+    if (from != to) {
+        if (arcWeight(from, to) < 0) negativeEdges--;
+        eraseArc(from, to);
+        if (prepare())
+            for (auto& t : trees) {
+                if (t.parent[to] == from) repair(t, subtree(t, to));
+                if (!g.isDirected() && t.parent[from] == to) repair(t, subtree(t, from));
+            }
+    }
+    finish(t0);
+}
+
+void DynamicSSSP::onSetEdgeWeight(const Graph&, int from, int to, int oldWeight, int newWeight) {
+    STAT_PHASE("dynamicSSSP");
+    auto t0 = chrono::steady_clock::now();
+    last = Update();
+    if (from != to && oldWeight != newWeight) {
+        setArc(from, to, newWeight);
+        negativeEdges += (newWeight < 0) - (oldWeight < 0);
+        if (prepare())
+            for (auto& t : trees) {
+                if (newWeight < oldWeight) {
+                    decrease(t, from, to, newWeight);
+                    if (!g.isDirected()) decrease(t, to, from, newWeight);
+                } else {
+                    if (t.parent[to] == from) repair(t, subtree(t, to));
+                    if (!g.isDirected() && t.parent[from] == to) repair(t, subtree(t, from));
+                }
             }
+    }
+    finish(t0);
+}
+
+// поддеревья удалённой вершины собираются до перенумерации, затем индексы
+// больше oldIndex сдвигаются на единицу, как в adjList
+void DynamicSSSP::onRemovePoint(const Graph&, int v, const string&) {
+    STAT_PHASE("dynamicSSSP");
+    auto t0 = chrono::steady_clock::now();
+    last = Update();
+    removeSource(v);
+    for (const auto& a : out[v]) if (a.w < 0) negativeEdges--;
+    if (g.isDirected())
+        for (const auto& a : in[v]) if (a.w < 0) negativeEdges--;
+    bool maintain = valid() && !stale;
+    vector<vector<int>> affected(trees.size());
+    if (maintain)
+        for (size_t i = 0; i < trees.size(); ++i) affected[i] = subtree(trees[i], v);
+    auto shift = [v](int x) { return x > v ? x - 1 : x; };
+    auto renumber = [&](vector<vector<Arc>>& adj) {
+        adj.erase(adj.begin() + v);
+        for (auto& arcs : adj) {
+            arcs.erase(remove_if(arcs.begin(), arcs.end(), [&](const Arc& a) { return a.v == v; }), arcs.end());
+            for (auto& a : arcs) a.v = shift(a.v);
         }
+    };
+    renumber(out);
+    if (g.isDirected()) renumber(in);
+    mark.erase(mark.begin() + v);
+
+    for (size_t i = 0; i < trees.size(); ++i) {
+        Tree& t = trees[i];
+        t.source = shift(t.source);
+        t.dist.erase(t.dist.begin() + v);
+        t.parent.erase(t.parent.begin() + v);
+        for (auto& p : t.parent) p = p == v ? -1 : shift(p);
+        vector<int> moved;
+        for (int x : affected[i]) if (x != v) moved.push_back(shift(x));
+        if (maintain) repair(t, moved);
+    }
+    if (!maintain) prepare();
+    finish(t0);
+}
+
+void DynamicSSSP::onRebuild(const Graph&) {
+    STAT_PHASE("dynamicSSSP");
+    auto t0 = chrono::steady_clock::now();
+    last = Update();
+    // индексы источников изменились: находим их заново по именам;
+    // деревья источников, которых в новом графе нет, удаляются (как в removeSource)
+    for (auto& t : trees) t.source = g.findVertex(t.name);
+    removeSource(-1);
+    loadArcs();
+    stale = false;
+    if (valid())
+        for (auto& t : trees) computeTree(t);
+    else stale = true;
+    finish(t0);
+}
+
+// ===== Хранилище графов: снимки и журнал изменений (WAL) =====
+// Каталог хранилища содержит для графа name два файла:
+//  - name.snap — двоичный снимок: "RGS1", ориентированность, номер последней
+//    учтённой записи журнала (LSN), имена вершин и дуги по индексам в порядке
+//    списков смежности; пишется во временный файл и атомарно переименовывается;
+//  - name.wal — журнал изменений: записи [длина][crc32][LSN][тип][данные]
+//    с именами вершин (индексы сдвигаются при удалении вершин).
+// Каждое изменение графа — одна запись в буфере; фоновый поток пишет буфер
+// одним write и одним fdatasync (групповая фиксация: раз в groupCommitMs или
+// при накоплении groupBytes). После snapshotEvery записей снимается снимок,
+// и журнал обрезается — только после того, как снимок надёжно на диске.
+// Восстановление: снимок + записи журнала с большим LSN; недописанный хвост
+// журнала (сбой во время записи) отбрасывается. После восстановления хранилище
+// продолжает тот же снимок и журнал с последнего LSN. Ошибка write/fdatasync
+// необратима: фоновый поток останавливается, а все следующие append и sync
+// бросают исключение — иначе новые записи легли бы за повреждённым хвостом.
+
+struct StoreOptions {
+    int groupCommitMs = 5;           // наибольшая задержка фиксации группы
+    size_t groupBytes = 64 << 10;    // размер буфера, при котором группа пишется сразу
+    uint64_t snapshotEvery = 100000; // записей журнала между снимками
+    bool fsync = true;               // false — без fdatasync (только для замеров)
+};
+
+class GraphStore : public GraphListener {
+public:
+    struct Counters {
+        uint64_t records = 0;        // записей журнала с открытия
+        uint64_t commits = 0;        // групп (write + fdatasync)
+        uint64_t bytes = 0;          // байт журнала записано
+        uint64_t snapshots = 0;
+        double lastSnapshotMs = 0;
+    };
+
+    // итог восстановления
+    struct Recovery {
+        int vertices = 0;
+        uint64_t replayed = 0;       // применённых записей журнала
+        uint64_t truncatedBytes = 0; // отброшенный повреждённый хвост
+        uint64_t lsn = 0;            // последний учтённый LSN (снимка или журнала)
+        double ms = 0;
+    };
+
+    // подключить хранилище к графу: сразу пишется снимок, журнал начинается заново.
+    // resume — итог load() для этого же графа: снимок не переписывается, журнал
+    // дописывается с LSN, следующего за восстановленным
+    GraphStore(Graph& g, const string& dir, const string& name, const StoreOptions& opt = StoreOptions(),
+               const Recovery* resume = nullptr);
+    ~GraphStore() override;
+    GraphStore(const GraphStore&) = delete;
+    GraphStore& operator=(const GraphStore&) = delete;
+
+    // восстановить граф из каталога (снимок + журнал)
+    static Graph* load(const string& dir, const string& name, Recovery* info = nullptr);
+    // имена графов, для которых в каталоге есть снимок
+    static vector<string> list(const string& dir);
+
+    void sync();          // дождаться записи всех изменений на диск
+    void checkpoint();    // снимок + обрезка журнала
+    Counters counters() const;
+
+    void onAddPoint(const Graph& g, int v) override;
+    void onRemovePoint(const Graph& g, int oldIndex, const string& name) override;
+    void onAddEdge(const Graph& g, int from, int to, int weight) override;
+    void onRemoveEdge(const Graph& g, int from, int to) override;
+    void onSetEdgeWeight(const Graph& g, int from, int to, int oldWeight, int newWeight) override;
+    void onRebuild(const Graph& g) override;
+
+private:
+    enum RecordType : uint8_t { ADD_POINT = 1, REMOVE_POINT, ADD_EDGE, REMOVE_EDGE, SET_WEIGHT };
+
+    Graph& g;
+    string snapPath, walPath;
+    StoreOptions opt;
+    int fd = -1;
+
+    mutable mutex mu;
+    condition_variable wake, durable;
+    string buffer;                 // записи, ещё не отданные в write
+    uint64_t lsn = 0;              // последний выданный LSN
+    uint64_t durableLsn = 0;       // записи до него включительно на диске
+    uint64_t sinceSnapshot = 0;
+    bool syncRequested = false, stopping = false;
+    string error;                  // ошибка записи журнала; после неё хранилище не пишет
+    Counters st;
+    thread flusher;
+
+    void append(RecordType type, const string& a, const string& b = string(), int w = 0);
+    void flushLoop();
+    void writeSnapshot();
+};
+
+static uint32_t crc32(const char* data, size_t len) {
+    static const auto table = [] {
+        array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; ++i) c = table[(c ^ (uint8_t)data[i]) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+template <class T>
+static void putRaw(string& out, T x) { out.append((const char*)&x, sizeof(x)); }
+
+static void putString(string& out, const string& s) {
+    putRaw<uint32_t>(out, (uint32_t)s.size());
+    out += s;
+}
+
+// чтение с проверкой границ: false — данные кончились раньше времени
+struct ByteReader {
+    const char* p;
+    const char* end;
+    template <class T>
+    bool get(T& x) {
+        if (end - p < (ptrdiff_t)sizeof(T)) return false;
+        memcpy(&x, p, sizeof(T));
+        p += sizeof(T);
+        return true;
+    }
+    bool get(string& s) {
+        uint32_t len;
+        if (!get(len) || end - p < (ptrdiff_t)len) return false;
+        s.assign(p, len);
+        p += len;
+        return true;
+    }
+};
+
+static string readWholeFile(const string& path, bool& exists) {
+    ifstream fin(path, ios::binary);
+    exists = fin.is_open();
+    if (!exists) return string();
+    return string(istreambuf_iterator<char>(fin), istreambuf_iterator<char>());
+}
+
+// fsync файла или каталога по пути (каталог — чтобы переименование пережило сбой)
+static void fsyncPath(const string& path) {
+    int f = ::open(path.c_str(), O_RDONLY);
+    if (f == -1) throw runtime_error("Не удалось открыть " + path + ": " + strerror(errno));
+    int rc = ::fsync(f);
+    int err = errno;
+    ::close(f);
+    if (rc != 0) throw runtime_error("fsync " + path + ": " + strerror(err));
+}
+
+GraphStore::GraphStore(Graph& graph, const string& dir, const string& name, const StoreOptions& options,
+                       const Recovery* resume)
+    : g(graph), snapPath(dir + "/" + name + ".snap"), walPath(dir + "/" + name + ".wal"), opt(options) {
+    if (name.empty() || name.find('/') != string::npos) throw runtime_error("Недопустимое имя графа для хранилища: " + name);
+    if (::mkdir(dir.c_str(), 0755) == -1 && errno != EEXIST)
+        throw runtime_error("Не удалось создать каталог " + dir + ": " + strerror(errno));
+    if (resume) {
+        // load() уже отрезал повреждённый хвост: дописываем журнал за последней целой записью
+        lsn = durableLsn = resume->lsn;
+        sinceSnapshot = resume->replayed;
+    } else writeSnapshot();
+    fd = ::open(walPath.c_str(), O_WRONLY | O_CREAT | (resume ? 0 : O_TRUNC) | O_APPEND, 0644);
+    if (fd == -1) throw runtime_error("Не удалось открыть журнал " + walPath + ": " + strerror(errno));
+    g.addListener(this);
+    flusher = thread([this] { flushLoop(); });
+}
+
+GraphStore::~GraphStore() {
+    g.removeListener(this);
+    {
+        lock_guard<mutex> lk(mu);
+        stopping = true;
+    }
+    wake.notify_all();
+    flusher.join();
+    ::close(fd);
+}
+
+void GraphStore::append(RecordType type, const string& a, const string& b, int w) {
+    string payload;
+    putRaw<uint8_t>(payload, type);
+    putString(payload, a);
+    if (type != ADD_POINT && type != REMOVE_POINT) putString(payload, b);
+    if (type == ADD_EDGE || type == SET_WEIGHT) putRaw<int32_t>(payload, w);
+
+    bool snapshotDue;
+    {
+        lock_guard<mutex> lk(mu);
+        if (!error.empty()) throw runtime_error("Ошибка хранилища: " + error);
+        string body;
+        putRaw<uint64_t>(body, ++lsn);
+        body += payload;
+        bool first = buffer.empty();
+        putRaw<uint32_t>(buffer, (uint32_t)body.size());
+        putRaw<uint32_t>(buffer, crc32(body.data(), body.size()));
+        buffer += body;
+        st.records++;
+        snapshotDue = ++sinceSnapshot >= opt.snapshotEvery;
+        // первая запись группы запускает таймер groupCommitMs, полный буфер пишется сразу
+        if (first || buffer.size() >= opt.groupBytes) wake.notify_one();
+    }
+    if (snapshotDue) checkpoint();
+}
+
+// фоновый поток групповой фиксации
+void GraphStore::flushLoop() {
+    unique_lock<mutex> lk(mu);
+    while (true) {
+        wake.wait(lk, [&] { return stopping || !buffer.empty(); });
+        if (buffer.empty()) break;   // stopping и писать нечего
+        // даём группе собраться, если её не торопят
+        wake.wait_for(lk, chrono::milliseconds(opt.groupCommitMs), [&] {
+            return stopping || syncRequested || buffer.size() >= opt.groupBytes;
+        });
+        string batch;
+        batch.swap(buffer);
+        uint64_t upTo = lsn;
+        syncRequested = false;
+        lk.unlock();
+
+        string failure;
+        for (size_t off = 0; off < batch.size();) {
+            ssize_t k = ::write(fd, batch.data() + off, batch.size() - off);
+            if (k < 0) {
+                if (errno == EINTR) continue;
+                failure = string("запись журнала: ") + strerror(errno);
+                break;
+            }
+            off += k;
+        }
+        if (failure.empty() && opt.fsync && ::fdatasync(fd) != 0)
+            failure = string("fdatasync журнала: ") + strerror(errno);
+
+        lk.lock();
+        if (!failure.empty()) {
+            // часть группы могла лечь на диск: дальше писать нельзя, durableLsn не двигаем
+            error = failure;
+            buffer.clear();
+            durable.notify_all();
+            break;
+        }
+        durableLsn = upTo;
+        st.commits++;
+        st.bytes += batch.size();
+        durable.notify_all();
+    }
+}
+
+void GraphStore::sync() {
+    unique_lock<mutex> lk(mu);
+    uint64_t target = lsn;
+    if (error.empty() && durableLsn < target) {
+        syncRequested = true;
+        wake.notify_one();
+        durable.wait(lk, [&] { return durableLsn >= target || !error.empty(); });
+    }
+    if (!error.empty()) throw runtime_error("Ошибка хранилища: " + error);
+}
+
+GraphStore::Counters GraphStore::counters() const {
+    lock_guard<mutex> lk(mu);
+    return st;
+}
+
+// снимок во временный файл, fsync, атомарное переименование
+void GraphStore::writeSnapshot() {
+    auto t0 = chrono::steady_clock::now();
+    int n = g.vertexCount();
+    string out("RGS1");
+    putRaw<uint8_t>(out, g.isDirected());
+    {
+        lock_guard<mutex> lk(mu);
+        putRaw<uint64_t>(out, lsn);
+    }
+    putRaw<int32_t>(out, n);
+    for (const auto& p : g.adjList) putString(out, p.adress);
+    for (const auto& p : g.adjList) {
+        putRaw<uint32_t>(out, (uint32_t)p.adj.size());
+        for (const auto& e : p.adj) {
+            putRaw<int32_t>(out, g.findVertex(e.to));
+            putRaw<int32_t>(out, e.weight);
+        }
+    }
+
+    string tmp = snapPath + ".tmp";
+    {
+        ofstream fout(tmp, ios::binary | ios::trunc);
+        if (!fout.is_open()) throw runtime_error("Не удалось открыть файл " + tmp);
+        fout.write(out.data(), out.size());
+        if (!fout) throw runtime_error("Не удалось записать снимок " + tmp);
+    }
+    if (opt.fsync) fsyncPath(tmp);
+    if (::rename(tmp.c_str(), snapPath.c_str()) != 0)
+        throw runtime_error("Не удалось переименовать снимок: " + string(strerror(errno)));
+    if (opt.fsync) fsyncPath(snapPath.substr(0, snapPath.rfind('/')));
+
+    lock_guard<mutex> lk(mu);
+    st.snapshots++;
+    st.lastSnapshotMs = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+}
+
+// записи с LSN не больше снимка уже в нём: журнал можно обрезать. writeSnapshot
+// возвращается только после fsync снимка и каталога, иначе бросает — и журнал цел
+void GraphStore::checkpoint() {
+    STAT_PHASE("checkpoint");
+    sync();
+    writeSnapshot();
+    lock_guard<mutex> lk(mu);
+    if (::ftruncate(fd, 0) != 0) throw runtime_error("Не удалось обрезать журнал: " + string(strerror(errno)));
+    sinceSnapshot = 0;
+}
+
+void GraphStore::onAddPoint(const Graph& graph, int v) { append(ADD_POINT, graph.adjList[v].adress); }
+
+void GraphStore::onRemovePoint(const Graph&, int, const string& name) { append(REMOVE_POINT, name); }
+
+void GraphStore::onAddEdge(const Graph& graph, int from, int to, int weight) {
+    append(ADD_EDGE, graph.adjList[from].adress, graph.adjList[to].adress, weight);
+}
+
+void GraphStore::onRemoveEdge(const Graph& graph, int from, int to) {
+    append(REMOVE_EDGE, graph.adjList[from].adress, graph.adjList[to].adress);
+}
+
+void GraphStore::onSetEdgeWeight(const Graph& graph, int from, int to, int, int newWeight) {
+    append(SET_WEIGHT, graph.adjList[from].adress, graph.adjList[to].adress, newWeight);
+}
+
+// перенумерация или присваивание графа: проще записать новый снимок
+void GraphStore::onRebuild(const Graph&) { checkpoint(); }
+
+Graph* GraphStore::load(const string& dir, const string& name, Recovery* info) {
+    STAT_PHASE("recover");
+    auto t0 = chrono::steady_clock::now();
+    Recovery rec;
+    string snapPath = dir + "/" + name + ".snap", walPath = dir + "/" + name + ".wal";
+
+    bool exists;
+    string snap = readWholeFile(snapPath, exists);
+    if (!exists) throw runtime_error("Нет снимка " + snapPath);
+    ByteReader in{snap.data(), snap.data() + snap.size()};
+    char magic[4];
+    uint8_t directed = 0;
+    uint64_t snapLsn = 0;
+    int32_t n = 0;
+    if (!in.get(magic) || string(magic, 4) != "RGS1" || !in.get(directed) || !in.get(snapLsn) || !in.get(n) || n < 0)
+        throw runtime_error("Неверный формат снимка " + snapPath);
+
+    rec.lsn = snapLsn;
+    unique_ptr<Graph> g(new Graph(directed != 0));
+    g->setVerbose(false);
+    vector<string> names(n);
+    for (auto& s : names) {
+        if (!in.get(s)) throw runtime_error("Снимок повреждён: " + snapPath);
+        g->addPoint(s);
+    }
+    for (int v = 0; v < n; ++v) {
+        uint32_t deg;
+        if (!in.get(deg)) throw runtime_error("Снимок повреждён: " + snapPath);
+        auto& adj = g->adjList[v].adj;
+        adj.reserve(deg);
+        for (uint32_t k = 0; k < deg; ++k) {
+            int32_t to, w;
+            if (!in.get(to) || !in.get(w) || to < 0 || to >= n) throw runtime_error("Снимок повреждён: " + snapPath);
+            adj.emplace_back(names[to], w);
+        }
+    }
+
+    // журнал: применяем записи новее снимка до первой повреждённой
+    string wal = readWholeFile(walPath, exists);
+    const char* p = wal.data();
+    const char* end = p + wal.size();
+    while (end - p >= 8) {
+        uint32_t len, crc;
+        memcpy(&len, p, 4);
+        memcpy(&crc, p + 4, 4);
+        if ((size_t)(end - p - 8) < len || crc32(p + 8, len) != crc) break;
+        ByteReader r{p + 8, p + 8 + len};
+        p += 8 + len;
+        uint64_t recLsn;
+        uint8_t type;
+        string a, b;
+        int32_t w = 0;
+        if (!r.get(recLsn) || !r.get(type) || !r.get(a)) continue;
+        if (recLsn <= snapLsn) continue;
+        if (type != ADD_POINT && type != REMOVE_POINT) r.get(b);
+        if (type == ADD_EDGE || type == SET_WEIGHT) r.get(w);
+        switch (type) {
+            case ADD_POINT: g->addPoint(a); break;
+            case REMOVE_POINT: g->removePoint(a); break;
+            case ADD_EDGE: g->addEdge(a, b, w); break;
+            case REMOVE_EDGE: g->removeEdge(a, b); break;
+            case SET_WEIGHT: g->setEdgeWeight(a, b, w); break;
+        }
+        rec.lsn = recLsn;
+        rec.replayed++;
+    }
+    rec.truncatedBytes = end - p;
+    if (rec.truncatedBytes && ::truncate(walPath.c_str(), p - wal.data()) != 0)
+        throw runtime_error("Не удалось обрезать журнал " + walPath);
+
+    g->setVerbose(true);
+    rec.vertices = g->vertexCount();
+    rec.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    if (info) *info = rec;
+    return g.release();
+}
+
+vector<string> GraphStore::list(const string& dir) {
+    vector<string> res;
+    DIR* d = ::opendir(dir.c_str());
+    if (!d) return res;
+    while (dirent* e = ::readdir(d)) {
+        string f = e->d_name;
+        if (f.size() > 5 && f.compare(f.size() - 5, 5, ".snap") == 0) res.push_back(f.substr(0, f.size() - 5));
+    }
+    ::closedir(d);
+    sort(res.begin(), res.end());
+    return res;
+}
+
+// ===== Игра «утка против фермеров»: ретроградный анализ =====
+// Игровые графы (как в duck_vs_farmers.py): секция "nodes:" со строками
+// "имя x y", затем "edges:" со строками "откуда куда вес"; '#' — комментарий.
+// Правила: утка и фермеры ходят по очереди, один ход — одно ребро (вес не
+// важен); утка обязана сдвинуться, каждый фермер может остаться на месте.
+// Утка выигрывает, дойдя до озера, фермеры — оказавшись в вершине утки.
+// Позиция (утка, фермеры..., чей ход) нумеруется числом. Таблица исходов —
+// 2 бита на позицию; вторая таблица — число полуходов до конца при лучшей
+// игре (номер слоя, 2 байта): по ней выигрывающая сторона выбирает ход,
+// приближающий победу (одного исхода мало — можно ходить по кругу).
+// Слой L — позиции, решённые ровно за L полуходов: кандидаты — предшественники
+// позиций слоя L-1; они проверяются параллельно, решения записываются после слоя.
+// Позиции, не решённые ни одним слоем, — ничьи (утка бегает бесконечно).
+
+// true, если первая значащая строка файла — "nodes:"
+bool isGameGraphFile(const string& filePath) {
+    ifstream fin(filePath);
+    string line;
+    while (getline(fin, line)) {
+        stringstream ss(line);
+        string tok;
+        if (!(ss >> tok) || tok[0] == '#') continue;
+        transform(tok.begin(), tok.end(), tok.begin(), ::tolower);
+        return tok == "nodes:";
+    }
+    return false;
+}
+
+Graph loadGameGraph(const string& filePath, bool directed, vector<pair<int, int>>* coords) {
+    ifstream fin(filePath);
+    if (!fin.is_open()) throw runtime_error("Не удалось открыть файл");
+
+    Graph g(directed);
+    g.setVerbose(false);
+    if (coords) coords->clear();
+    string line, mode;
+    int lineNum = 0;
+    while (getline(fin, line)) {
+        ++lineNum;
+        stringstream ss(line);
+        vector<string> parts;
+        for (string tok; ss >> tok;) parts.push_back(tok);
+        if (parts.empty() || parts[0][0] == '#') continue;
+
+        string head = parts[0];
+        transform(head.begin(), head.end(), head.begin(), ::tolower);
+        if (parts.size() == 1 && (head == "nodes:" || head == "edges:")) {
+            mode = head;
+            continue;
+        }
+        string where = "Ошибка в строке " + to_string(lineNum) + ": ";
+        if (mode.empty() || parts.size() != 3)
+            throw runtime_error(where + (mode == "edges:" ? "неверный формат ребра" : "неверный формат узла"));
+        try {
+            if (mode == "nodes:") {
+                int x = stoi(parts[1]), y = stoi(parts[2]);
+                if (g.findVertex(parts[0]) != -1) throw runtime_error(where + "вершина " + parts[0] + " повторяется");
+                g.addPoint(parts[0]);
+                if (coords) coords->push_back({x, y});
+            } else {
+                for (int k = 0; k < 2; ++k)
+                    if (g.findVertex(parts[k]) == -1) throw runtime_error(where + "неизвестная вершина " + parts[k]);
+                g.addEdge(parts[0], parts[1], stoi(parts[2]));
+            }
+        } catch (const invalid_argument&) {
+            throw runtime_error(where + "ожидалось целое число");
+        } catch (const out_of_range&) {
+            throw runtime_error(where + "число вне диапазона");
+        }
+    }
+    if (g.vertexCount() == 0) throw runtime_error("Файл графа пустой или некорректный");
+    g.setVerbose(true);
+    return g;
+}
+
+class PursuitGame {
+public:
+    enum Outcome : uint8_t { DRAW = 0, DUCK_WINS = 1, FARMERS_WIN = 2 };
+
+    struct Position {
+        int duck;
+        vector<int> farmers;
+        bool duckToMove = true;
+    };
+
+    struct Summary {
+        uint64_t states = 0, duckWins = 0, farmersWin = 0, draws = 0;
+        vector<uint64_t> layerSizes;   // решённых позиций в каждом слое
+        double ms = 0;
+    };
+
+    PursuitGame(const Graph& g, int lake, int farmers, int threads = 0);
+
+    const Summary& solve();
+    const Summary& summary() const { return sum; }
+
+    Outcome outcome(const Position& p) const { return (Outcome)get2(value, index(p)); }
+    // исход уже закончившейся игры (DRAW — игра продолжается)
+    Outcome finished(const Position& p) const { return terminal(p.duck, p.farmers.data(), p.duckToMove ? 0 : 1); }
+    // ход стороны, которой принадлежит очередь: к победе кратчайшим путём,
+    // при проигрыше — как можно дольше, при ничьей — не проигрывая
+    Position bestMove(const Position& p) const;
+    // полуходов до конца игры при лучшей игре обеих сторон (для ничьей — 0)
+    int plies(const Position& p) const { return depth[index(p)]; }
+    size_t tableBytes() const { return value.size() * sizeof(uint64_t) + depth.size() * sizeof(uint16_t); }
+
+    static const char* outcomeName(Outcome o) {
+        return o == DUCK_WINS ? "утка доходит до озера" : o == FARMERS_WIN ? "фермеры ловят утку" : "ничья";
+    }
+
+private:
+    int n, k, lake, threads;
+    CSR fwd, rev;                     // ходы и обратные ходы
+    uint32_t count;                   // число позиций: 2 * n^(k+1)
+    vector<uint64_t> value;           // по 2 бита на позицию
+    vector<uint16_t> depth;           // номер слоя (насыщение на 65535)
+
+    Summary sum;
+
+    static int get2(const vector<uint64_t>& t, uint32_t i) { return (t[i >> 5] >> ((i & 31) * 2)) & 3; }
+    static void set2(vector<uint64_t>& t, uint32_t i, int v) {
+        uint64_t shift = (i & 31) * 2;
+        t[i >> 5] = (t[i >> 5] & ~(3ull << shift)) | ((uint64_t)v << shift);
+    }
+
+    // позиция -> номер: ((утка * n + ф1) * n + ф2 ...) * 2 + (ход фермеров)
+    uint32_t index(int duck, const int* farmers, int turn) const {
+        uint32_t x = duck;
+        for (int i = 0; i < k; ++i) x = x * n + farmers[i];
+        return x * 2 + turn;
+    }
+    uint32_t index(const Position& p) const { return index(p.duck, p.farmers.data(), p.duckToMove ? 0 : 1); }
+    int decode(uint32_t x, int* farmers) const {   // возвращает утку, x — без бита хода
+        for (int i = k - 1; i >= 0; --i) { farmers[i] = x % n; x /= n; }
+        return (int)x;
+    }
+
+    Outcome terminal(int duck, const int* farmers, int turn) const;
+    Outcome evaluate(uint32_t s) const;
+    template <class F> void forEachFarmerMove(const CSR& adj, const int* from, F f) const;
+    template <class F> vector<uint32_t> collect(uint32_t items, F f) const;
+};
+
+PursuitGame::PursuitGame(const Graph& g, int lakeVertex, int farmers, int t)
+    : n(g.vertexCount()), k(farmers), lake(lakeVertex), threads(t), fwd(g.toCSR()) {
+    if (k < 1 || k > 4) throw runtime_error("Число фермеров должно быть от 1 до 4");
+    if (lake < 0 || lake >= n) throw runtime_error("Озеро не задано");
+    rev = g.isDirected() ? g.toCSR(true) : fwd;
+    double states = 2;
+    for (int i = 0; i <= k; ++i) states *= n;
+    if (states > INT_MAX) throw runtime_error("Слишком много позиций: " + to_string((long long)states));
+    count = (uint32_t)states;
+    value.assign((count + 31) / 32, 0);
+    depth.assign(count, 0);
+    sum.states = count;
+}
+
+// окончание игры: поймана (на ходу утки) или дошла до озера
+PursuitGame::Outcome PursuitGame::terminal(int duck, const int* farmers, int turn) const {
+    if (turn == 1 && duck == lake) return DUCK_WINS;
+    for (int i = 0; i < k; ++i)
+        if (farmers[i] == duck && turn == 0) return FARMERS_WIN;
+    if (turn == 0 && duck == lake) return DUCK_WINS;
+    if (turn == 0 && fwd.offset[duck] == fwd.offset[duck + 1]) return FARMERS_WIN;   // утке некуда идти
+    return DRAW;
+}
+
+// все сочетания ходов фермеров (каждый — к соседу по adj или на месте)
+template <class F>
+void PursuitGame::forEachFarmerMove(const CSR& adj, const int* from, F f) const {
+    int to[4], pos[4];
+    for (int i = 0; i < k; ++i) { to[i] = from[i]; pos[i] = adj.offset[from[i]] - 1; }
+    while (true) {
+        f(to);
+        int i = 0;
+        for (; i < k; ++i) {
+            if (++pos[i] < adj.offset[from[i] + 1]) { to[i] = adj.target[pos[i]]; break; }
+            pos[i] = adj.offset[from[i]] - 1;
+            to[i] = from[i];
+        }
+        if (i == k) return;
+    }
+}
+
+// решение по уже решённым позициям (без записи)
+PursuitGame::Outcome PursuitGame::evaluate(uint32_t s) const {
+    int turn = s & 1, farmers[4];
+    int duck = decode(s >> 1, farmers);
+    Outcome t = terminal(duck, farmers, turn);
+    if (t != DRAW) return t;
+    bool all = true;
+    if (turn == 0) {
+        for (int e = fwd.offset[duck]; e < fwd.offset[duck + 1]; ++e) {
+            int v = get2(value, index(fwd.target[e], farmers, 1));
+            if (v == DUCK_WINS) return DUCK_WINS;
+            all = all && v == FARMERS_WIN;
+        }
+        return all ? FARMERS_WIN : DRAW;
+    }
+    bool win = false;
+    forEachFarmerMove(fwd, farmers, [&](const int* to) {
+        int v = get2(value, index(duck, to, 0));
+        win = win || v == FARMERS_WIN;
+        all = all && v == DUCK_WINS;
+    });
+    return win ? FARMERS_WIN : all ? DUCK_WINS : DRAW;
+}
+
+// параллельный сбор: f(i, out) для i < items, результаты кусков — по порядку
+template <class F>
+vector<uint32_t> PursuitGame::collect(uint32_t items, F f) const {
+    const int grain = 4096;
+    int chunks = (int)((items + grain - 1) / grain);
+    vector<vector<uint32_t>> parts(chunks);
+    parallelFor(threads, 0, chunks, [&](int c) {
+        uint32_t hi = min<uint32_t>(items, (uint32_t)(c + 1) * grain);
+        for (uint32_t i = (uint32_t)c * grain; i < hi; ++i) f(i, parts[c]);
+    }, 1);
+    vector<uint32_t> res;
+    for (auto& p : parts) res.insert(res.end(), p.begin(), p.end());
+    return res;
+}
+
+const PursuitGame::Summary& PursuitGame::solve() {
+    STAT_PHASE("pursuitGame");
+    auto t0 = chrono::steady_clock::now();
+    fill(value.begin(), value.end(), 0);
+    sum.layerSizes.clear();
+
+    // слой 0: окончания игры
+    vector<uint32_t> layer = collect(count, [&](uint32_t s, vector<uint32_t>& out) {
+        int farmers[4];
+        int duck = decode(s >> 1, farmers);
+        if (terminal(duck, farmers, s & 1) != DRAW) out.push_back(s);
+    });
+    vector<uint8_t> result;
+
+    vector<atomic<uint64_t>> candidate((count + 63) / 64);
+    for (int L = 0; !layer.empty(); ++L) {
+        result.resize(layer.size());
+        parallelFor(threads, 0, (int)layer.size(), [&](int i) { result[i] = evaluate(layer[i]); }, 4096);
+        for (size_t i = 0; i < layer.size(); ++i) {
+            set2(value, layer[i], result[i]);
+            depth[layer[i]] = (uint16_t)min(L, 65535);
+        }
+        sum.layerSizes.push_back(layer.size());
+
+        // кандидаты следующего слоя: нерешённые предшественники, без повторов
+        auto mark = [&](uint32_t p, vector<uint32_t>& out) {
+            if (get2(value, p) != DRAW) return;
+            uint64_t bit = 1ull << (p & 63);
+            if (!(candidate[p >> 6].fetch_or(bit, memory_order_relaxed) & bit)) out.push_back(p);
+        };
+        vector<uint32_t> cand = collect((uint32_t)layer.size(), [&](uint32_t i, vector<uint32_t>& out) {
+            uint32_t s = layer[i];
+            int farmers[4];
+            int duck = decode(s >> 1, farmers);
+            if (s & 1) {
+                // ходили фермеры -> до этого ходила утка
+                for (int e = rev.offset[duck]; e < rev.offset[duck + 1]; ++e)
+                    mark(index(rev.target[e], farmers, 0), out);
+            } else {
+                forEachFarmerMove(rev, farmers, [&](const int* from) { mark(index(duck, from, 1), out); });
+            }
+        });
+        for (uint32_t p : cand) candidate[p >> 6].store(0, memory_order_relaxed);
+
+        layer = collect((uint32_t)cand.size(), [&](uint32_t i, vector<uint32_t>& out) {
+            if (evaluate(cand[i]) != DRAW) out.push_back(cand[i]);
+        });
+    }
+
+    sum.duckWins = sum.farmersWin = 0;
+    for (uint32_t s = 0; s < count; ++s) {
+        int v = get2(value, s);
+        if (v == DUCK_WINS) sum.duckWins++;
+        else if (v == FARMERS_WIN) sum.farmersWin++;
+    }
+    sum.draws = count - sum.duckWins - sum.farmersWin;
+    sum.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    return sum;
+}
+
+PursuitGame::Position PursuitGame::bestMove(const Position& p) const {
+    uint32_t s = index(p);
+    int turn = s & 1;
+    int o = get2(value, s);
+    Outcome mine = turn == 0 ? DUCK_WINS : FARMERS_WIN;
+
+    // оценка хода: больше — лучше
+    auto score = [&](uint32_t next) {
+        int v = get2(value, next);
+        if (o == mine) return v == mine ? 65536 - depth[next] : 0;   // быстрее к победе
+        if (o == DRAW) return v == DRAW ? 1 : 0;
+        return (int)depth[next];                                      // проигрыш: затягиваем
+    };
+    Position best = p;
+    best.duckToMove = !p.duckToMove;
+    int bestScore = -1;
+    if (turn == 0) {
+        for (int e = fwd.offset[p.duck]; e < fwd.offset[p.duck + 1]; ++e) {
+            int sc = score(index(fwd.target[e], p.farmers.data(), 1));
+            if (sc > bestScore) { bestScore = sc; best.duck = fwd.target[e]; }
+        }
+    } else {
+        forEachFarmerMove(fwd, p.farmers.data(), [&](const int* to) {
+            int sc = score(index(p.duck, to, 0));
+            if (sc > bestScore) { bestScore = sc; best.farmers.assign(to, to + k); }
+        });
+    }
+    return best;
+}
+
+// ===== Поток минимальной стоимости =====
+// Ёмкость дуги — вес ребра (Edge.weight), стоимость единицы потока задаётся
+// отдельно (FlowCosts). Несколько источников и стоков подключаются к
+// суперисточнику S и суперстоку T дугами с ёмкостью, равной запасу/спросу.
+// Ищется максимальный поток S -> T наименьшей стоимости:
+//  - последовательные кратчайшие пути (Дейкстра с потенциалами Джонсона);
+//  - масштабирование стоимостей (Голдберг–Тарьян, push-relabel) для потока
+//    величины F, найденной заранее алгоритмом Диница.
+// Тёплый старт: потоки прежнего решения (обрезанные по новым ёмкостям) и цены
+// вершин служат начальным псевдопотоком для шага уточнения масштабирования
+// с малым eps, что при небольших изменениях ёмкостей быстрее решения с нуля.
+
+// стоимость единицы потока по ребру; для неориентированного графа — в обе стороны
+struct FlowCosts {
+    long long defaultCost = 1;
+    unordered_map<string, long long> byEdge;
+
+    static string key(const string& from, const string& to) { return from + '\n' + to; }
+
+    void set(const string& from, const string& to, long long cost) { byEdge[key(from, to)] = cost; }
+
+    long long get(const string& from, const string& to, bool directed) const {
+        auto it = byEdge.find(key(from, to));
+        if (it != byEdge.end()) return it->second;
+        if (!directed && (it = byEdge.find(key(to, from))) != byEdge.end()) return it->second;
+        return defaultCost;
+    }
+
+    // файл в формате графа: "откуда куда стоимость"
+    static FlowCosts fromFile(const string& filePath, long long defaultCost = 1) {
+        ifstream fin(filePath);
+        if (!fin.is_open()) throw runtime_error("Не удалось открыть файл");
+        FlowCosts c;
+        c.defaultCost = defaultCost;
+        string from, to;
+        long long cost;
+        while (fin >> from >> to >> cost) c.set(from, to, cost);
+        return c;
+    }
+};
+
+// источник или сток: amount — запас/спрос, < 0 — без ограничения
+struct FlowTerminal {
+    int vertex;
+    long long amount;
+};
+
+class MinCostFlow {
+public:
+    enum class Method { SuccessiveShortestPaths, CostScaling };
+
+    struct ArcFlow { int from, to; long long capacity, cost, flow; };
+
+    struct Result {
+        long long flow = 0, cost = 0;
+        int iterations = 0;            // дополняющих путей (SSP) или проталкиваний (масштабирование)
+        double ms = 0;
+        vector<ArcFlow> arcs;          // дуги графа в порядке toCSR()
+        vector<long long> prices;      // цены вершин (масштабированные) — для тёплого старта
+    };
+
+    MinCostFlow(const Graph& g, const FlowCosts& costs);
+
+    Result solve(const vector<FlowTerminal>& sources, const vector<FlowTerminal>& sinks,
+                 Method method, const Result* warm = nullptr) const;
+
+private:
+    int n;
+    vector<ArcFlow> base;   // дуги графа (flow не используется)
+
+    // остаточная сеть: дуга 2k — прямая, 2k+1 — обратная
+    struct Network {
+        vector<int> to;
+        vector<long long> res, cost;
+        vector<vector<int>> out;
+        explicit Network(int nodes) : out(nodes) {}
+        int add(int u, int v, long long cap, long long c) {
+            int id = (int)to.size();
+            to.push_back(v); res.push_back(cap); cost.push_back(c); out[u].push_back(id);
+            to.push_back(u); res.push_back(0); cost.push_back(-c); out[v].push_back(id + 1);
+            return id;
+        }
+    };
+
+    void successiveShortestPaths(Network& net, int S, int T, Result& r) const;
+    static long long maxFlowValue(Network net, int S, int T);
+    void costScaling(Network& net, int S, int T, long long F, long long eps, vector<long long>& price, Result& r) const;
+    // множитель стоимостей для масштабирования: строго больше числа вершин сети
+    static long long costScale(int nodes) { return (long long)nodes + 1; }
+};
+
+MinCostFlow::MinCostFlow(const Graph& g, const FlowCosts& costs) : n(g.vertexCount()) {
+    CSR csr = g.toCSR();
+    for (int u = 0; u < n; ++u)
+        for (int k = csr.offset[u]; k < csr.offset[u + 1]; ++k) {
+            int v = csr.target[k];
+            if (u == v) continue;
+            base.push_back({u, v, max(0, csr.weight[k]),
+                            costs.get(g.adjList[u].adress, g.adjList[v].adress, g.isDirected()), 0});
+        }
+}
+
+MinCostFlow::Result MinCostFlow::solve(const vector<FlowTerminal>& sources, const vector<FlowTerminal>& sinks,
+                                       Method method, const Result* warm) const {
+    STAT_PHASE("minCostFlow");
+    auto t0 = chrono::steady_clock::now();
+    int S = n, T = n + 1, N = n + 2;
+    Network net(N);
+
+    long long totalCap = 1, maxCost = 1;
+    for (const auto& a : base) {
+        totalCap += a.capacity;
+        maxCost = max(maxCost, llabs(a.cost));
+    }
+    for (const auto& a : base) net.add(a.from, a.to, a.capacity, a.cost);
+    for (const auto& s : sources) net.add(S, s.vertex, s.amount < 0 ? totalCap : s.amount, 0);
+    for (const auto& t : sinks) net.add(t.vertex, T, t.amount < 0 ? totalCap : t.amount, 0);
+
+    Result r;
+    bool useWarm = warm && warm->arcs.size() == base.size() && (int)warm->prices.size() == N;
+    if (method == Method::SuccessiveShortestPaths && !useWarm) {
+        successiveShortestPaths(net, S, T, r);
+    } else {
+        // величина максимального потока (Диниц), затем поток этой величины
+        // наименьшей стоимости: запас F в S и спрос F в T
+        long long F = maxFlowValue(net, S, T);
+        for (auto& c : net.cost) c *= costScale(N);
+
+        vector<long long> price(N, 0);
+        long long eps = maxCost * costScale(N);
+        if (useWarm) {
+            price = warm->prices;
+            for (size_t k = 0; k < base.size(); ++k) {
+                long long f = min(warm->arcs[k].flow, net.res[2 * k]);
+                net.res[2 * k] -= f;
+                net.res[2 * k + 1] += f;
+            }
+            // наименьшее eps, при котором начальный псевдопоток eps-оптимален; первое
+            // уточнение в costScaling идёт уже с eps / ALPHA, как и при холодном старте
+            eps = 1;
+            for (int u = 0; u < N; ++u)
+                for (int a : net.out[u])
+                    if (net.res[a] > 0) eps = max(eps, -(net.cost[a] + price[u] - price[net.to[a]]));
+        }
+        costScaling(net, S, T, F, eps, price, r);
+        r.prices = price;
+        r.flow = F;
+        r.cost = 0;
+        for (size_t k = 0; k < base.size(); ++k) r.cost += net.res[2 * k + 1] * base[k].cost;
+    }
+
+    r.arcs = base;
+    for (size_t k = 0; k < base.size(); ++k) r.arcs[k].flow = net.res[2 * k + 1];
+    r.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    return r;
+}
+
+void MinCostFlow::successiveShortestPaths(Network& net, int S, int T, Result& r) const {
+    const long long INF = LLONG_MAX / 4;
+    int N = (int)net.out.size();
+
+    // начальные потенциалы — Беллман–Форд (стоимости могут быть отрицательными)
+    vector<long long> pot(N, INF);
+    pot[S] = 0;
+    for (int round = 0;; ++round) {
+        bool changed = false;
+        for (int u = 0; u < N; ++u) {
+            if (pot[u] == INF) continue;
+            for (int a : net.out[u])
+                if (net.res[a] > 0 && pot[u] + net.cost[a] < pot[net.to[a]]) {
+                    pot[net.to[a]] = pot[u] + net.cost[a];
+                    changed = true;
+                }
+        }
+        if (!changed) break;
+        if (round == N) throw runtime_error("Цикл отрицательной стоимости: используйте масштабирование стоимостей");
+    }
+    for (auto& p : pot) if (p == INF) p = 0;   // недостижимые вершины так и останутся недостижимыми
+
+    vector<long long> dist(N);
+    vector<int> parentArc(N);
+    while (true) {
+        fill(dist.begin(), dist.end(), INF);
+        fill(parentArc.begin(), parentArc.end(), -1);
+        priority_queue<pair<long long,int>, vector<pair<long long,int>>, greater<pair<long long,int>>> pq;
+        dist[S] = 0;
+        pq.push({0, S});
+        while (!pq.empty()) {
+            auto [d, u] = pq.top(); pq.pop();
+            if (d != dist[u]) continue;
+            for (int a : net.out[u]) {
+                if (net.res[a] == 0) continue;
+                int v = net.to[a];
+                long long nd = d + net.cost[a] + pot[u] - pot[v];
+                if (nd < dist[v]) {
+                    dist[v] = nd;
+                    parentArc[v] = a;
+                    pq.push({nd, v});
+                    STAT_INC(STAT_RELAXATIONS);
+                }
+            }
+        }
+        if (dist[T] == INF) break;
+        for (int v = 0; v < N; ++v) if (dist[v] < INF) pot[v] += dist[v];
+
+        long long f = INF;
+        for (int v = T; v != S; v = net.to[parentArc[v] ^ 1]) f = min(f, net.res[parentArc[v]]);
+        for (int v = T; v != S; v = net.to[parentArc[v] ^ 1]) {
+            net.res[parentArc[v]] -= f;
+            net.res[parentArc[v] ^ 1] += f;
+            r.cost += f * net.cost[parentArc[v]];
+        }
+        r.flow += f;
+        r.iterations++;
+        STAT_INC(STAT_AUGMENTING_PATHS);
+    }
+    r.prices.resize(N);
+    for (int v = 0; v < N; ++v) r.prices[v] = pot[v] * costScale(N);    // масштаб как в costScaling
+}
+
+// Диниц по копии сети (без рекурсии: путь хранится явным стеком дуг)
+long long MinCostFlow::maxFlowValue(Network net, int S, int T) {
+    int N = (int)net.out.size();
+    vector<int> level(N), it(N), path;
+    long long total = 0;
+    while (true) {
+        fill(level.begin(), level.end(), -1);
+        vector<int> q{S};
+        level[S] = 0;
+        for (size_t h = 0; h < q.size(); ++h)
+            for (int a : net.out[q[h]])
+                if (net.res[a] > 0 && level[net.to[a]] == -1) {
+                    level[net.to[a]] = level[q[h]] + 1;
+                    q.push_back(net.to[a]);
+                }
+        if (level[T] == -1) break;
+        fill(it.begin(), it.end(), 0);
+        path.clear();
+        int u = S;
+        while (true) {
+            if (u == T) {
+                long long f = LLONG_MAX;
+                for (int a : path) f = min(f, net.res[a]);
+                for (int a : path) { net.res[a] -= f; net.res[a ^ 1] += f; }
+                total += f;
+                size_t cut = 0;
+                while (net.res[path[cut]] > 0) ++cut;
+                path.resize(cut);
+                u = cut == 0 ? S : net.to[path[cut - 1]];
+                continue;
+            }
+            while (it[u] < (int)net.out[u].size()) {
+                int a = net.out[u][it[u]];
+                if (net.res[a] > 0 && level[net.to[a]] == level[u] + 1) break;
+                ++it[u];
+            }
+            if (it[u] == (int)net.out[u].size()) {
+                if (u == S) break;
+                level[u] = -1;   // тупик
+                u = net.to[path.back() ^ 1];
+                path.pop_back();
+                ++it[u];
+                continue;
+            }
+            path.push_back(net.out[u][it[u]]);
+            u = net.to[path.back()];
+        }
+    }
+    return total;
+}
+
+// уточнения (refine) с eps, уменьшающимся в ALPHA раз, до 1; стоимости уже умножены
+// на costScale(N) = N + 1, поэтому eps = 1 — это 1/(N + 1) < 1/N в исходных единицах,
+// и 1-оптимальный поток оптимален: у остаточного цикла из ≤ N дуг стоимость > -1
+void MinCostFlow::costScaling(Network& net, int S, int T, long long F, long long eps,
+                              vector<long long>& price, Result& r) const {
+    const long long ALPHA = 8;
+    int N = (int)net.out.size();
+    vector<long long> excess(N);
+    vector<size_t> current(N);
+    vector<char> inQueue(N);
+    deque<int> active;
+
+    auto rc = [&](int u, int a) { return net.cost[a] + price[u] - price[net.to[a]]; };
+    auto push = [&](int u, int a, long long f) {
+        net.res[a] -= f;
+        net.res[a ^ 1] += f;
+        excess[u] -= f;
+        excess[net.to[a]] += f;
+        r.iterations++;
+    };
+
+    // начальные избытки (при тёплом старте псевдопоток может быть несбалансирован)
+    for (int u = 0; u < N; ++u)
+        for (int a : net.out[u])
+            if (a & 1) excess[u] += net.res[a];      // входящий поток по прямой дуге a ^ 1
+            else excess[u] -= net.res[a ^ 1];        // исходящий поток
+    excess[S] += F;
+    excess[T] -= F;
+
+    do {
+        eps = max<long long>(1, eps / ALPHA);
+        // насыщаем все дуги с отрицательной приведённой стоимостью — получаем 0-оптимальный псевдопоток
+        for (int u = 0; u < N; ++u)
+            for (int a : net.out[u])
+                if (net.res[a] > 0 && rc(u, a) < 0) push(u, a, net.res[a]);
+        active.clear();
+        for (int u = 0; u < N; ++u) {
+            current[u] = 0;
+            inQueue[u] = excess[u] > 0;
+            if (inQueue[u]) active.push_back(u);
+        }
+        while (!active.empty()) {
+            int u = active.front();
+            active.pop_front();
+            inQueue[u] = 0;
+            while (excess[u] > 0) {
+                if (current[u] == net.out[u].size()) {
+                    // relabel: делаем допустимой хотя бы одну остаточную дугу
+                    long long best = LLONG_MIN;
+                    for (int a : net.out[u])
+                        if (net.res[a] > 0) best = max(best, price[net.to[a]] - net.cost[a]);
+                    price[u] = best - eps;
+                    current[u] = 0;
+                    continue;
+                }
+                int a = net.out[u][current[u]];
+                if (net.res[a] > 0 && rc(u, a) < 0) {
+                    int v = net.to[a];
+                    push(u, a, min(excess[u], net.res[a]));
+                    if (excess[v] > 0 && !inQueue[v]) { inQueue[v] = 1; active.push_back(v); }
+                } else {
+                    current[u]++;
+                }
+            }
+        }
+    } while (eps > 1);
+}
+
+// список "A:5,B,C:2" -> терминалы; без количества — без ограничения
+vector<FlowTerminal> parseFlowTerminals(const Graph& g, const string& list) {
+    vector<FlowTerminal> res;
+    stringstream ss(list);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (item.empty()) continue;
+        size_t colon = item.rfind(':');
+        string name = colon == string::npos ? item : item.substr(0, colon);
+        long long amount = colon == string::npos ? -1 : stoll(item.substr(colon + 1));
+        int v = g.findVertex(name);
+        if (v == -1) throw runtime_error("Вершина \"" + name + "\" не найдена");
+        if (amount < 0 && colon != string::npos) throw runtime_error("Отрицательное количество для \"" + name + "\"");
+        res.push_back({v, amount});
+    }
+    if (res.empty()) throw runtime_error("Пустой список вершин");
+    return res;
+}
+
+// ===== Перенумерация вершин =====
+// Индексы вершин — порядок вставки в adjList, поэтому соседи в BFS/Дейкстре
+// разбросаны по памяти. Перенумерация переставляет adjList так, чтобы
+// соседние вершины получили близкие индексы; рёбра хранят имена,
+// поэтому после rebuildIndex всё продолжает работать.
+
+// средний |u - v| по рёбрам (и максимальный — ширина ленты)
+double Graph::averageEdgeGap(int* bandwidth) const {
+    CSR csr = toCSR();
+    long long sum = 0;
+    int band = 0;
+    for (int u = 0; u < csr.vertexCount(); ++u)
+        for (int k = csr.offset[u]; k < csr.offset[u + 1]; ++k) {
+            int gap = abs(u - csr.target[k]);
+            sum += gap;
+            band = max(band, gap);
+        }
+    if (bandwidth) *bandwidth = band;
+    return csr.edgeCount() ? (double)sum / csr.edgeCount() : 0.0;
+}
+
+// order[новый индекс] = текущий индекс
+vector<int> Graph::computeOrder(VertexOrder method, unsigned seed) const {
+    STAT_PHASE("reorder");
+    int n = vertexCount();
+    vector<int> order(n);
+    for (int i = 0; i < n; ++i) order[i] = i;
+    if (method == VertexOrder::Original || n == 0) return order;
+    if (method == VertexOrder::Random) {
+        mt19937 rng(seed);
+        shuffle(order.begin(), order.end(), rng);
+        return order;
+    }
+
+    CSR out = toCSR(), in = directed ? toCSR(true) : out;
+    // соседи без учёта направления
+    auto forNeighbors = [&](int u, auto f) {
+        for (int k = out.offset[u]; k < out.offset[u + 1]; ++k) f(out.target[k]);
+        if (directed) for (int k = in.offset[u]; k < in.offset[u + 1]; ++k) f(in.target[k]);
+    };
+    vector<int> deg(n);
+    for (int u = 0; u < n; ++u)
+        deg[u] = out.offset[u + 1] - out.offset[u] + (directed ? in.offset[u + 1] - in.offset[u] : 0);
+
+    if (method == VertexOrder::Degree) {
+        stable_sort(order.begin(), order.end(), [&](int a, int b) { return deg[a] > deg[b]; });
+        return order;
+    }
+
+    vector<int> result;
+    result.reserve(n);
+    vector<char> placed(n, 0);
+
+    if (method == VertexOrder::BFS) {
+        for (int s = 0; s < n; ++s) {
+            if (placed[s]) continue;
+            size_t head = result.size();
+            result.push_back(s);
+            placed[s] = 1;
+            while (head < result.size()) {
+                int u = result[head++];
+                forNeighbors(u, [&](int v) { if (!placed[v]) { placed[v] = 1; result.push_back(v); } });
+            }
+        }
+        return result;
+    }
+
+    if (method == VertexOrder::RCM) {
+        // Cuthill–McKee от псевдопериферийной вершины каждой компоненты,
+        // соседи — по возрастанию степени; затем порядок разворачивается
+        vector<int> level(n, -1), touched;
+        auto bfsLevels = [&](int s, int& farthest) {
+            for (int v : touched) level[v] = -1;
+            touched.assign(1, s);
+            level[s] = 0;
+            farthest = s;
+            for (size_t h = 0; h < touched.size(); ++h) {
+                int u = touched[h];
+                forNeighbors(u, [&](int v) {
+                    if (level[v] != -1) return;
+                    level[v] = level[u] + 1;
+                    touched.push_back(v);
+                    if (level[v] > level[farthest] || (level[v] == level[farthest] && deg[v] < deg[farthest]))
+                        farthest = v;
+                });
+            }
+            return level[farthest];
+        };
+        vector<int> byDegree(order);
+        stable_sort(byDegree.begin(), byDegree.end(), [&](int a, int b) { return deg[a] < deg[b]; });
+        vector<int> nbrs;
+        for (int start : byDegree) {
+            if (placed[start]) continue;
+            int root = start, far;
+            int ecc = bfsLevels(root, far);
+            for (int it = 0; it < 5; ++it) {
+                int next = far;
+                int e = bfsLevels(next, far);
+                if (e <= ecc) break;
+                ecc = e;
+                root = next;
+            }
+            size_t head = result.size();
+            result.push_back(root);
+            placed[root] = 1;
+            while (head < result.size()) {
+                int u = result[head++];
+                nbrs.clear();
+                forNeighbors(u, [&](int v) { if (!placed[v]) { placed[v] = 1; nbrs.push_back(v); } });
+                stable_sort(nbrs.begin(), nbrs.end(), [&](int a, int b) { return deg[a] < deg[b]; });
+                result.insert(result.end(), nbrs.begin(), nbrs.end());
+            }
+        }
+        reverse(result.begin(), result.end());
+        return result;
+    }
+
+    // Gorder: жадно берём вершину с наибольшим числом связей (рёбер и общих
+    // входящих соседей) с последними WINDOW размещёнными. Через хабы степени
+    // выше hubLimit «братьев» не считаем, иначе обновления квадратичны.
+    const int WINDOW = 5;
+    int hubLimit = max(16, (int)sqrt((double)n));
+    vector<int> score(n, 0);
+    priority_queue<pair<int,int>> heap; // (счёт, -вершина); устаревшие записи отбрасываются при извлечении
+    auto bump = [&](int v, int d) {
+        if (placed[v]) return;
+        score[v] += d;
+        heap.push({score[v], -v});
+    };
+    auto update = [&](int u, int d) {
+        for (int k = out.offset[u]; k < out.offset[u + 1]; ++k) bump(out.target[k], d);
+        for (int k = in.offset[u]; k < in.offset[u + 1]; ++k) {
+            int x = in.target[k];
+            if (directed) bump(x, d);
+            if (out.offset[x + 1] - out.offset[x] > hubLimit) continue;
+            for (int j = out.offset[x]; j < out.offset[x + 1]; ++j)
+                if (out.target[j] != u) bump(out.target[j], d);
+        }
+    };
+    vector<int> byDegree(order);
+    stable_sort(byDegree.begin(), byDegree.end(), [&](int a, int b) { return deg[a] > deg[b]; });
+    size_t nextSeed = 0;
+    deque<int> window;
+    while ((int)result.size() < n) {
+        int v = -1;
+        while (!heap.empty()) {
+            auto [s, negV] = heap.top();
+            heap.pop();
+            if (!placed[-negV] && score[-negV] == s && s > 0) { v = -negV; break; }
+        }
+        if (v == -1) {
+            while (placed[byDegree[nextSeed]]) ++nextSeed;
+            v = byDegree[nextSeed];
+        }
+        placed[v] = 1;
+        result.push_back(v);
+        window.push_back(v);
+        update(v, 1);
+        if ((int)window.size() > WINDOW) {
+            update(window.front(), -1);
+            window.pop_front();
+        }
+    }
+    return result;
+}
+
+// переставить adjList в порядке method; списки смежности сортируются по новым индексам
+Relabeling Graph::reorder(VertexOrder method, unsigned seed) {
+    auto t0 = chrono::steady_clock::now();
+    Relabeling r;
+    r.order = method;
+    r.gapBefore = averageEdgeGap(&r.bandwidthBefore);
+    r.newToOld = computeOrder(method, seed);
+    int n = vertexCount();
+    r.oldToNew.assign(n, 0);
+    for (int i = 0; i < n; ++i) r.oldToNew[r.newToOld[i]] = i;
+
+    vector<Point> next(n);
+    for (int i = 0; i < n; ++i) next[i] = move(adjList[r.newToOld[i]]);
+    adjList.swap(next);
+    rebuildIndex();
+    if (method != VertexOrder::Original) {
+        parallelFor(threadCount(), 0, n, [&](int i) {
+            auto& adj = adjList[i].adj;
+            stable_sort(adj.begin(), adj.end(), [&](const Edge& a, const Edge& b) {
+                return nameIndex.find(a.to)->second < nameIndex.find(b.to)->second;
+            });
+        }, 256);
+    }
+
+    for (auto* l : listeners) l->onRebuild(*this);
+    r.gapAfter = averageEdgeGap(&r.bandwidthAfter);
+    r.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    return r;
+}
+
+// ===== Сжатое представление списков смежности =====
+// Только для чтения. Блок вершины: степень (varint), ширина разностей в байтах,
+// упакованные веса её рёбер, затем отсортированные соседи: первый — varint
+// со знаком (zigzag) относительно самой вершины, остальные — разности
+// одинаковой для блока ширины 1..4 байта, что декодируется без ветвлений. Веса кодируются константой, индексом
+// в словаре (до 256 различных значений) или смещением от минимума — что короче. Имена лежат одним блоком, поиск по имени —
+// двоичный поиск по отсортированному массиву индексов.
+
+// оценка памяти, которую занимает Graph (строки, векторы рёбер, индекс имён)
+size_t graphMemoryBytes(const Graph& g) {
+    auto strBytes = [](const string& s) { return s.capacity() > 15 ? s.capacity() + 1 : 0; };
+    size_t b = sizeof(Graph) + g.adjList.capacity() * sizeof(Point);
+    for (const auto& p : g.adjList) {
+        b += strBytes(p.adress) + p.adj.capacity() * sizeof(Edge);
+        for (const auto& e : p.adj) b += strBytes(e.to);
+        // узел индекса имён: ключ, значение, указатель и хэш
+        b += sizeof(pair<const string, int>) + 2 * sizeof(void*) + strBytes(p.adress);
+    }
+    return b + g.indexMap().bucket_count() * sizeof(void*);
+}
+
+class CompressedGraph {
+public:
+    enum class WeightCoding { Constant, Dictionary, Packed };
+
+    explicit CompressedGraph(const Graph& g);
+
+    int vertexCount() const { return n; }
+    long long arcCount() const { return arcs; }  // для неориентированного — обе стороны
+    bool isDirected() const { return directed; }
+    WeightCoding weightCoding() const { return coding; }
+    int weightBits() const { return width; }
+    string name(int v) const { return nameData.substr(nameOffset[v], nameOffset[v + 1] - nameOffset[v]); }
+    int findVertex(const string& name) const;
+    size_t memoryBytes() const;
+
+    // f(to, w) для всех рёбер v по возрастанию to
+    template <class F>
+    void forEachNeighbor(int v, F f) const {
+        const uint8_t* p = bytes.data() + byteOffset[v];
+        uint64_t deg = readVarint(p);
+        if (deg == 0) return;
+        int gw = *p++;
+        const uint8_t* w = p;
+        p += (deg * width + 7) / 8;
+        uint64_t z = readVarint(p);
+        int to = v + (int)((int64_t)(z >> 1) ^ -(int64_t)(z & 1));
+        f(to, weightAt(w, 0));
+        for (uint64_t i = 1; i < deg; ++i) {
+            to += readGap(p, gw);
+            f(to, weightAt(w, i));
+        }
+    }
+
+    // f(to) — без декодирования весов (для обходов по числу рёбер)
+    template <class F>
+    void forEachTarget(int v, F f) const {
+        const uint8_t* p = bytes.data() + byteOffset[v];
+        uint64_t deg = readVarint(p);
+        if (deg == 0) return;
+        int gw = *p++;
+        p += (deg * width + 7) / 8;
+        uint64_t z = readVarint(p);
+        int to = v + (int)((int64_t)(z >> 1) ^ -(int64_t)(z & 1));
+        f(to);
+        for (uint64_t i = 1; i < deg; ++i) {
+            to += readGap(p, gw);
+            f(to);
+        }
+    }
+
+    vector<int> bfs(int s) const;                  // число рёбер до вершин (-1 — недостижима)
+    vector<long long> dijkstra(int s) const;       // LLONG_MAX / 4 — недостижима
+
+private:
+    int n = 0;
+    bool directed = false;
+    long long arcs = 0;
+    vector<uint8_t> bytes;          // блоки вершин подряд
+    vector<uint64_t> byteOffset;    // начало блока вершины в bytes
+    WeightCoding coding = WeightCoding::Constant;
+    int width = 0;                  // бит на вес
+    int base = 0;                   // константа или минимум
+    vector<int> dict;
+    string nameData;
+    vector<uint64_t> nameOffset;
+    vector<int> byName;             // индексы вершин по возрастанию имени
+
+    static uint64_t readVarint(const uint8_t*& p) {
+        uint64_t x = *p++;
+        if (x < 0x80) return x;
+        x &= 0x7f;
+        for (int shift = 7;; shift += 7) {
+            uint64_t b = *p++;
+            x |= (b & 0x7f) << shift;
+            if (b < 0x80) return x;
+        }
+    }
+
+    // разность соседей фиксированной для блока ширины gw байт (1..4)
+    static int readGap(const uint8_t*& p, int gw) {
+        uint32_t x;
+        memcpy(&x, p, sizeof(x));
+        p += gw;
+        return (int)(gw == 4 ? x : x & ((1u << (8 * gw)) - 1));
+    }
+
+    static void writeVarint(vector<uint8_t>& out, uint64_t x) {
+        while (x >= 0x80) { out.push_back((uint8_t)(x | 0x80)); x >>= 7; }
+        out.push_back((uint8_t)x);
+    }
+
+    // i-й вес блока, начинающегося с w; width <= 32, поэтому хватает 8 байт
+    // (в конце bytes оставлен запас для невыровненного чтения)
+    int weightAt(const uint8_t* w, uint64_t i) const {
+        if (width == 0) return base;
+        uint64_t pos = i * width, word;
+        memcpy(&word, w + (pos >> 3), sizeof(word));
+        uint64_t v = (word >> (pos & 7)) & ((1ULL << width) - 1);
+        return coding == WeightCoding::Dictionary ? dict[v] : (int)(base + (long long)v);
+    }
+};
+
+CompressedGraph::CompressedGraph(const Graph& g) : n(g.vertexCount()), directed(g.isDirected()) {
+    STAT_PHASE("compress");
+    CSR csr = g.toCSR();
+    long long m = arcs = csr.edgeCount();
+
+    // 1) выбор кодирования весов
+    int lo = INT_MAX, hi = INT_MIN;
+    set<int> distinct;
+    for (int w : csr.weight) {
+        lo = min(lo, w);
+        hi = max(hi, w);
+        if (distinct.size() <= 256) distinct.insert(w);
+    }
+    auto bitsFor = [](uint64_t x) { int b = 0; while (b < 64 && (x >> b) > 0) ++b; return b; };
+    if (m == 0 || lo == hi) {
+        coding = WeightCoding::Constant;
+        base = m ? lo : 0;
+    } else {
+        int rangeBits = bitsFor((uint64_t)((long long)hi - lo));
+        int dictBits = distinct.size() <= 256 ? bitsFor(distinct.size() - 1) : 64;
+        if (dictBits < rangeBits) {
+            coding = WeightCoding::Dictionary;
+            width = dictBits;
+            dict.assign(distinct.begin(), distinct.end());
+        } else {
+            coding = WeightCoding::Packed;
+            width = rangeBits;
+            base = lo;
+        }
+    }
+
+    // 2) блоки вершин: степень, веса, соседи по возрастанию
+    byteOffset.resize(n + 1);
+    bytes.reserve((size_t)m * 2 + n);
+    vector<pair<int,int>> nbrs;
+    for (int v = 0; v < n; ++v) {
+        byteOffset[v] = bytes.size();
+        nbrs.clear();
+        for (int k = csr.offset[v]; k < csr.offset[v + 1]; ++k) nbrs.push_back({csr.target[k], csr.weight[k]});
+        sort(nbrs.begin(), nbrs.end());
+        writeVarint(bytes, nbrs.size());
+        if (nbrs.empty()) continue;
+        int gw = 1;
+        for (size_t i = 1; i < nbrs.size(); ++i)
+            while (gw < 4 && (uint32_t)(nbrs[i].first - nbrs[i - 1].first) >> (8 * gw)) ++gw;
+        bytes.push_back((uint8_t)gw);
+
+        size_t w = bytes.size();
+        bytes.resize(w + (nbrs.size() * width + 7) / 8, 0);
+        for (size_t i = 0; width && i < nbrs.size(); ++i) {
+            uint64_t code = coding == WeightCoding::Dictionary
+                ? (uint64_t)(lower_bound(dict.begin(), dict.end(), nbrs[i].second) - dict.begin())
+                : (uint64_t)((long long)nbrs[i].second - base);
+            for (int b = 0; b < width; ++b)
+                if (code >> b & 1) bytes[w + (i * width + b) / 8] |= (uint8_t)(1 << ((i * width + b) % 8));
+        }
+        for (size_t i = 0; i < nbrs.size(); ++i) {
+            if (i == 0) {
+                int64_t d = (int64_t)nbrs[0].first - v;
+                writeVarint(bytes, (uint64_t)((d << 1) ^ (d >> 63)));
+            } else {
+                uint32_t gap = (uint32_t)(nbrs[i].first - nbrs[i - 1].first);
+                for (int b = 0; b < gw; ++b) bytes.push_back((uint8_t)(gap >> (8 * b)));
+            }
+        }
+    }
+    byteOffset[n] = bytes.size();
+    bytes.resize(bytes.size() + 8, 0);   // запас для невыровненного чтения весов и разностей
+    bytes.shrink_to_fit();
+
+    // 3) имена одним блоком
+    nameOffset.resize(n + 1);
+    for (int v = 0; v < n; ++v) {
+        nameOffset[v] = nameData.size();
+        nameData += g.adjList[v].adress;
+    }
+    nameOffset[n] = nameData.size();
+    byName.resize(n);
+    for (int v = 0; v < n; ++v) byName[v] = v;
+    sort(byName.begin(), byName.end(), [&](int a, int b) {
+        return nameData.compare(nameOffset[a], nameOffset[a + 1] - nameOffset[a],
+                                nameData, nameOffset[b], nameOffset[b + 1] - nameOffset[b]) < 0;
+    });
+}
+
+int CompressedGraph::findVertex(const string& name) const {
+    int lo = 0, hi = n;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2, v = byName[mid];
+        int c = nameData.compare(nameOffset[v], nameOffset[v + 1] - nameOffset[v], name);
+        if (c == 0) return v;
+        if (c < 0) lo = mid + 1; else hi = mid;
+    }
+    return -1;
+}
+
+size_t CompressedGraph::memoryBytes() const {
+    return bytes.capacity() + (byteOffset.capacity() + nameOffset.capacity()) * sizeof(uint64_t)
+         + (dict.capacity() + byName.capacity()) * sizeof(int) + nameData.capacity();
+}
+
+vector<int> CompressedGraph::bfs(int s) const {
+    STAT_INC(STAT_BFS_RUNS);
+    vector<int> dist(n, -1), q(n);
+    int* d = dist.data();
+    int* tail = q.data();
+    dist[s] = 0;
+    *tail++ = s;
+    for (int* head = q.data(); head < tail; ++head) {
+        int v = *head, next = d[v] + 1;
+        forEachTarget(v, [&](int to) {
+            if (d[to] == -1) { d[to] = next; *tail++ = to; }
+        });
+    }
+    STAT_ADD(STAT_BFS_VISITED, tail - q.data());
+    return dist;
+}
+
+vector<long long> CompressedGraph::dijkstra(int s) const {
+    const long long INF = LLONG_MAX / 4;
+    vector<long long> dist(n, INF);
+    priority_queue<pair<long long,int>, vector<pair<long long,int>>, greater<pair<long long,int>>> pq;
+    dist[s] = 0;
+    pq.push({0, s});
+    while (!pq.empty()) {
+        auto [d, v] = pq.top(); pq.pop();
+        if (d != dist[v]) continue;
+        forEachNeighbor(v, [&](int to, int w) {
+            if (d + w < dist[to]) {
+                dist[to] = d + w;
+                pq.push({dist[to], to});
+                STAT_INC(STAT_RELAXATIONS);
+                STAT_INC(STAT_HEAP_PUSHES);
+            }
+        });
+    }
+    return dist;
+}
+
+const char* weightCodingName(CompressedGraph::WeightCoding c) {
+    switch (c) {
+        case CompressedGraph::WeightCoding::Constant: return "constant";
+        case CompressedGraph::WeightCoding::Dictionary: return "dictionary";
+        case CompressedGraph::WeightCoding::Packed: return "packed";
+    }
+    return "?";
+}
+
+// ===== Иерархии сокращений (Contraction Hierarchies) =====
+// Предобработка: вершины по очереди "сжимаются" в порядке важности,
+// вместо удалённых путей добавляются рёбра-сокращения (shortcuts).
+// Запрос: двунаправленная Дейкстра только "вверх" по иерархии.
+
+// Дейкстра по CSR с остановкой в t (t = -1 — до всех вершин), для сравнения с CH
+long long dijkstraCSR(const CSR& g, int s, int t, vector<long long>* distOut = nullptr) {
+    const long long INF = LLONG_MAX / 4;
+    int n = g.vertexCount();
+    vector<long long> dist(n, INF);
+    priority_queue<pair<long long,int>, vector<pair<long long,int>>, greater<pair<long long,int>>> pq;
+    dist[s] = 0;
+    pq.push({0, s});
+    while (!pq.empty()) {
+        auto [d, v] = pq.top(); pq.pop();
+        if (d != dist[v]) continue;
+        if (v == t) break;
+        for (int k = g.offset[v]; k < g.offset[v + 1]; ++k) {
+            int to = g.target[k];
+            long long nd = d + g.weight[k];
+            if (nd < dist[to]) {
+                dist[to] = nd;
+                pq.push({nd, to});
+            }
+        }
+    }
+    long long res = (t == -1) ? 0 : dist[t];
+    if (distOut) *distOut = move(dist);
+    return res;
+}
+
+class ContractionHierarchy {
+public:
+    static constexpr long long INF = LLONG_MAX / 4;
+
+    vector<string> names;      // имена вершин (индексы совпадают с adjList исходного графа)
+
+    // статистика предобработки
+    double prepMs = 0;         // время построения, мс
+    long long shortcuts = 0;   // число добавленных сокращений
+    size_t peakPrepBytes = 0;  // пик памяти временного графа при сжатии
+
+    ContractionHierarchy() {}
+    explicit ContractionHierarchy(const Graph& g, int witnessLimit = 500);
+
+    int vertexCount() const { return n; }
+    int findVertex(const string& name) const {
+        auto it = nameIdx.find(name);
+        return it == nameIdx.end() ? -1 : it->second;
+    }
+
+    long long distance(int s, int t) const;
+    vector<int> path(int s, int t) const;  // пустой вектор — пути нет
+
+    size_t memoryBytes() const;            // память готовой иерархии
+    void saveToFile(const string& filePath) const;
+    static ContractionHierarchy loadFromFile(const string& filePath);
+
+private:
+    int n = 0;
+    vector<int> rank;                      // порядок сжатия
+    unordered_map<string, int> nameIdx;
+
+    // восходящий CSR: u -> v, rank[v] > rank[u]
+    vector<int> upOff, upTo, upMid;
+    vector<long long> upW;
+    // нисходящий CSR (хранится развёрнутым): v -> u, rank[v] > rank[u], лежит у u
+    vector<int> downOff, downTo, downMid;
+    vector<long long> downW;
+
+    long long search(int s, int t, int& meet, vector<int>* fwdPar, vector<int>* bwdPar) const;
+    void unpack(int a, int b, int mid, vector<int>& out) const;
+};
+
+ContractionHierarchy::ContractionHierarchy(const Graph& g, int witnessLimit) {
+    STAT_PHASE("chPreprocess");
+    auto t0 = chrono::steady_clock::now();
+    n = g.vertexCount();
+    names.resize(n);
+    for (int i = 0; i < n; ++i) {
+        names[i] = g.adjList[i].adress;
+        nameIdx[names[i]] = i;
+    }
+
+    // временный динамический граф: (сосед, вес, середина сокращения или -1)
+    struct Arc { int v; long long w; int mid; };
+    vector<vector<Arc>> out(n), in(n);
+
+    auto addArc = [&](int u, int v, long long w, int mid) {
+        // параллельные рёбра сливаем, оставляя минимальное
+        for (auto& a : out[u]) if (a.v == v) {
+            if (w < a.w) {
+                a.w = w; a.mid = mid;
+                for (auto& b : in[v]) if (b.v == u) { b.w = w; b.mid = mid; }
+            }
+            return false;
+        }
+        out[u].push_back({v, w, mid});
+        in[v].push_back({u, w, mid});
+        return true;
+    };
+
+    CSR csr = g.toCSR();
+    for (int u = 0; u < n; ++u) {
+        for (int k = csr.offset[u]; k < csr.offset[u + 1]; ++k) {
+            if (csr.weight[k] < 0)
+                throw runtime_error("Иерархия сокращений требует неотрицательных весов рёбер");
+            if (csr.target[k] != u) addArc(u, csr.target[k], csr.weight[k], -1);
+        }
+    }
+
+    vector<char> contracted(n, 0);
+    vector<int> deletedNeighbors(n, 0);
+    vector<int> level(n, 0);
+
+    // локальный поиск свидетелей (witness search) с ограничением числа шагов
+    vector<long long> wdist(n, INF);
+    vector<int> touched;
+    auto witness = [&](int src, int skip, long long limit) {
+        for (int v : touched) wdist[v] = INF;
+        touched.clear();
+        priority_queue<pair<long long,int>, vector<pair<long long,int>>, greater<pair<long long,int>>> pq;
+        wdist[src] = 0; touched.push_back(src);
+        pq.push({0, src});
+        int settled = 0;
+        while (!pq.empty() && settled < witnessLimit) {
+            auto [d, v] = pq.top(); pq.pop();
+            if (d != wdist[v]) continue;
+            if (d > limit) break;
+            ++settled;
+            for (const auto& a : out[v]) {
+                if (contracted[a.v] || a.v == skip) continue;
+                long long nd = d + a.w;
+                if (nd < wdist[a.v]) {
+                    if (wdist[a.v] == INF) touched.push_back(a.v);
+                    wdist[a.v] = nd;
+                    pq.push({nd, a.v});
+                }
+            }
+        }
+    };
+
+    // сжать v (simulate = только посчитать нужные сокращения)
+    auto contract = [&](int v, bool simulate) {
+        int added = 0;
+        long long maxOut = 0;
+        for (const auto& b : out[v]) if (!contracted[b.v]) maxOut = max(maxOut, b.w);
+        for (const auto& a : in[v]) {
+            if (contracted[a.v]) continue;
+            witness(a.v, v, a.w + maxOut);
+            for (const auto& b : out[v]) {
+                if (contracted[b.v] || b.v == a.v) continue;
+                long long via = a.w + b.w;
+                if (wdist[b.v] > via) {
+                    ++added;
+                    if (!simulate && addArc(a.v, b.v, via, v)) ++shortcuts;
+                }
+            }
+        }
+        return added;
+    };
+
+    auto tempBytes = [&]() {
+        size_t b = 0;
+        for (int v = 0; v < n; ++v) b += (out[v].capacity() + in[v].capacity()) * sizeof(Arc);
+        return b;
+    };
+
+    auto priority = [&](int v) {
+        int degree = 0;
+        for (const auto& a : in[v]) if (!contracted[a.v]) ++degree;
+        for (const auto& a : out[v]) if (!contracted[a.v]) ++degree;
+        // разность рёбер + число сжатых соседей + уровень (равномерность иерархии)
+        return 2 * (contract(v, true) - degree) + deletedNeighbors[v] + level[v];
+    };
+
+    priority_queue<pair<int,int>, vector<pair<int,int>>, greater<pair<int,int>>> order;
+    for (int v = 0; v < n; ++v) order.push({priority(v), v});
+    peakPrepBytes = tempBytes();
+
+    rank.assign(n, 0);
+    upOff.assign(n + 1, 0);
+    downOff.assign(n + 1, 0);
+    vector<vector<Arc>> ups(n), downs(n);
+
+    int nextRank = 0;
+    while (!order.empty()) {
+        auto [p, v] = order.top(); order.pop();
+        if (contracted[v]) continue;
+        // ленивое обновление приоритета
+        int actual = priority(v);
+        if (!order.empty() && actual > order.top().first) {
+            order.push({actual, v});
+            continue;
+        }
+
+        contract(v, false);
+        contracted[v] = 1;
+        rank[v] = nextRank++;
+
+        // оставшиеся рёбра v ведут к вершинам с большим рангом
+        for (const auto& b : out[v]) if (!contracted[b.v]) ups[v].push_back(b);
+        for (const auto& a : in[v]) if (!contracted[a.v]) downs[v].push_back(a);
+
+        for (const auto& a : out[v]) if (!contracted[a.v]) {
+            deletedNeighbors[a.v]++;
+            level[a.v] = max(level[a.v], level[v] + 1);
+        }
+        for (const auto& a : in[v]) if (!contracted[a.v]) {
+            deletedNeighbors[a.v]++;
+            level[a.v] = max(level[a.v], level[v] + 1);
+        }
+        if ((nextRank & 1023) == 0) peakPrepBytes = max(peakPrepBytes, tempBytes());
+        out[v].clear(); out[v].shrink_to_fit();
+        in[v].clear(); in[v].shrink_to_fit();
+    }
+    peakPrepBytes = max(peakPrepBytes, tempBytes());
+
+    // упаковываем в CSR
+    for (int v = 0; v < n; ++v) {
+        upOff[v + 1] = upOff[v] + (int)ups[v].size();
+        downOff[v + 1] = downOff[v] + (int)downs[v].size();
+        for (const auto& a : ups[v]) { upTo.push_back(a.v); upW.push_back(a.w); upMid.push_back(a.mid); }
+        for (const auto& a : downs[v]) { downTo.push_back(a.v); downW.push_back(a.w); downMid.push_back(a.mid); }
+    }
+
+    prepMs = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+}
+
+// двунаправленный поиск; meet — вершина встречи
+long long ContractionHierarchy::search(int s, int t, int& meet, vector<int>* fwdPar, vector<int>* bwdPar) const {
+    // рабочие массивы переиспользуются между запросами одного потока
+    thread_local vector<long long> df, db;
+    thread_local vector<int> pf, pb, touched;
+    if ((int)df.size() < n) {
+        df.assign(n, INF); db.assign(n, INF);
+        pf.assign(n, -1); pb.assign(n, -1);
+    }
+    for (int v : touched) { df[v] = db[v] = INF; pf[v] = pb[v] = -1; }
+    touched.clear();
+
+    using QE = pair<long long,int>;
+    priority_queue<QE, vector<QE>, greater<QE>> qf, qb;
+    df[s] = 0; db[t] = 0;
+    touched.push_back(s); touched.push_back(t);
+    qf.push({0, s}); qb.push({0, t});
+
+    long long best = INF;
+    meet = -1;
+    if (s == t) { best = 0; meet = s; }
+
+    while (!qf.empty() || !qb.empty()) {
+        long long top = min(qf.empty() ? INF : qf.top().first,
+                            qb.empty() ? INF : qb.top().first);
+        if (top >= best) break;
+
+        for (int dir = 0; dir < 2; ++dir) {
+            auto& q = dir == 0 ? qf : qb;
+            if (q.empty()) continue;
+            auto [d, v] = q.top(); q.pop();
+            auto& dist = dir == 0 ? df : db;
+            auto& par = dir == 0 ? pf : pb;
+            const auto& other = dir == 0 ? db : df;
+            if (d != dist[v]) continue;
+            if (other[v] != INF && d + other[v] < best) { best = d + other[v]; meet = v; }
+
+            const auto& off = dir == 0 ? upOff : downOff;
+            const auto& to = dir == 0 ? upTo : downTo;
+            const auto& w = dir == 0 ? upW : downW;
+            for (int k = off[v]; k < off[v + 1]; ++k) {
+                long long nd = d + w[k];
+                int u = to[k];
+                if (nd < dist[u]) {
+                    if (df[u] == INF && db[u] == INF) touched.push_back(u);
+                    dist[u] = nd;
+                    par[u] = v;
+                    q.push({nd, u});
+                }
+            }
+        }
+    }
+    if (fwdPar) *fwdPar = pf;
+    if (bwdPar) *bwdPar = pb;
+    return best;
+}
+
+long long ContractionHierarchy::distance(int s, int t) const {
+    if (s < 0 || t < 0 || s >= n || t >= n) return INF;
+    int meet;
+    return search(s, t, meet, nullptr, nullptr);
+}
+
+// развернуть ребро a -> b (mid = середина сокращения) в путь исходного графа
+void ContractionHierarchy::unpack(int a, int b, int mid, vector<int>& out) const {
+    if (mid == -1) { out.push_back(b); return; }
+    // a -> mid лежит в нисходящем списке mid, mid -> b — в восходящем
+    for (int k = downOff[mid]; k < downOff[mid + 1]; ++k)
+        if (downTo[k] == a) { unpack(a, mid, downMid[k], out); break; }
+    for (int k = upOff[mid]; k < upOff[mid + 1]; ++k)
+        if (upTo[k] == b) { unpack(mid, b, upMid[k], out); break; }
+}
+
+vector<int> ContractionHierarchy::path(int s, int t) const {
+    if (s < 0 || t < 0 || s >= n || t >= n) return {};
+    int meet;
+    vector<int> pf, pb;
+    if (search(s, t, meet, &pf, &pb) >= INF) return {};
+
+    // цепочка вершин иерархии: s ... meet ... t
+    vector<int> chain;
+    for (int v = meet; v != -1 && v != s; v = pf[v]) chain.push_back(v);
+    chain.push_back(s);
+    reverse(chain.begin(), chain.end());
+    for (int v = meet; v != t && pb[v] != -1; ) { v = pb[v]; chain.push_back(v); }
+
+    auto edgeMid = [&](int a, int b) {
+        long long bestW = INF; int mid = -1;
+        for (int k = upOff[a]; k < upOff[a + 1]; ++k)
+            if (upTo[k] == b && upW[k] < bestW) { bestW = upW[k]; mid = upMid[k]; }
+        for (int k = downOff[b]; k < downOff[b + 1]; ++k)
+            if (downTo[k] == a && downW[k] < bestW) { bestW = downW[k]; mid = downMid[k]; }
+        return mid;
+    };
+
+    vector<int> result{s};
+    for (size_t i = 0; i + 1 < chain.size(); ++i)
+        unpack(chain[i], chain[i + 1], edgeMid(chain[i], chain[i + 1]), result);
+    return result;
+}
+
+size_t ContractionHierarchy::memoryBytes() const {
+    return (rank.capacity() + upOff.capacity() + upTo.capacity() + upMid.capacity()
+            + downOff.capacity() + downTo.capacity() + downMid.capacity()) * sizeof(int)
+         + (upW.capacity() + downW.capacity()) * sizeof(long long);
+}
+
+// бинарный формат: "CHG1", n, имена, ранги, восходящий и нисходящий CSR
+void ContractionHierarchy::saveToFile(const string& filePath) const {
+    ofstream fout(filePath, ios::binary);
+    if (!fout.is_open()) throw runtime_error("Не удалось открыть файл");
+
+    auto putVec = [&](const auto& v) {
+        uint64_t sz = v.size();
+        fout.write((const char*)&sz, sizeof(sz));
+        fout.write((const char*)v.data(), sz * sizeof(v[0]));
+    };
+    fout.write("CHG1", 4);
+    int32_t nn = n;
+    fout.write((const char*)&nn, sizeof(nn));
+    for (const auto& name : names) {
+        uint32_t len = name.size();
+        fout.write((const char*)&len, sizeof(len));
+        fout.write(name.data(), len);
+    }
+    putVec(rank);
+    putVec(upOff); putVec(upTo); putVec(upMid); putVec(upW);
+    putVec(downOff); putVec(downTo); putVec(downMid); putVec(downW);
+}
+
+// файл мог обрезаться или остаться от другой версии графа: размеры массивов
+// ограничены остатком файла и сверяются между собой, индексы — с числом вершин
+ContractionHierarchy ContractionHierarchy::loadFromFile(const string& filePath) {
+    ifstream fin(filePath, ios::binary | ios::ate);
+    if (!fin.is_open()) throw runtime_error("Не удалось открыть файл");
+    const uint64_t fileSize = (uint64_t)fin.tellg();
+    fin.seekg(0);
+    auto corrupt = []() { return runtime_error("Файл иерархии повреждён"); };
+    auto remaining = [&]() { return fin ? fileSize - (uint64_t)fin.tellg() : 0; };
+
+    auto getVec = [&](auto& v) {
+        uint64_t sz = 0;
+        fin.read((char*)&sz, sizeof(sz));
+        if (!fin || sz > remaining() / sizeof(v[0])) throw corrupt();
+        v.resize(sz);
+        fin.read((char*)v.data(), sz * sizeof(v[0]));
+    };
+    char magic[4];
+    fin.read(magic, 4);
+    if (!fin || string(magic, 4) != "CHG1") throw runtime_error("Неверный формат файла иерархии");
+
+    ContractionHierarchy ch;
+    int32_t nn = 0;
+    fin.read((char*)&nn, sizeof(nn));
+    if (!fin || nn < 0 || (uint64_t)nn > remaining() / sizeof(uint32_t)) throw corrupt();
+    ch.n = nn;
+    ch.names.resize(nn);
+    for (int i = 0; i < nn; ++i) {
+        uint32_t len = 0;
+        fin.read((char*)&len, sizeof(len));
+        if (!fin || len > remaining()) throw corrupt();
+        ch.names[i].resize(len);
+        fin.read(&ch.names[i][0], len);
+        ch.nameIdx[ch.names[i]] = i;
+    }
+    getVec(ch.rank);
+    getVec(ch.upOff); getVec(ch.upTo); getVec(ch.upMid); getVec(ch.upW);
+    getVec(ch.downOff); getVec(ch.downTo); getVec(ch.downMid); getVec(ch.downW);
+    if (!fin) throw corrupt();
+
+    auto inRange = [&](const vector<int>& v, int lo) {
+        return all_of(v.begin(), v.end(), [&](int x) { return x >= lo && x < nn; });
+    };
+    auto validCSR = [&](const vector<int>& off, const vector<int>& to, const vector<int>& mid,
+                        const vector<long long>& w) {
+        if (off.size() != (size_t)nn + 1 || off[0] != 0) return false;
+        for (int i = 0; i < nn; ++i) if (off[i] > off[i + 1]) return false;
+        size_t m = (size_t)off[nn];
+        // mid = -1 — исходное ребро, иначе вершина, через которую проходит сокращение
+        if (to.size() != m || mid.size() != m || w.size() != m || !inRange(to, 0) || !inRange(mid, -1))
+            return false;
+        // дуги ведут вверх по рангу, середина сжата раньше концов — иначе unpack зациклится
+        for (int u = 0; u < nn; ++u)
+            for (int k = off[u]; k < off[u + 1]; ++k)
+                if (ch.rank[to[k]] <= ch.rank[u] || (mid[k] != -1 && ch.rank[mid[k]] >= ch.rank[u])) return false;
+        return true;
+    };
+    if (ch.rank.size() != (size_t)nn || !inRange(ch.rank, 0)
+        || !validCSR(ch.upOff, ch.upTo, ch.upMid, ch.upW)
+        || !validCSR(ch.downOff, ch.downTo, ch.downMid, ch.downW))
+        throw corrupt();
+    return ch;
+}
+
+// построить иерархию, сохранить рядом с графом и сравнить время запросов с Дейкстрой
+void benchmarkContractionHierarchy(const Graph& g, const string& filePath, int queries = 1000) {
+    if (g.vertexCount() == 0) {
+        cout << "Граф пуст.\n";
+        return;
+    }
+    ContractionHierarchy ch(g);
+    cout << "Иерархия построена за " << ch.prepMs << " мс, сокращений: " << ch.shortcuts << "\n";
+    cout << "Память иерархии: " << ch.memoryBytes() << " байт, пик при построении: "
+         << ch.peakPrepBytes << " байт\n";
+    ch.saveToFile(filePath);
+    cout << "Иерархия сохранена в " << filePath << "\n";
+
+    CSR csr = g.toCSR();
+    int n = g.vertexCount();
+    mt19937 rng(12345);
+    vector<pair<int,int>> qs(queries);
+    for (auto& q : qs) q = {(int)(rng() % n), (int)(rng() % n)};
+
+    long long checksumCH = 0, checksumDij = 0;
+    int mismatches = 0;
+    auto t0 = chrono::steady_clock::now();
+    vector<long long> chRes(queries);
+    for (int i = 0; i < queries; ++i) chRes[i] = ch.distance(qs[i].first, qs[i].second);
+    auto t1 = chrono::steady_clock::now();
+    for (int i = 0; i < queries; ++i) {
+        long long d = dijkstraCSR(csr, qs[i].first, qs[i].second);
+        if (d >= ContractionHierarchy::INF) d = ContractionHierarchy::INF;
+        if (d != chRes[i]) ++mismatches;
+        checksumDij += d == ContractionHierarchy::INF ? 0 : d;
+        checksumCH += chRes[i] == ContractionHierarchy::INF ? 0 : chRes[i];
+    }
+    auto t2 = chrono::steady_clock::now();
+
+    double chUs = chrono::duration<double, micro>(t1 - t0).count() / queries;
+    double dijUs = chrono::duration<double, micro>(t2 - t1).count() / queries;
+    cout << "Запросов: " << queries << "\n";
+    cout << "CH: " << chUs << " мкс/запрос, Дейкстра: " << dijUs << " мкс/запрос";
+    if (chUs > 0) cout << " (ускорение x" << dijUs / chUs << ")";
+    cout << "\n";
+    if (mismatches) cout << "ВНИМАНИЕ: расхождений с Дейкстрой: " << mismatches << "\n";
+    else if (checksumCH != checksumDij)
+        cout << "ВНИМАНИЕ: контрольные суммы не совпадают: CH " << checksumCH << ", Дейкстра " << checksumDij << "\n";
+    else cout << "Результаты совпадают с Дейкстрой (контрольная сумма " << checksumCH << ")\n";
+}
+
+// ===== Кратчайшие расстояния между всеми парами (APSP) =====
+// Стратегия выбирается по плотности графа и знакам весов:
+//  - один источник: BFS / Дейкстра / Беллман–Форд;
+//  - разреженный граф: параллельные BFS (единичные веса) или Дейкстра из каждой вершины;
+//  - отрицательные веса: Джонсон (перевзвешивание потенциалами Беллмана–Форда);
+//  - плотный граф: блочный Флойд–Уоршелл.
+
+enum class ApspStrategy { Auto, SingleSource, ParallelBFS, ParallelDijkstra, Johnson, BlockedFloyd };
+
+string apspStrategyName(ApspStrategy s) {
+    switch (s) {
+        case ApspStrategy::Auto: return "auto";
+        case ApspStrategy::SingleSource: return "single-source";
+        case ApspStrategy::ParallelBFS: return "parallel-bfs";
+        case ApspStrategy::ParallelDijkstra: return "parallel-dijkstra";
+        case ApspStrategy::Johnson: return "johnson";
+        case ApspStrategy::BlockedFloyd: return "blocked-floyd";
+    }
+    return "?";
+}
+
+// BFS по CSR (веса игнорируются): out[v] = число рёбер или INF; rev — обратный CSR
+void ssspBFS(const CSR& g, const CSR* rev, int s, long long* out, long long INF) {
+    auto r = directionOptimizingBFS(g, rev, s);
+    for (int v = 0; v < g.vertexCount(); ++v) out[v] = r.dist[v] == -1 ? INF : r.dist[v];
+}
+
+// Дейкстра по CSR; h — потенциалы Джонсона (вес ребра u->v: w + h[u] - h[v])
+void ssspDijkstra(const CSR& g, int s, long long* out, long long INF, const vector<long long>* h = nullptr) {
+    int n = g.vertexCount();
+    fill(out, out + n, INF);
+    priority_queue<pair<long long,int>, vector<pair<long long,int>>, greater<pair<long long,int>>> pq;
+    out[s] = 0;
+    pq.push({0, s});
+    while (!pq.empty()) {
+        auto [d, v] = pq.top(); pq.pop();
+        if (d != out[v]) continue;
+        for (int k = g.offset[v]; k < g.offset[v + 1]; ++k) {
+            int to = g.target[k];
+            long long w = g.weight[k];
+            if (h) w += (*h)[v] - (*h)[to];
+            if (d + w < out[to]) {
+                out[to] = d + w;
+                pq.push({out[to], to});
+            }
+        }
+    }
+    if (h) {
+        // возвращаемся к исходным весам
+        for (int v = 0; v < n; ++v)
+            if (out[v] != INF) out[v] += (*h)[v] - (*h)[s];
+    }
+}
+
+// Беллман–Форд по CSR; false — достижим цикл отрицательного веса
+bool ssspBellmanFord(const CSR& g, int s, long long* out, long long INF) {
+    int n = g.vertexCount();
+    fill(out, out + n, INF);
+    out[s] = 0;
+    for (int i = 0; i < n; ++i) {
+        bool updated = false;
+        for (int u = 0; u < n; ++u) {
+            if (out[u] == INF) continue;
+            for (int k = g.offset[u]; k < g.offset[u + 1]; ++k) {
+                int v = g.target[k];
+                if (out[u] + g.weight[k] < out[v]) {
+                    out[v] = out[u] + g.weight[k];
+                    updated = true;
+                }
+            }
+        }
+        if (!updated) return true;
+    }
+    return false; // изменения на n-й итерации -> отрицательный цикл
+}
+
+class AllPairsDistances {
+public:
+    static constexpr long long INF = LLONG_MAX / 4;
+
+    ApspStrategy used = ApspStrategy::Auto;  // фактически применённая стратегия
+    bool negativeCycle = false;
+    double elapsedMs = 0;
+
+    // sources пустой — считаем все пары; threads = 0 — по числу ядер
+    AllPairsDistances(const Graph& g, const vector<int>& sources = {},
+                      ApspStrategy strategy = ApspStrategy::Auto, int threads = 0);
+
+    int vertexCount() const { return n; }
+    bool hasRow(int s) const { return s >= 0 && s < n && rowOf[s] != -1; }
+    long long dist(int s, int t) const { return rows[(size_t)rowOf[s] * n + t]; }
+
+    // эксцентриситет (INF, если достижимы не все вершины)
+    long long eccentricity(int v) const;
+    long long radius() const;
+    long long diameter() const;
+    vector<int> center() const;
+    vector<int> periphery() const;                   // вершины с эксцентриситетом = диаметру
+    vector<int> nPeriphery(int s, long long N) const; // достижимые вершины с dist(s, v) > N
+
+    static ApspStrategy choose(int n, long long m, bool negative, bool unit, size_t sources);
+
+private:
+    int n = 0;
+    vector<int> rowOf;       // вершина -> номер строки в rows (или -1)
+    vector<long long> rows;  // строки матрицы расстояний подряд
+
+    void requireAll() const {
+        for (int v = 0; v < n; ++v)
+            if (rowOf[v] == -1) throw runtime_error("Нужны расстояния между всеми парами вершин");
+    }
+    void blockedFloyd(const CSR& g, int threads);
+};
+
+ApspStrategy AllPairsDistances::choose(int n, long long m, bool negative, bool unit, size_t sources) {
+    if (sources == 1) return ApspStrategy::SingleSource;
+    // плотный граф: n^3 Флойда сравним с n * m log n серии Дейкстр
+    bool dense = n > 0 && m * 8 >= (long long)n * n;
+    if (dense) return ApspStrategy::BlockedFloyd;
+    if (negative) return ApspStrategy::Johnson;
+    return unit ? ApspStrategy::ParallelBFS : ApspStrategy::ParallelDijkstra;
+}
+
+AllPairsDistances::AllPairsDistances(const Graph& g, const vector<int>& sources,
+                                     ApspStrategy strategy, int threads) {
+    STAT_PHASE("apsp");
+    auto t0 = chrono::steady_clock::now();
+    n = g.vertexCount();
+    CSR csr = g.toCSR();
+
+    bool negative = false, unit = true;
+    for (int w : csr.weight) {
+        if (w < 0) negative = true;
+        if (w != 1) unit = false;
+    }
+
+    vector<int> src = sources;
+    if (src.empty()) { src.resize(n); for (int i = 0; i < n; ++i) src[i] = i; }
+    rowOf.assign(n, -1);
+    for (size_t i = 0; i < src.size(); ++i) rowOf[src[i]] = (int)i;
+
+    used = strategy == ApspStrategy::Auto
+         ? choose(n, csr.edgeCount(), negative, unit, src.size())
+         : strategy;
+    if (used == ApspStrategy::BlockedFloyd && src.size() != (size_t)n) {
+        // Флойд всё равно считает всю матрицу
+        src.resize(n);
+        for (int i = 0; i < n; ++i) { src[i] = i; rowOf[i] = i; }
+    }
+    rows.assign(src.size() * (size_t)n, INF);
+    if (threads <= 0) threads = g.threadCount();
+
+    if (used == ApspStrategy::BlockedFloyd) {
+        blockedFloyd(csr, threads);
+        elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        return;
+    }
+
+    // потенциалы Джонсона: Беллман–Форд от фиктивной вершины (h = 0 для всех)
+    CSR reversed = g.isDirected() && unit ? g.toCSR(true) : CSR();
+    const CSR* rev = g.isDirected() ? &reversed : &csr;
+
+    vector<long long> h;
+    if (used == ApspStrategy::Johnson || (used == ApspStrategy::SingleSource && negative)) {
+        h.assign(n, 0);
+        for (int i = 0; i <= n; ++i) {
+            bool updated = false;
+            for (int u = 0; u < n; ++u)
+                for (int k = csr.offset[u]; k < csr.offset[u + 1]; ++k)
+                    if (h[u] + csr.weight[k] < h[csr.target[k]]) {
+                        h[csr.target[k]] = h[u] + csr.weight[k];
+                        updated = true;
+                    }
+            if (!updated) break;
+            if (i == n) negativeCycle = true;
+        }
+        if (negativeCycle) {
+            elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+            return;
+        }
+    }
+
+    auto runSource = [&](size_t i) {
+        long long* out = &rows[i * n];
+        if (unit && !negative && used != ApspStrategy::Johnson) ssspBFS(csr, rev, src[i], out, INF);
+        else if (h.empty()) ssspDijkstra(csr, src[i], out, INF);
+        else ssspDijkstra(csr, src[i], out, INF, &h);
+    };
+
+    // источники раздаются пулу потоков: каждая задача пишет только свою строку
+    parallelFor(threads, 0, (int)src.size(), [&](int i) { runSource(i); }, 1);
+
+    elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+}
+
+// Флойд–Уоршелл по блокам B x B: диагональный блок, его строка и столбец, остальные
+void AllPairsDistances::blockedFloyd(const CSR& g, int threads) {
+    const int B = 64;
+    for (int i = 0; i < n; ++i) rows[(size_t)i * n + i] = 0;
+    for (int u = 0; u < n; ++u)
+        for (int k = g.offset[u]; k < g.offset[u + 1]; ++k) {
+            long long& d = rows[(size_t)u * n + g.target[k]];
+            d = min(d, (long long)g.weight[k]);
+        }
+
+    auto relaxBlock = [&](int bi, int bj, int bk) {
+        int iEnd = min(n, (bi + 1) * B), jEnd = min(n, (bj + 1) * B), kEnd = min(n, (bk + 1) * B);
+        for (int k = bk * B; k < kEnd; ++k) {
+            const long long* rowK = &rows[(size_t)k * n];
+            for (int i = bi * B; i < iEnd; ++i) {
+                long long* rowI = &rows[(size_t)i * n];
+                long long dik = rowI[k];
+                if (dik == INF) continue;
+                for (int j = bj * B; j < jEnd; ++j) {
+                    if (rowK[j] == INF) continue;
+                    long long nd = dik + rowK[j];
+                    if (nd < rowI[j]) rowI[j] = nd;
+                }
+            }
+        }
+    };
+
+    auto parallelBlocks = [&](const vector<pair<int,int>>& blocks, int bk) {
+        parallelFor(threads, 0, (int)blocks.size(),
+                    [&](int i) { relaxBlock(blocks[i].first, blocks[i].second, bk); }, 1);
+    };
+
+    int nb = (n + B - 1) / B;
+    for (int bk = 0; bk < nb; ++bk) {
+        relaxBlock(bk, bk, bk);
+        vector<pair<int,int>> cross, rest;
+        for (int b = 0; b < nb; ++b) if (b != bk) { cross.push_back({bk, b}); cross.push_back({b, bk}); }
+        parallelBlocks(cross, bk);
+        for (int bi = 0; bi < nb; ++bi)
+            for (int bj = 0; bj < nb; ++bj)
+                if (bi != bk && bj != bk) rest.push_back({bi, bj});
+        parallelBlocks(rest, bk);
+    }
+
+    for (int i = 0; i < n; ++i)
+        if (rows[(size_t)i * n + i] < 0) negativeCycle = true;
+}
+
+long long AllPairsDistances::eccentricity(int v) const {
+    if (!hasRow(v)) throw runtime_error("Расстояния от вершины не вычислены");
+    long long ecc = 0;
+    for (int t = 0; t < n; ++t) ecc = max(ecc, dist(v, t));
+    return ecc;
+}
+
+long long AllPairsDistances::radius() const {
+    requireAll();
+    long long r = INF;
+    for (int v = 0; v < n; ++v) r = min(r, eccentricity(v));
+    return r;
+}
+
+long long AllPairsDistances::diameter() const {
+    requireAll();
+    long long d = 0;
+    for (int v = 0; v < n; ++v) d = max(d, eccentricity(v));
+    return d;
+}
+
+vector<int> AllPairsDistances::center() const {
+    long long r = radius();
+    vector<int> res;
+    for (int v = 0; v < n; ++v) if (eccentricity(v) == r) res.push_back(v);
+    return res;
+}
+
+vector<int> AllPairsDistances::periphery() const {
+    long long d = diameter();
+    vector<int> res;
+    for (int v = 0; v < n; ++v) if (eccentricity(v) == d) res.push_back(v);
+    return res;
+}
+
+vector<int> AllPairsDistances::nPeriphery(int s, long long N) const {
+    if (!hasRow(s)) throw runtime_error("Расстояния от вершины не вычислены");
+    vector<int> res;
+    for (int v = 0; v < n; ++v)
+        if (dist(s, v) > N && dist(s, v) < INF) res.push_back(v);
+    return res;
+}
+
+// N-периферия s по одной строке матрицы расстояний; false — из s достижим
+// отрицательный цикл. Потенциалы Джонсона находят отрицательный цикл в любом
+// месте графа, а строке s мешает только достижимый из s — тогда его ищет
+// Беллман–Форд от s, как и прежний подсчёт по одной вершине
+static bool nPeripheryFrom(const Graph& g, int s, long long N, vector<int>& periphery) {
+    AllPairsDistances apsp(g, {s});
+    periphery.clear();
+    if (!apsp.negativeCycle) {
+        periphery = apsp.nPeriphery(s, N);
+        return true;
+    }
+    vector<long long> dist;
+    if (!g.bellmanFordDistances(s, dist)) return false;
+    for (int v = 0; v < g.vertexCount(); ++v)
+        if (dist[v] > N && dist[v] < LLONG_MAX / 4) periphery.push_back(v);
+    return true;
+}
+
+void Graph::floydPeriphery(const string& start, int N) const {
+    int n = adjList.size();
+    if (n == 0) {
+        cout << "Граф пуст.\n";
+        return;
+    }
+
+    int s = findVertex(start);
+    if (s == -1) {
+        cout << "Вершина " << start << " не найдена в графе.\n";
+        return;
+    }
+
+    vector<int> periphery;
+    if (!nPeripheryFrom(*this, s, N, periphery)) {
+        cout << "Из вершины " << start << " достижим цикл отрицательного веса!\n";
+        return;
+    }
+
+    // Вывод результата
+    cout << "N-периферия вершины " << start << " (N = " << N << "): ";
+    if (periphery.empty())
+        cout << "пусто\n";
+    else {
+        for (int v : periphery)
+            cout << adjList[v].adress << " ";
+        cout << "\n";
+    }
+}
+
+// эксцентриситеты, радиус, диаметр, центр и периферия графа
+void printGraphMetrics(const Graph& g) {
+    if (g.vertexCount() == 0) {
+        cout << "Граф пуст.\n";
+        return;
+    }
+    AllPairsDistances apsp(g);
+    cout << "Стратегия APSP: " << apspStrategyName(apsp.used)
+         << ", время: " << apsp.elapsedMs << " мс\n";
+    if (apsp.negativeCycle) {
+        cout << "Граф содержит цикл отрицательного веса!\n";
+        return;
+    }
+
+    auto show = [&](long long d) { return d >= AllPairsDistances::INF ? string("∞") : to_string(d); };
+    cout << "Эксцентриситеты:\n";
+    for (int v = 0; v < g.vertexCount(); ++v)
+        cout << g.adjList[v].adress << " : " << show(apsp.eccentricity(v)) << "\n";
+    cout << "Радиус: " << show(apsp.radius()) << "\n";
+    cout << "Диаметр: " << show(apsp.diameter()) << "\n";
+    cout << "Центр: ";
+    for (int v : apsp.center()) cout << g.adjList[v].adress << " ";
+    cout << "\nПериферия: ";
+    for (int v : apsp.periphery()) cout << g.adjList[v].adress << " ";
+    cout << "\n";
+}
+
+// ===== Приближённые метрики для больших графов =====
+// Расстояния считаются в рёбрах (как в verticesWithinK). Все методы
+// останавливаются по бюджету времени / числа BFS или по достигнутой точности.
+
+struct ApproxBudget {
+    double timeMs = 1000;    // лимит времени, мс
+    int maxBfs = 64;         // лимит числа обходов BFS
+    double relError = 0.0;   // допустимый относительный зазор между границами (0 — до точного ответа)
+    size_t memoryBytes = 256u << 20;  // лимит памяти счётчиков HyperANF; при нехватке регистров меньше
+    unsigned seed = 1;
+};
+
+// BFS по числу рёбер; возвращает эксцентриситет s (-1, если достижимы не все вершины).
+// rev — обратный CSR для шагов снизу вверх (nullptr — только сверху вниз)
+static int bfsHops(const CSR& g, int s, vector<int>& dist, int* farthest = nullptr, const CSR* rev = nullptr) {
+    auto r = directionOptimizingBFS(g, rev, s);
+    dist = move(r.dist);
+    if (farthest) *farthest = r.last;
+    return r.reached == g.vertexCount() ? (int)r.levelSizes.size() - 1 : -1;
+}
+
+struct DiameterEstimate {
+    long long lower = 0, upper = 0;  // diameter ∈ [lower, upper]; upper = INF — граф несвязен
+    int bfsRuns = 0;
+    bool exact() const { return lower == upper; }
+};
+
+// Верхние/нижние границы эксцентриситетов по выборке источников (BoundingDiameters):
+// для источника s и любой v:  max(d(v,s), ecc(s) - d(s,v)) <= ecc(v) <= d(v,s) + ecc(s)
+struct EccentricityBounds {
+    static constexpr long long INF = LLONG_MAX / 4;
+    vector<long long> lower, upper;
+    int bfsRuns = 0;
+
+    bool exact(int v) const { return lower[v] == upper[v]; }
+    long long diameterLower() const { return lower.empty() ? 0 : *max_element(lower.begin(), lower.end()); }
+    long long diameterUpper() const { return upper.empty() ? 0 : *max_element(upper.begin(), upper.end()); }
+    long long radiusLower() const { return lower.empty() ? 0 : *min_element(lower.begin(), lower.end()); }
+    long long radiusUpper() const { return upper.empty() ? 0 : *min_element(upper.begin(), upper.end()); }
+    // вершины, которые точно / возможно лежат на периферии
+    vector<int> surePeriphery() const {
+        vector<int> res;
+        long long du = diameterUpper();
+        for (int v = 0; v < (int)lower.size(); ++v) if (lower[v] == du) res.push_back(v);
+        return res;
+    }
+    vector<int> candidatePeriphery() const {
+        vector<int> res;
+        long long dl = diameterLower();
+        for (int v = 0; v < (int)upper.size(); ++v) if (upper[v] >= dl) res.push_back(v);
+        return res;
+    }
+};
+
+EccentricityBounds boundEccentricities(const Graph& g, const ApproxBudget& budget) {
+    auto t0 = chrono::steady_clock::now();
+    const long long INF = EccentricityBounds::INF;
+    int n = g.vertexCount();
+    CSR fwd = g.toCSR();
+    CSR bwd = g.isDirected() ? g.toCSR(true) : CSR();
+
+    EccentricityBounds b;
+    b.lower.assign(n, 0);
+    b.upper.assign(n, INF);
+    if (n == 0) return b;
+
+    vector<char> used(n, 0);
+    vector<int> df, db;
+    mt19937 rng(budget.seed);
+    bool pickUpper = true;
+
+    auto gap = [&]() {
+        // наибольший относительный зазор по вершинам с конечной верхней границей
+        double worst = 0;
+        for (int v = 0; v < n; ++v) {
+            if (b.lower[v] == b.upper[v]) continue;
+            if (b.upper[v] >= INF) return 1.0;
+            worst = max(worst, (double)(b.upper[v] - b.lower[v]) / max<long long>(1, b.upper[v]));
+        }
+        return worst;
+    };
+
+    while (b.bfsRuns < budget.maxBfs) {
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        if (ms > budget.timeMs) break;
+        if (gap() <= budget.relError) break;
+
+        // чередуем вершину с наибольшей верхней и наименьшей нижней границей
+        int s = -1;
+        for (int v = 0; v < n; ++v) {
+            if (used[v] || b.lower[v] == b.upper[v]) continue;
+            if (s == -1) { s = v; continue; }
+            if (pickUpper ? (b.upper[v] > b.upper[s] || (b.upper[v] == b.upper[s] && b.lower[v] > b.lower[s]))
+                          : (b.lower[v] < b.lower[s]))
+                s = v;
+        }
+        if (s == -1) break;
+        if (b.bfsRuns == 0) s = (int)(rng() % n);
+        pickUpper = !pickUpper;
+        used[s] = 1;
+        ++b.bfsRuns;
+
+        bfsHops(fwd, s, df, nullptr, g.isDirected() ? &bwd : &fwd);
+        if (g.isDirected()) bfsHops(bwd, s, db, nullptr, &fwd);
+        const vector<int>& toS = g.isDirected() ? db : df; // d(v, s)
+
+        long long eccS = 0;
+        for (int v = 0; v < n; ++v) eccS = df[v] == -1 ? INF : max(eccS, (long long)df[v]);
+        b.lower[s] = b.upper[s] = eccS;
+
+        for (int v = 0; v < n; ++v) {
+            if (toS[v] == -1) {
+                // v не достигает s -> эксцентриситет бесконечен
+                b.lower[v] = b.upper[v] = INF;
+                continue;
+            }
+            long long lo = toS[v];
+            if (eccS < INF && df[v] != -1) lo = max(lo, eccS - df[v]);
+            b.lower[v] = max(b.lower[v], lo);
+            if (eccS < INF) b.upper[v] = min(b.upper[v], toS[v] + eccS);
+        }
+    }
+    return b;
+}
+
+// Диаметр: double sweep даёт нижнюю границу, iFUB сужает верхнюю
+// (для неориентированного связного графа); для орграфа — границы эксцентриситетов
+DiameterEstimate approxDiameter(const Graph& g, const ApproxBudget& budget) {
+    const long long INF = EccentricityBounds::INF;
+    DiameterEstimate est;
+    int n = g.vertexCount();
+    if (n == 0) return est;
+
+    if (g.isDirected()) {
+        auto b = boundEccentricities(g, budget);
+        est.lower = b.diameterLower();
+        est.upper = b.diameterUpper();
+        est.bfsRuns = b.bfsRuns;
+        return est;
+    }
+
+    auto t0 = chrono::steady_clock::now();
+    auto outOfBudget = [&]() {
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        return ms > budget.timeMs || est.bfsRuns >= budget.maxBfs;
+    };
+    CSR csr = g.toCSR();
+    vector<int> dist, distA;
+    mt19937 rng(budget.seed);
+
+    // 1) double sweep: r -> самая дальняя a -> самая дальняя b
+    int a, bEnd;
+    int r = (int)(rng() % n);
+    ++est.bfsRuns;
+    if (bfsHops(csr, r, dist, &a, &csr) == -1) {
+        est.lower = est.upper = INF; // граф несвязен
+        return est;
+    }
+    ++est.bfsRuns;
+    est.lower = bfsHops(csr, a, distA, &bEnd, &csr);
+    est.upper = 2LL * est.lower;
+
+    // 2) середина пути a-b как корень iFUB
+    vector<int> distB;
+    ++est.bfsRuns;
+    bfsHops(csr, bEnd, distB, nullptr, &csr);
+    int u = a;
+    for (int v = 0; v < n; ++v)
+        if (distA[v] + distB[v] == est.lower && distA[v] == est.lower / 2) { u = v; break; }
+
+    ++est.bfsRuns;
+    int eccU = bfsHops(csr, u, dist, nullptr, &csr);
+    est.lower = max<long long>(est.lower, eccU);
+    est.upper = min<long long>(est.upper, 2LL * eccU);
+
+    // 3) iFUB: обходим "кайму" уровней от дальних к ближним
+    vector<vector<int>> fringe(eccU + 1);
+    for (int v = 0; v < n; ++v) fringe[dist[v]].push_back(v);
+    vector<int> tmp;
+    for (int i = eccU; i > 0 && est.lower < est.upper; --i) {
+        for (int v : fringe[i]) {
+            if (outOfBudget()) return est;
+            ++est.bfsRuns;
+            est.lower = max<long long>(est.lower, bfsHops(csr, v, tmp, nullptr, &csr));
+        }
+        // вершины уровней < i не могут дать больше 2(i-1)
+        if (est.lower > 2LL * (i - 1)) { est.upper = est.lower; break; }
+        est.upper = min<long long>(est.upper, 2LL * (i - 1));
+        if ((double)(est.upper - est.lower) <= budget.relError * est.upper) break;
+    }
+    est.upper = max(est.upper, est.lower);
+    return est;
+}
+
+// HyperANF: для каждой вершины счётчик HyperLogLog множества вершин,
+// достижимых за <= t шагов; шаг t+1 — объединение (max регистров) с соседями
+struct NeighborhoodFunction {
+    vector<double> nf;      // nf[t] — оценка числа пар (u, v) с d(u, v) <= t
+    vector<double> ball;    // оценка |B(v, k)| для каждой вершины
+    vector<char> saturated; // регистры v совпадают с объединением по всем вершинам (необходимо для B(v, k) = V)
+    int steps = 0;          // сколько шагов успели сделать (может быть < k при исчерпании бюджета)
+    double relStdDev = 0;   // ожидаемая относительная погрешность одного счётчика
+};
+
+// регистры HyperLogLog упакованы по 10 в слово: поле 6 бит, значение до 31 в младших
+// пяти, шестой — защитный бит для побайтового (SWAR) максимума без переносов между полями
+static const uint64_t HLL_LANE_LOW = 0x041041041041041ULL;   // младший бит каждого из 10 полей
+static const uint64_t HLL_GUARD = HLL_LANE_LOW << 5;
+static const int HLL_PER_WORD = 10;
+
+// поле за полем max(a, b); true, если в a что-то выросло
+static inline bool hllMaxInto(uint64_t& a, uint64_t b) {
+    uint64_t ge = ((a | HLL_GUARD) - b) & HLL_GUARD;       // защитный бит уцелел, где a >= b
+    uint64_t keepA = (ge >> 5) * 31;
+    uint64_t r = (a & keepA) | (b & ~keepA);
+    if (r == a) return false;
+    a = r;
+    return true;
+}
+
+NeighborhoodFunction hyperANF(const Graph& g, int k, const ApproxBudget& budget) {
+    auto t0 = chrono::steady_clock::now();
+    NeighborhoodFunction res;
+    int n = g.vertexCount();
+    if (n == 0) return res;
+
+    // число регистров: 1.04 / sqrt(m) <= relError (от 16 до 4096), но так, чтобы
+    // две таблицы (текущий и следующий шаг) уложились в budget.memoryBytes
+    int bits = 4;
+    double target = budget.relError > 0 ? budget.relError : 0.05;
+    while (bits < 12 && 1.04 / sqrt((double)(1 << bits)) > target) ++bits;
+    auto wordsFor = [](int b) { return ((1 << b) + HLL_PER_WORD - 1) / HLL_PER_WORD; };
+    while (bits > 4 && 2.0 * n * wordsFor(bits) * sizeof(uint64_t) > (double)budget.memoryBytes) --bits;
+    const int m = 1 << bits;
+    const int W = wordsFor(bits);
+    res.relStdDev = 1.04 / sqrt((double)m);
+
+    auto hash64 = [&](uint64_t x) {
+        x += 0x9e3779b97f4a7c15ULL * (budget.seed + 1);
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    };
+    auto reg = [](const uint64_t* row, int i) {
+        return (int)(row[i / HLL_PER_WORD] >> (6 * (i % HLL_PER_WORD)) & 31);
+    };
+
+    vector<uint64_t> cur((size_t)n * W, 0), nxt((size_t)n * W);
+    for (int v = 0; v < n; ++v) {
+        uint64_t h = hash64(v);
+        int r = (int)(h & (m - 1));
+        uint64_t rest = h >> bits;
+        // rho > 31 встречается с вероятностью 2^-31 — насыщаем
+        uint64_t rho = rest ? min(__builtin_ctzll(rest) + 1, 31) : 31;
+        cur[(size_t)v * W + r / HLL_PER_WORD] = rho << (6 * (r % HLL_PER_WORD));
+    }
+
+    const double alpha = m == 16 ? 0.673 : m == 32 ? 0.697 : m == 64 ? 0.709 : 0.7213 / (1 + 1.079 / m);
+    auto estimate = [&](const uint64_t* row) {
+        double sum = 0; int zeros = 0;
+        for (int i = 0; i < m; ++i) { int x = reg(row, i); sum += ldexp(1.0, -x); if (!x) ++zeros; }
+        double e = alpha * m * m / sum;
+        if (e <= 2.5 * m && zeros) e = m * log((double)m / zeros); // линейный подсчёт
+        return min(e, (double)n);
+    };
+    auto totalNF = [&](const vector<uint64_t>& regs) {
+        double s = 0;
+        for (int v = 0; v < n; ++v) s += estimate(&regs[(size_t)v * W]);
+        return s;
+    };
+
+    CSR csr = g.toCSR();
+    res.nf.push_back(totalNF(cur));
+    for (int t = 1; t <= k; ++t) {
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        if (ms > budget.timeMs) break;
+        // строка nxt[v] строится заново из cur[v] и соседей; таблицы меняются местами
+        atomic<bool> changed(false);
+        parallelForWeighted(g.threadCount(), csr.offset, [&](int lo, int hi) {
+            bool local = false;
+            for (int v = lo; v < hi; ++v) {
+                uint64_t* dst = &nxt[(size_t)v * W];
+                copy_n(&cur[(size_t)v * W], W, dst);
+                for (int e = csr.offset[v]; e < csr.offset[v + 1]; ++e) {
+                    const uint64_t* src = &cur[(size_t)csr.target[e] * W];
+                    for (int i = 0; i < W; ++i) local |= hllMaxInto(dst[i], src[i]);
+                }
+            }
+            if (local) changed = true;
+        });
+        cur.swap(nxt);
+        res.steps = t;
+        res.nf.push_back(totalNF(cur));
+        if (!changed) {
+            // шары стабилизировались: дальнейшие шаги ничего не изменят
+            res.steps = k;
+            break;
+        }
+    }
+    vector<uint64_t>().swap(nxt);
+
+    res.ball.resize(n);
+    for (int v = 0; v < n; ++v) res.ball[v] = estimate(&cur[(size_t)v * W]);
+    vector<uint64_t> all(W, 0);
+    for (int v = 0; v < n; ++v)
+        for (int i = 0; i < W; ++i) hllMaxInto(all[i], cur[(size_t)v * W + i]);
+    res.saturated.resize(n);
+    for (int v = 0; v < n; ++v) res.saturated[v] = equal(all.begin(), all.end(), &cur[(size_t)v * W]);
+    return res;
+}
+
+// verticesWithinK с отсечением по HyperANF. Оценка размера шара не отличает
+// «достижимы все» от «достижимы 90%», поэтому она только отсекает: если B(v, k) = V,
+// регистры v обязаны совпасть с объединением регистров всех вершин, и вершины
+// с несовпадающими регистрами отбрасываются без ложных отказов. Каждый оставшийся
+// кандидат проверяется точным BFS глубины k. Если HyperANF не успел сделать k шагов,
+// отсечения нет.
+vector<string> approxVerticesWithinK(const Graph& g, int k, const ApproxBudget& budget,
+                                     NeighborhoodFunction* nfOut = nullptr, int* candidatesOut = nullptr) {
+    STAT_PHASE("approxVerticesWithinK");
+    auto nf = hyperANF(g, k, budget);
+    vector<string> result;
+    int n = g.vertexCount();
+    vector<int> candidates;
+    bool prune = nf.steps >= k && nf.saturated.size() == (size_t)n;
+    for (int v = 0; v < n; ++v)
+        if (!prune || nf.saturated[v]) candidates.push_back(v);
+    if (candidatesOut) *candidatesOut = (int)candidates.size();
+
+    if (!candidates.empty() && k >= 0) {
+        CSR out = g.toCSR();
+        CSR in = g.isDirected() ? g.toCSR(true) : CSR();
+        const CSR* rev = g.isDirected() ? &in : &out;
+        vector<char> ok(candidates.size(), 0);
+        parallelFor(g.threadCount(), 0, (int)candidates.size(), [&](int i) {
+            ok[i] = directionOptimizingBFS(out, rev, candidates[i], 1, k).reached == n;
+        }, 1);
+        for (size_t i = 0; i < candidates.size(); ++i)
+            if (ok[i]) result.push_back(g.adjList[candidates[i]].adress);
+    }
+    if (nfOut) *nfOut = move(nf);
+    return result;
+}
+
+void printApproxMetrics(const Graph& g, int k, const ApproxBudget& budget) {
+    if (g.vertexCount() == 0) {
+        cout << "Граф пуст.\n";
+        return;
+    }
+    const long long INF = EccentricityBounds::INF;
+    auto show = [&](long long d) { return d >= INF ? string("∞") : to_string(d); };
+
+    auto t0 = chrono::steady_clock::now();
+    auto d = approxDiameter(g, budget);
+    auto t1 = chrono::steady_clock::now();
+    cout << "Диаметр ∈ [" << show(d.lower) << ", " << show(d.upper) << "]"
+         << (d.exact() ? " (точно)" : "") << ", BFS: " << d.bfsRuns << ", "
+         << chrono::duration<double, milli>(t1 - t0).count() << " мс\n";
+
+    auto b = boundEccentricities(g, budget);
+    auto t2 = chrono::steady_clock::now();
+    int exactCnt = 0;
+    for (int v = 0; v < g.vertexCount(); ++v) if (b.exact(v)) ++exactCnt;
+    cout << "Эксцентриситеты: точно известны для " << exactCnt << " из " << g.vertexCount()
+         << " вершин, BFS: " << b.bfsRuns << ", "
+         << chrono::duration<double, milli>(t2 - t1).count() << " мс\n";
+    cout << "Радиус ∈ [" << show(b.radiusLower()) << ", " << show(b.radiusUpper()) << "]\n";
+    auto sure = b.surePeriphery(), cand = b.candidatePeriphery();
+    cout << "Периферия: точно " << sure.size() << " вершин, кандидатов " << cand.size() << "\n";
+
+    NeighborhoodFunction nf;
+    int candidates = 0;
+    auto within = approxVerticesWithinK(g, k, budget, &nf, &candidates);
+    auto t3 = chrono::steady_clock::now();
+    cout << "HyperANF: шагов " << nf.steps << " из " << k << ", погрешность счётчика ~"
+         << nf.relStdDev * 100 << "%, кандидатов после отсечения " << candidates << " из " << g.vertexCount()
+         << ", " << chrono::duration<double, milli>(t3 - t2).count() << " мс (с проверкой BFS)\n";
+    cout << "Вершины, из которых все достижимы за ≤ " << k << " шагов: ";
+    for (const auto& name : within) cout << name << " ";
+    cout << "\n";
+}
+
+// ===== Локальная структура: треугольники, кластеризация, k-ядра =====
+// Граф рассматривается как простой неориентированный: направления забываются,
+// петли и кратные рёбра отбрасываются. Результаты — массивы по индексам вершин.
+
+// простой неориентированный CSR с отсортированными списками соседей
+static CSR simpleUndirectedCSR(const Graph& g) {
+    int n = g.vertexCount();
+    // пары (min, max) без петель; у ориентированного графа u -> v и v -> u дают одну пару
+    auto edges = g.canonicalEdges(EdgeMerge::Min);
+    vector<IndexedEdge> pairs;
+    pairs.reserve(edges.size());
+    for (const auto& e : edges)
+        if (e.u != e.v) pairs.push_back({min(e.u, e.v), max(e.u, e.v), 0});
+    auto key = [](const IndexedEdge& e) { return (uint64_t)(uint32_t)e.u << 32 | (uint32_t)e.v; };
+    if (g.isDirected()) {
+        parallelRadixSort(g.threadCount(), pairs, key);
+        pairs.erase(unique(pairs.begin(), pairs.end(), [&](const IndexedEdge& a, const IndexedEdge& b) {
+            return key(a) == key(b);
+        }), pairs.end());
+    }
+
+    CSR csr;
+    csr.offset.assign(n + 1, 0);
+    for (const auto& p : pairs) { csr.offset[p.u + 1]++; csr.offset[p.v + 1]++; }
+    for (int i = 0; i < n; ++i) csr.offset[i + 1] += csr.offset[i];
+    csr.target.resize(csr.offset[n]);
+    csr.weight.assign(csr.offset[n], 1);
+    // пары идут по возрастанию (u, v): вершина x сначала получает меньших соседей
+    // (из пар (a, x)), потом больших (из пар (x, b)) — списки выходят отсортированными
+    vector<int> pos(csr.offset.begin(), csr.offset.end() - 1);
+    for (const auto& p : pairs) {
+        csr.target[pos[p.u]++] = p.v;
+        csr.target[pos[p.v]++] = p.u;
+    }
+    return csr;
+}
+
+struct TriangleStats {
+    vector<long long> triangles;   // число треугольников через вершину
+    vector<double> clustering;     // локальный коэффициент: доля связанных пар соседей
+    long long total = 0;           // треугольников в графе
+    long long wedges = 0;          // путей длины 2 («вилок»)
+    double globalClustering = 0;   // транзитивность: 3 * total / wedges
+    double averageClustering = 0;  // среднее локальных коэффициентов
+    double ms = 0;
+};
+
+// Подсчёт треугольников с ориентацией по степени: ребро направляется от вершины
+// с меньшим (степень, индекс) к большей, поэтому у каждой вершины не больше
+// O(sqrt(m)) исходящих и каждый треугольник находится ровно один раз — как
+// пересечение отсортированных исходящих списков концов ребра слиянием.
+// Параллельно по вершинам с разбиением по числу рёбер
+TriangleStats countTriangles(const Graph& g) {
+    STAT_PHASE("triangles");
+    auto t0 = chrono::steady_clock::now();
+    int n = g.vertexCount();
+    int threads = g.threadCount();
+    CSR und = simpleUndirectedCSR(g);
+    auto deg = [&](int v) { return und.offset[v + 1] - und.offset[v]; };
+    auto lower = [&](int a, int b) { return deg(a) < deg(b) || (deg(a) == deg(b) && a < b); };
+
+    // ориентированный CSR: только рёбра «вверх» по порядку; порядок индексов сохраняется
+    CSR up;
+    up.offset.assign(n + 1, 0);
+    parallelFor(threads, 0, n, [&](int v) {
+        for (int k = und.offset[v]; k < und.offset[v + 1]; ++k) up.offset[v + 1] += lower(v, und.target[k]);
+    }, 1024);
+    for (int v = 0; v < n; ++v) up.offset[v + 1] += up.offset[v];
+    up.target.resize(up.offset[n]);
+    parallelFor(threads, 0, n, [&](int v) {
+        int p = up.offset[v];
+        for (int k = und.offset[v]; k < und.offset[v + 1]; ++k)
+            if (lower(v, und.target[k])) up.target[p++] = und.target[k];
+    }, 1024);
+
+    vector<atomic<long long>> cnt(n);
+    parallelForWeighted(threads, up.offset, [&](int lo, int hi) {
+        long long scanned = 0;
+        for (int u = lo; u < hi; ++u) {
+            const int* au = up.target.data() + up.offset[u];
+            const int* eu = up.target.data() + up.offset[u + 1];
+            long long tu = 0;
+            for (const int* pv = au; pv != eu; ++pv) {
+                int v = *pv;
+                const int* a = au;
+                const int* b = up.target.data() + up.offset[v];
+                const int* eb = up.target.data() + up.offset[v + 1];
+                long long tv = 0;
+                scanned += (eu - a) + (eb - b);
+                while (a != eu && b != eb) {
+                    if (*a < *b) ++a;
+                    else if (*b < *a) ++b;
+                    else {
+                        cnt[*a].fetch_add(1, memory_order_relaxed);
+                        ++tv; ++a; ++b;
+                    }
+                }
+                if (tv) { cnt[v].fetch_add(tv, memory_order_relaxed); tu += tv; }
+            }
+            if (tu) cnt[u].fetch_add(tu, memory_order_relaxed);
+        }
+        STAT_ADD(STAT_EDGES_SCANNED, scanned);
+    });
+
+    TriangleStats r;
+    r.triangles.resize(n);
+    r.clustering.resize(n);
+    for (int v = 0; v < n; ++v) r.triangles[v] = cnt[v].load();
+    parallelFor(threads, 0, n, [&](int v) {
+        long long d = deg(v);
+        r.clustering[v] = d < 2 ? 0.0 : 2.0 * r.triangles[v] / (d * (d - 1));
+    }, 4096);
+    double sumLocal = 0;
+    for (int v = 0; v < n; ++v) {
+        long long d = deg(v);
+        r.total += r.triangles[v];
+        r.wedges += d * (d - 1) / 2;
+        sumLocal += r.clustering[v];
+    }
+    r.total /= 3;
+    r.globalClustering = r.wedges ? 3.0 * r.total / r.wedges : 0.0;
+    r.averageClustering = n ? sumLocal / n : 0.0;
+    r.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    return r;
+}
+
+struct CoreDecomposition {
+    vector<int> core;    // ядерное число: наибольшее k, при котором вершина входит в k-ядро
+    vector<int> order;   // порядок удаления вершин (по неубыванию ядерного числа)
+    int degeneracy = 0;  // наибольшее ядерное число
+    double ms = 0;
+
+    // вершины k-ядра
+    vector<int> kCore(int k) const {
+        vector<int> res;
+        for (int v = 0; v < (int)core.size(); ++v) if (core[v] >= k) res.push_back(v);
+        return res;
+    }
+};
+
+// Разложение на k-ядра (Батагель–Заверсник) за O(V + E): вершины лежат в корзинах
+// по текущей степени, каждый раз снимается вершина наименьшей степени, а её
+// соседи с большей степенью переезжают в корзину ниже обменом за O(1)
+CoreDecomposition coreDecomposition(const Graph& g) {
+    STAT_PHASE("kcore");
+    auto t0 = chrono::steady_clock::now();
+    int n = g.vertexCount();
+    CSR und = simpleUndirectedCSR(g);
+
+    CoreDecomposition r;
+    r.core.resize(n);
+    int maxDeg = 0;
+    for (int v = 0; v < n; ++v) {
+        r.core[v] = und.offset[v + 1] - und.offset[v];
+        maxDeg = max(maxDeg, r.core[v]);
+    }
+    // сортировка подсчётом: vert — вершины по степени, pos — место вершины, bin — начало корзины
+    vector<int> bin(maxDeg + 2, 0), vert(n), pos(n);
+    for (int v = 0; v < n; ++v) bin[r.core[v] + 1]++;
+    for (int d = 0; d <= maxDeg; ++d) bin[d + 1] += bin[d];
+    for (int v = 0; v < n; ++v) {
+        pos[v] = bin[r.core[v]]++;
+        vert[pos[v]] = v;
+    }
+    for (int d = maxDeg; d > 0; --d) bin[d] = bin[d - 1];
+    bin[0] = 0;
+
+    for (int i = 0; i < n; ++i) {
+        int v = vert[i];
+        for (int k = und.offset[v]; k < und.offset[v + 1]; ++k) {
+            int u = und.target[k];
+            if (r.core[u] <= r.core[v]) continue;
+            // u меняется местами с первой вершиной своей корзины, корзина сдвигается
+            int du = r.core[u], pu = pos[u], pw = bin[du], w = vert[pw];
+            if (u != w) { pos[u] = pw; vert[pu] = w; pos[w] = pu; vert[pw] = u; }
+            bin[du]++;
+            r.core[u]--;
+        }
+        STAT_ADD(STAT_EDGES_SCANNED, und.offset[v + 1] - und.offset[v]);
+    }
+    r.order = move(vert);
+    r.degeneracy = n ? *max_element(r.core.begin(), r.core.end()) : 0;
+    r.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    return r;
+}
+
+// ===== Ранжирование вершин: PageRank и посредничество =====
+// PageRank считается «вытягиванием» по обратному CSR: каждая вершина сама
+// суммирует вклады входящих соседей, поэтому записи не пересекаются и потоки не
+// синхронизируются. Векторы рангов — два непрерывных буфера с выравниванием по
+// строке кэша, меняются местами после каждой итерации; поэлементные проходы
+// (вклады, невязка) — простые циклы по массивам, которые компилятор векторизует.
+
+// непрерывный массив, выровненный по 64 байтам (строка кэша, ширина AVX-512)
+template <class T>
+class AlignedArray {
+public:
+    AlignedArray() = default;
+    explicit AlignedArray(size_t n, T fill = T()) : n(n) {
+        size_t bytes = max<size_t>(64, (n * sizeof(T) + 63) / 64 * 64);
+        ptr.reset(static_cast<T*>(aligned_alloc(64, bytes)));
+        if (!ptr) throw bad_alloc();
+        for (size_t i = 0; i < n; ++i) ptr[i] = fill;
+    }
+    T* data() { return ptr.get(); }
+    const T* data() const { return ptr.get(); }
+    T& operator[](size_t i) { return ptr[i]; }
+    const T& operator[](size_t i) const { return ptr[i]; }
+    size_t size() const { return n; }
+    void swap(AlignedArray& o) { ptr.swap(o.ptr); std::swap(n, o.n); }
+    vector<T> toVector() const { return vector<T>(ptr.get(), ptr.get() + n); }
+private:
+    struct Free { void operator()(T* p) const { free(p); } };
+    unique_ptr<T[], Free> ptr;
+    size_t n = 0;
+};
+
+struct PageRankOptions {
+    double damping = 0.85;
+    double tolerance = 1e-9;    // остановка, когда сумма |r_new - r| меньше
+    int maxIterations = 200;
+    vector<int> personalization; // вершины телепортации (пусто — все вершины поровну)
+};
+
+struct PageRankResult {
+    vector<double> rank;    // сумма рангов равна 1
+    int iterations = 0;
+    double delta = 0;       // L1-изменение на последней итерации
+    bool converged = false;
+    double ms = 0;
+};
+
+// Итерация: r'(v) = d * sum r(u) / out(u) по входящим u + (1 - d + d * D) * t(v),
+// где D — ранг висячих вершин (без исходящих рёбер), t — распределение телепортации
+// (персонализированный PageRank — телепортация только в заданные вершины).
+// Вершины делятся между потоками по числу входящих рёбер; невязка считается
+// свёрткой по фиксированным кускам — результат не зависит от числа потоков
+PageRankResult pageRank(const Graph& g, const PageRankOptions& opt = {}) {
+    STAT_PHASE("pagerank");
+    auto t0 = chrono::steady_clock::now();
+    int n = g.vertexCount();
+    int threads = g.threadCount();
+    PageRankResult res;
+    if (n == 0) return res;
+
+    CSR in = g.toCSR(g.isDirected());  // у неориентированного графа обратный совпадает с прямым
+    AlignedArray<double> invOut(n, 0.0), tele(n, 0.0);
+    {
+        vector<int> out(n, 0);
+        for (int u : in.target) out[u]++;
+        for (int u = 0; u < n; ++u) invOut[u] = out[u] ? 1.0 / out[u] : 0.0;
+    }
+    if (opt.personalization.empty()) {
+        for (int v = 0; v < n; ++v) tele[v] = 1.0 / n;
+    } else {
+        for (int v : opt.personalization) {
+            if (v < 0 || v >= n) throw runtime_error("PageRank: вершина телепортации вне графа");
+            tele[v] += 1.0 / opt.personalization.size();
+        }
+    }
+
+    AlignedArray<double> rank(n), next(n), contrib(n);
+    for (int v = 0; v < n; ++v) rank[v] = tele[v];
+    const double d = opt.damping;
+    const int grain = 1 << 14;
+
+    while (res.iterations < opt.maxIterations) {
+        ++res.iterations;
+        // 1) вклады и висячая масса
+        double dangling = parallelReduce(threads, 0, n, 0.0, [&](int lo, int hi) {
+            const double* r = rank.data();
+            const double* io = invOut.data();
+            double* c = contrib.data();
+            double s = 0;
+            for (int u = lo; u < hi; ++u) {
+                c[u] = r[u] * io[u];
+                s += io[u] == 0.0 ? r[u] : 0.0;
+            }
+            return s;
+        }, [](double a, double b) { return a + b; }, grain);
+
+        // 2) вытягивание по входящим рёбрам
+        const double base = 1.0 - d + d * dangling;
+        parallelForWeighted(threads, in.offset, [&](int lo, int hi) {
+            const int* src = in.target.data();
+            const double* c = contrib.data();
+            const double* t = tele.data();
+            double* nx = next.data();
+            for (int v = lo; v < hi; ++v) {
+                double s = 0;
+                for (int k = in.offset[v], e = in.offset[v + 1]; k < e; ++k) s += c[src[k]];
+                nx[v] = d * s + base * t[v];
+            }
+            STAT_ADD(STAT_EDGES_SCANNED, in.offset[hi] - in.offset[lo]);
+        });
+
+        // 3) невязка; проверка сходимости на каждой итерации
+        res.delta = parallelReduce(threads, 0, n, 0.0, [&](int lo, int hi) {
+            const double* r = rank.data();
+            const double* nx = next.data();
+            double s = 0;
+            for (int v = lo; v < hi; ++v) s += fabs(nx[v] - r[v]);
+            return s;
+        }, [](double a, double b) { return a + b; }, grain);
+        rank.swap(next);
+        if (res.delta < opt.tolerance) { res.converged = true; break; }
+    }
+    res.rank = rank.toVector();
+    res.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    return res;
+}
+
+struct BetweennessResult {
+    vector<double> score;   // оценка посредничества (для неориентированного — пары без порядка)
+    int sources = 0;        // число обработанных источников
+    bool exact = false;     // обработаны все вершины
+    double ms = 0;
+};
+
+// Посредничество по Брандесу (пути считаются в рёбрах): из каждого источника BFS
+// с подсчётом числа кратчайших путей, затем обратный проход накапливает
+// зависимости. samples < n — случайная выборка источников без повторений,
+// результат домножается на n / samples (несмещённая оценка). Источники делятся
+// на не более чем 16 фиксированных кусков со своими массивами сумм, которые
+// складываются по порядку — результат не зависит от числа потоков
+BetweennessResult betweenness(const Graph& g, int samples = 0, unsigned seed = 1) {
+    STAT_PHASE("betweenness");
+    auto t0 = chrono::steady_clock::now();
+    int n = g.vertexCount();
+    BetweennessResult res;
+    res.score.assign(n, 0.0);
+    if (n == 0) return res;
+
+    CSR csr = g.toCSR();
+    vector<int> src(n);
+    for (int v = 0; v < n; ++v) src[v] = v;
+    if (samples > 0 && samples < n) {
+        mt19937 rng(seed);
+        for (int i = 0; i < samples; ++i) swap(src[i], src[i + rng() % (n - i)]);
+        src.resize(samples);
+        sort(src.begin(), src.end());
+    }
+    int k = (int)src.size();
+    res.sources = k;
+    res.exact = k == n;
+
+    const int maxParts = 16;
+    int grain = (k + maxParts - 1) / maxParts;
+    int parts = (k + grain - 1) / grain;
+    vector<vector<double>> part(parts);
+    parallelFor(g.threadCount(), 0, parts, [&](int p) {
+        vector<double>& acc = part[p];
+        acc.assign(n, 0.0);
+        vector<int> dist(n, -1), order;
+        vector<double> sigma(n, 0.0), delta(n, 0.0);
+        order.reserve(n);
+        long long scanned = 0;
+        for (int i = p * grain; i < min(k, (p + 1) * grain); ++i) {
+            int s = src[i];
+            order.clear();
+            dist[s] = 0; sigma[s] = 1; order.push_back(s);
+            for (size_t h = 0; h < order.size(); ++h) {
+                int u = order[h];
+                for (int e = csr.offset[u]; e < csr.offset[u + 1]; ++e) {
+                    int v = csr.target[e];
+                    if (dist[v] < 0) { dist[v] = dist[u] + 1; order.push_back(v); }
+                    if (dist[v] == dist[u] + 1) sigma[v] += sigma[u];
+                }
+            }
+            // обратный проход: предшественники v — соседи на уровень ближе к источнику
+            for (size_t h = order.size(); h-- > 0;) {
+                int u = order[h];
+                for (int e = csr.offset[u]; e < csr.offset[u + 1]; ++e) {
+                    int v = csr.target[e];
+                    if (dist[v] == dist[u] + 1) delta[u] += sigma[u] / sigma[v] * (1 + delta[v]);
+                }
+                scanned += 2 * (csr.offset[u + 1] - csr.offset[u]);
+                if (u != s) acc[u] += delta[u];
+            }
+            for (int u : order) { dist[u] = -1; sigma[u] = 0; delta[u] = 0; }
+        }
+        STAT_ADD(STAT_EDGES_SCANNED, scanned);
+    }, 1);
+
+    double scale = (double)n / k / (g.isDirected() ? 1 : 2);
+    for (const auto& acc : part)
+        for (int v = 0; v < n; ++v) res.score[v] += acc[v];
+    for (auto& x : res.score) x *= scale;
+    res.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    return res;
+}
+
+// ===== Разбиение графа на части и выполнение по частям =====
+// Вершины делятся на части распространением меток (минимизация числа разрезанных
+// рёбер при ограничении на размер части). Каждая часть хранится отдельным CSR
+// (шардом) и обслуживается своим потоком: поток сам выделяет и заполняет память
+// шарда, поэтому по правилу первого касания страницы оказываются на узле NUMA,
+// где он работает (потоки частей закрепляются за процессорами своих узлов).
+// Алгоритмы идут супершагами: части считают независимо, затем обмениваются
+// значениями граничных вершин. Рёбра в другие части ведут в «призрачные»
+// вершины — локальные копии чужих граничных вершин.
+
+struct PartitionOptions {
+    int parts = 0;             // число частей (0 — max(узлов NUMA, число потоков графа))
+    int rounds = 20;           // наибольшее число раундов распространения меток
+    double imbalance = 1.05;   // вес части (сумма степеней + 1) не больше imbalance * среднего
+    bool pin = true;           // закреплять потоки частей за процессорами узлов NUMA
+};
+
+// процессоры каждого узла NUMA по /sys/devices/system/node (пусто — сведений нет)
+static vector<vector<int>> numaNodeCpus() {
+    vector<vector<int>> nodes;
+    for (int node = 0;; ++node) {
+        ifstream fin("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+        if (!fin.is_open()) break;
+        string list, item;
+        getline(fin, list);
+        vector<int> cpus;
+        stringstream ss(list);
+        while (getline(ss, item, ',')) {
+            if (item.empty()) continue;
+            size_t dash = item.find('-');
+            int lo = stoi(item.substr(0, dash));
+            int hi = dash == string::npos ? lo : stoi(item.substr(dash + 1));
+            for (int c = lo; c <= hi; ++c) cpus.push_back(c);
+        }
+        nodes.push_back(cpus);
+    }
+    return nodes;
+}
+
+// Разбиение распространением меток: начальные части — равные по весу отрезки порядка
+// BFS (связные куски), затем в каждом раунде вершина переходит в часть, где больше
+// всего её соседей, если там есть место. Проход последовательный, результат
+// детерминирован; cut — число неориентированных рёбер между частями
+vector<int> partitionLabelPropagation(const Graph& g, int parts, const PartitionOptions& opt = {},
+                                      long long* cut = nullptr) {
+    STAT_PHASE("partition");
+    int n = g.vertexCount();
+    parts = max(1, min(parts, max(1, n)));
+    CSR und = simpleUndirectedCSR(g);
+
+    vector<int> order;
+    order.reserve(n);
+    vector<char> seen(n, 0);
+    for (int s = 0; s < n; ++s) {
+        if (seen[s]) continue;
+        seen[s] = 1;
+        order.push_back(s);
+        for (size_t h = order.size() - 1; h < order.size(); ++h) {
+            int u = order[h];
+            for (int k = und.offset[u]; k < und.offset[u + 1]; ++k)
+                if (!seen[und.target[k]]) { seen[und.target[k]] = 1; order.push_back(und.target[k]); }
+        }
+    }
+    // вес вершины — степень + 1: части выравниваются по работе обходов, а не только по числу вершин
+    auto weight = [&](int v) { return (long long)und.offset[v + 1] - und.offset[v] + 1; };
+    long long total = (long long)n + und.edgeCount();
+    vector<int> part(n);
+    vector<long long> size(parts, 0);
+    long long acc = 0;
+    for (int i = 0; i < n; ++i) {
+        int v = order[i];
+        part[v] = (int)min<long long>(parts - 1, acc * parts / total);
+        acc += weight(v);
+        size[part[v]] += weight(v);
+    }
+
+    long long cap = max<long long>(1, (long long)ceil(opt.imbalance * total / parts));
+    vector<int> cnt(parts, 0), touched;
+    for (int round = 0; round < opt.rounds; ++round) {
+        long long moves = 0;
+        for (int v : order) {
+            touched.clear();
+            for (int k = und.offset[v]; k < und.offset[v + 1]; ++k) {
+                int p = part[und.target[k]];
+                if (cnt[p]++ == 0) touched.push_back(p);
+            }
+            int cur = part[v], best = cur;
+            for (int p : touched)
+                if (p != cur && size[p] + weight(v) <= cap &&
+                    (cnt[p] > cnt[best] || (cnt[p] == cnt[best] && best != cur && p < best)))
+                    best = p;
+            if (best != cur && cnt[best] > cnt[cur]) {
+                size[cur] -= weight(v); size[best] += weight(v);
+                part[v] = best;
+                ++moves;
+            }
+            for (int p : touched) cnt[p] = 0;
+        }
+        if (moves == 0) break;
+    }
+    if (cut) {
+        *cut = 0;
+        for (int v = 0; v < n; ++v)
+            for (int k = und.offset[v]; k < und.offset[v + 1]; ++k)
+                if (v < und.target[k] && part[v] != part[und.target[k]]) ++*cut;
+    }
+    return part;
+}
+
+class PartitionedGraph {
+public:
+    struct Shard {
+        vector<int> vertex;       // локальный индекс -> глобальный
+        vector<int> ghostOwner;   // призрачная вершина: часть-владелец
+        vector<int> ghostLocal;   //                     и индекс в ней
+        CSR out, in;              // цели < localCount() — свои вершины, дальше — призрачные
+        long long crossArcs = 0;  // дуг (out и in) в другие части
+        int boundary = 0;         // вершин с соседями в других частях
+
+        int localCount() const { return (int)vertex.size(); }
+        const CSR& inArcs(bool directed) const { return directed ? in : out; }
+    };
+
+    PartitionedGraph(const Graph& g, const PartitionOptions& opt = {});
+    ~PartitionedGraph();
+    PartitionedGraph(const PartitionedGraph&) = delete;
+    PartitionedGraph& operator=(const PartitionedGraph&) = delete;
+
+    int partCount() const { return (int)shards.size(); }
+    int part(int v) const { return owner[v]; }
+    int localIndex(int v) const { return local[v]; }
+    const Shard& shard(int p) const { return shards[p]; }
+    long long edgeCut() const { return cut; }
+    int numaNodes() const { return max(1, (int)nodes.size()); }
+    double buildMs() const { return ms; }
+
+    // число рёбер от s (-1 — недостижима), BFS по уровням с обменом границей
+    vector<int> bfs(int s) const;
+    // слабые компоненты: метка — наименьший индекс вершины компоненты
+    vector<int> components(int* count = nullptr) const;
+    PageRankResult pageRank(const PageRankOptions& opt = {}) const;
+
+private:
+    bool directed;
+    int n;
+    vector<int> owner, local;
+    vector<Shard> shards;
+    vector<vector<int>> nodes;
+    long long cut = 0;
+    double ms = 0;
+
+    // потоки частей: f(p) выполняется потоком части p, run возвращается после всех
+    vector<thread> workers;
+    mutable mutex runLock;     // один супершаг за раз
+    mutable mutex m;
+    mutable condition_variable wake, done;
+    mutable const function<void(int)>* job = nullptr;
+    mutable uint64_t generation = 0;
+    mutable int pending = 0;
+    bool stopping = false;
+
+    void workerLoop(int p, bool pin);
+    void run(const function<void(int)>& f) const;
+};
+
+void PartitionedGraph::workerLoop(int p, bool pin) {
+    if (pin && nodes.size() > 1) {
+        const auto& cpus = nodes[(long long)p * nodes.size() / shards.size()];
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int c : cpus) CPU_SET(c, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    uint64_t seen = 0;
+    unique_lock<mutex> lk(m);
+    while (true) {
+        wake.wait(lk, [&]() { return stopping || generation != seen; });
+        if (stopping) return;
+        seen = generation;
+        const auto* f = job;
+        lk.unlock();
+        (*f)(p);
+        lk.lock();
+        if (--pending == 0) done.notify_all();
+    }
+}
+
+void PartitionedGraph::run(const function<void(int)>& f) const {
+    lock_guard<mutex> serial(runLock);
+    unique_lock<mutex> lk(m);
+    job = &f;
+    pending = (int)shards.size();
+    ++generation;
+    wake.notify_all();
+    done.wait(lk, [&]() { return pending == 0; });
+}
+
+PartitionedGraph::PartitionedGraph(const Graph& g, const PartitionOptions& opt)
+    : directed(g.isDirected()), n(g.vertexCount()), nodes(numaNodeCpus()) {
+    STAT_PHASE("partition_build");
+    auto t0 = chrono::steady_clock::now();
+    int parts = opt.parts > 0 ? opt.parts : max((int)nodes.size(), g.threadCount());
+    owner = partitionLabelPropagation(g, parts, opt, &cut);
+    parts = 0;
+    for (int p : owner) parts = max(parts, p + 1);
+    parts = max(parts, 1);
+    local.assign(n, 0);
+    vector<int> size(parts, 0);
+    for (int v = 0; v < n; ++v) local[v] = size[owner[v]]++;
+
+    CSR fwd = g.toCSR();
+    CSR bwd = directed ? g.toCSR(true) : CSR();
+    shards.resize(parts);
+    for (int p = 0; p < parts; ++p) workers.emplace_back([this, p, &opt]() { workerLoop(p, opt.pin); });
+
+    // каждый шард строит его собственный поток (первое касание памяти)
+    run([&](int p) {
+        Shard& sh = shards[p];
+        sh.vertex.reserve(size[p]);
+        for (int v = 0; v < n; ++v) if (owner[v] == p) sh.vertex.push_back(v);
+        unordered_map<int, int> ghost;
+        auto build = [&](const CSR& src, CSR& dst) {
+            dst.offset.assign(sh.localCount() + 1, 0);
+            for (int i = 0; i < sh.localCount(); ++i) {
+                int v = sh.vertex[i];
+                dst.offset[i + 1] = dst.offset[i] + src.offset[v + 1] - src.offset[v];
+            }
+            dst.target.resize(dst.offset.back());
+            dst.weight.resize(dst.offset.back());
+            for (int i = 0; i < sh.localCount(); ++i) {
+                int v = sh.vertex[i], k = dst.offset[i];
+                for (int e = src.offset[v]; e < src.offset[v + 1]; ++e, ++k) {
+                    int t = src.target[e];
+                    dst.weight[k] = src.weight[e];
+                    if (owner[t] == p) { dst.target[k] = local[t]; continue; }
+                    auto it = ghost.find(t);
+                    if (it == ghost.end()) {
+                        it = ghost.emplace(t, (int)sh.ghostOwner.size()).first;
+                        sh.ghostOwner.push_back(owner[t]);
+                        sh.ghostLocal.push_back(local[t]);
+                    }
+                    dst.target[k] = sh.localCount() + it->second;
+                    sh.crossArcs++;
+                }
+            }
+        };
+        build(fwd, sh.out);
+        if (directed) build(bwd, sh.in);
+        auto crosses = [&](const CSR& c, int i) {
+            if (c.offset.empty()) return false;  // in у неориентированного графа не хранится
+            for (int k = c.offset[i]; k < c.offset[i + 1]; ++k)
+                if (c.target[k] >= sh.localCount()) return true;
+            return false;
+        };
+        for (int i = 0; i < sh.localCount(); ++i) sh.boundary += crosses(sh.out, i) || crosses(sh.in, i);
+    });
+    ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+}
+
+PartitionedGraph::~PartitionedGraph() {
+    {
+        lock_guard<mutex> lk(m);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& t : workers) t.join();
+}
+
+vector<int> PartitionedGraph::bfs(int s) const {
+    STAT_PHASE("bfs_partitioned");
+    int P = partCount();
+    struct State {
+        vector<int> dist, frontier, next;
+        vector<char> sent;              // призрачная вершина уже отправлена владельцу
+        vector<vector<int>> outbox;     // outbox[q] — индексы вершин части q
+    };
+    vector<State> st(P);
+    run([&](int p) {
+        const Shard& sh = shards[p];
+        st[p].dist.assign(sh.localCount(), -1);
+        st[p].sent.assign(sh.ghostOwner.size(), 0);
+        st[p].outbox.resize(P);
+        if (owner[s] == p) { st[p].dist[local[s]] = 0; st[p].frontier.push_back(local[s]); }
+    });
+    for (int level = 0;; ++level) {
+        // 1) каждая часть расширяет свой фронт; рёбра наружу — в почтовые ящики владельцев
+        run([&](int p) {
+            const Shard& sh = shards[p];
+            State& my = st[p];
+            int L = sh.localCount();
+            my.next.clear();
+            for (int u : my.frontier)
+                for (int k = sh.out.offset[u]; k < sh.out.offset[u + 1]; ++k) {
+                    int t = sh.out.target[k];
+                    if (t < L) {
+                        if (my.dist[t] < 0) { my.dist[t] = level + 1; my.next.push_back(t); }
+                    } else if (!my.sent[t - L]) {
+                        my.sent[t - L] = 1;
+                        my.outbox[sh.ghostOwner[t - L]].push_back(sh.ghostLocal[t - L]);
+                    }
+                }
+        });
+        // 2) обмен: каждая часть забирает адресованные ей вершины
+        run([&](int p) {
+            State& my = st[p];
+            for (int q = 0; q < P; ++q) {
+                for (int v : st[q].outbox[p])
+                    if (my.dist[v] < 0) { my.dist[v] = level + 1; my.next.push_back(v); }
+                st[q].outbox[p].clear();
+            }
+            my.frontier.swap(my.next);
+        });
+        size_t active = 0;
+        for (const auto& x : st) active += x.frontier.size();
+        if (active == 0) break;
+    }
+    vector<int> dist(n);
+    for (int p = 0; p < P; ++p)
+        for (int i = 0; i < shards[p].localCount(); ++i) dist[shards[p].vertex[i]] = st[p].dist[i];
+    return dist;
+}
+
+vector<int> PartitionedGraph::components(int* count) const {
+    STAT_PHASE("components_partitioned");
+    int P = partCount();
+    // внутри части — система непересекающихся множеств по внутренним рёбрам,
+    // между частями — распространение наименьшей метки компоненты через границу
+    struct State {
+        vector<int> comp;        // локальная компонента вершины
+        vector<int> label;       // метка компоненты (наименьший глобальный индекс)
+        vector<int> ghostLabel;  // метки призрачных вершин с прошлого обмена
+        bool changed = false;
+    };
+    vector<State> st(P);
+    run([&](int p) {
+        const Shard& sh = shards[p];
+        State& my = st[p];
+        int L = sh.localCount();
+        vector<int> parent(L);
+        for (int i = 0; i < L; ++i) parent[i] = i;
+        auto find = [&](int a) { while (parent[a] != a) a = parent[a] = parent[parent[a]]; return a; };
+        for (int u = 0; u < L; ++u)
+            for (int k = sh.out.offset[u]; k < sh.out.offset[u + 1]; ++k)
+                if (sh.out.target[k] < L) {
+                    int a = find(u), b = find(sh.out.target[k]);
+                    if (a != b) parent[max(a, b)] = min(a, b);
+                }
+        my.comp.resize(L);
+        my.label.assign(L, INT_MAX);
+        for (int u = 0; u < L; ++u) {
+            my.comp[u] = find(u);
+            my.label[my.comp[u]] = min(my.label[my.comp[u]], sh.vertex[u]);
+        }
+        my.ghostLabel.assign(sh.ghostOwner.size(), INT_MAX);
+    });
+    while (true) {
+        // обмен: чтение меток владельцев (в этой фазе метки никто не пишет)
+        run([&](int p) {
+            const Shard& sh = shards[p];
+            for (size_t gI = 0; gI < sh.ghostOwner.size(); ++gI) {
+                const State& o = st[sh.ghostOwner[gI]];
+                st[p].ghostLabel[gI] = o.label[o.comp[sh.ghostLocal[gI]]];
+            }
+        });
+        run([&](int p) {
+            const Shard& sh = shards[p];
+            State& my = st[p];
+            int L = sh.localCount();
+            my.changed = false;
+            for (const CSR* c : {&sh.out, &sh.in})
+                for (int u = 0; u < (int)c->offset.size() - 1; ++u)
+                    for (int k = c->offset[u]; k < c->offset[u + 1]; ++k) {
+                        int t = c->target[k];
+                        if (t < L) continue;
+                        int& lab = my.label[my.comp[u]];
+                        if (my.ghostLabel[t - L] < lab) { lab = my.ghostLabel[t - L]; my.changed = true; }
+                    }
+        });
+        bool any = false;
+        for (const auto& x : st) any |= x.changed;
+        if (!any) break;
+    }
+    vector<int> label(n);
+    int comps = 0;
+    for (int p = 0; p < P; ++p)
+        for (int i = 0; i < shards[p].localCount(); ++i) {
+            int v = shards[p].vertex[i];
+            label[v] = st[p].label[st[p].comp[i]];
+            comps += label[v] == v;
+        }
+    if (count) *count = comps;
+    return label;
+}
+
+// тот же PageRank, что и pageRank(g): вклады граничных вершин перед вытягиванием
+// копируются в призрачные вершины; висячая масса и невязка складываются по частям
+PageRankResult PartitionedGraph::pageRank(const PageRankOptions& opt) const {
+    STAT_PHASE("pagerank_partitioned");
+    auto t0 = chrono::steady_clock::now();
+    int P = partCount();
+    PageRankResult res;
+    if (n == 0) return res;
+    vector<double> teleGlobal(n, 0.0);
+    if (opt.personalization.empty()) fill(teleGlobal.begin(), teleGlobal.end(), 1.0 / n);
+    else for (int v : opt.personalization) {
+        if (v < 0 || v >= n) throw runtime_error("PageRank: вершина телепортации вне графа");
+        teleGlobal[v] += 1.0 / opt.personalization.size();
+    }
+
+    struct State {
+        AlignedArray<double> rank, next, invOut, tele;
+        AlignedArray<double> contrib;  // свои вершины, за ними — копии вкладов призрачных
+        double dangling = 0, delta = 0;
+    };
+    vector<State> st(P);
+    run([&](int p) {
+        const Shard& sh = shards[p];
+        State& my = st[p];
+        int L = sh.localCount();
+        my.rank = AlignedArray<double>(L);
+        my.next = AlignedArray<double>(L);
+        my.contrib = AlignedArray<double>(L + sh.ghostOwner.size());
+        my.invOut = AlignedArray<double>(L);
+        my.tele = AlignedArray<double>(L);
+        for (int i = 0; i < L; ++i) {
+            int deg = sh.out.offset[i + 1] - sh.out.offset[i];
+            my.invOut[i] = deg ? 1.0 / deg : 0.0;
+            my.tele[i] = my.rank[i] = teleGlobal[sh.vertex[i]];
+        }
+    });
+    const double d = opt.damping;
+    while (res.iterations < opt.maxIterations) {
+        ++res.iterations;
+        run([&](int p) {
+            State& my = st[p];
+            int L = shards[p].localCount();
+            const double* r = my.rank.data();
+            const double* io = my.invOut.data();
+            double* c = my.contrib.data();
+            double s = 0;
+            for (int u = 0; u < L; ++u) {
+                c[u] = r[u] * io[u];
+                s += io[u] == 0.0 ? r[u] : 0.0;
+            }
+            my.dangling = s;
+        });
+        double dangling = 0;
+        for (const auto& x : st) dangling += x.dangling;
+        const double base = 1.0 - d + d * dangling;
+        run([&](int p) {
+            const Shard& sh = shards[p];
+            State& my = st[p];
+            int L = sh.localCount();
+            // обмен границей: вклады чужих вершин, на которые ссылаются входящие дуги
+            for (size_t gI = 0; gI < sh.ghostOwner.size(); ++gI)
+                my.contrib[L + gI] = st[sh.ghostOwner[gI]].contrib[sh.ghostLocal[gI]];
+            const CSR& in = sh.inArcs(directed);
+            const int* src = in.target.data();
+            const double* c = my.contrib.data();
+            const double* t = my.tele.data();
+            const double* r = my.rank.data();
+            double* nx = my.next.data();
+            double delta = 0;
+            for (int v = 0; v < L; ++v) {
+                double s = 0;
+                for (int k = in.offset[v], e = in.offset[v + 1]; k < e; ++k) s += c[src[k]];
+                nx[v] = d * s + base * t[v];
+                delta += fabs(nx[v] - r[v]);
+            }
+            my.delta = delta;
+            my.rank.swap(my.next);
+        });
+        res.delta = 0;
+        for (const auto& x : st) res.delta += x.delta;
+        if (res.delta < opt.tolerance) { res.converged = true; break; }
+    }
+    res.rank.assign(n, 0.0);
+    for (int p = 0; p < P; ++p)
+        for (int i = 0; i < shards[p].localCount(); ++i) res.rank[shards[p].vertex[i]] = st[p].rank[i];
+    res.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    return res;
+}
+
+// ===== Генераторы синтетических графов =====
+// Вершины называются v0, v1, ...; параллельные рёбра и петли отбрасываются.
+
+struct WeightSpec {
+    string kind = "uniform";  // unit | uniform | heavy (логнормальный хвост) | mixed (есть отрицательные)
+    int lo = 1, hi = 100;
+};
+
+// разбор "unit", "uniform:1:100", "heavy:1:1000", "mixed:-5:20"
+WeightSpec parseWeightSpec(const string& text) {
+    WeightSpec ws;
+    size_t p1 = text.find(':');
+    ws.kind = text.substr(0, p1);
+    if (p1 != string::npos) {
+        size_t p2 = text.find(':', p1 + 1);
+        ws.lo = stoi(text.substr(p1 + 1, p2 - p1 - 1));
+        if (p2 != string::npos) ws.hi = stoi(text.substr(p2 + 1));
+    }
+    if (ws.kind != "unit" && ws.kind != "uniform" && ws.kind != "heavy" && ws.kind != "mixed")
+        throw runtime_error("Неизвестное распределение весов: " + ws.kind);
+    if (ws.lo > ws.hi) swap(ws.lo, ws.hi);
+    return ws;
+}
+
+static int drawWeight(const WeightSpec& ws, mt19937_64& rng) {
+    if (ws.kind == "unit") return 1;
+    if (ws.kind == "heavy") {
+        lognormal_distribution<double> d(0.0, 1.5);
+        return (int)min<double>(ws.hi, ws.lo + d(rng));
+    }
+    return uniform_int_distribution<int>(ws.lo, ws.hi)(rng);
+}
+
+// собрать граф из списка пар (рёбра уже без дубликатов)
+static Graph buildGenerated(int n, const vector<pair<int,int>>& edges, bool directed,
+                            const WeightSpec& ws, mt19937_64& rng) {
+    Graph g(directed);
+    g.setVerbose(false);
+    for (int i = 0; i < n; ++i) g.addPoint("v" + to_string(i));
+    for (auto [u, v] : edges) g.addEdgeByIndex(u, v, drawWeight(ws, rng));
+    return g;
+}
+
+// добавить ребро, если его ещё нет (для неориентированного графа — пара без порядка)
+static void pushUnique(vector<pair<int,int>>& edges, unordered_map<uint64_t, char>& seen,
+                       int u, int v, bool directed) {
+    if (u == v) return;
+    if (!directed && u > v) swap(u, v);
+    uint64_t key = ((uint64_t)u << 32) | (uint32_t)v;
+    if (seen.emplace(key, 1).second) edges.push_back({u, v});
+}
+
+// Эрдёш–Реньи G(n, m): m случайных рёбер
+Graph generateErdosRenyi(int n, long long m, bool directed, const WeightSpec& ws, unsigned seed) {
+    mt19937_64 rng(seed);
+    long long maxEdges = (long long)n * (n - 1) / (directed ? 1 : 2);
+    m = min(m, maxEdges);
+    vector<pair<int,int>> edges;
+    unordered_map<uint64_t, char> seen;
+    seen.reserve(m * 2);
+    while ((long long)edges.size() < m)
+        pushUnique(edges, seen, (int)(rng() % n), (int)(rng() % n), directed);
+    return buildGenerated(n, edges, directed, ws, rng);
+}
+
+// R-MAT / Кронекер: 2^scale вершин, рекурсивный выбор квадранта с вероятностями a, b, c, d
+Graph generateRMAT(int scale, long long m, bool directed, const WeightSpec& ws, unsigned seed,
+                   double a = 0.57, double b = 0.19, double c = 0.19) {
+    mt19937_64 rng(seed);
+    uniform_real_distribution<double> U(0, 1);
+    int n = 1 << scale;
+    vector<pair<int,int>> edges;
+    unordered_map<uint64_t, char> seen;
+    seen.reserve(m * 2);
+    // при малых графах повторы неизбежны — ограничиваем число попыток
+    for (long long attempts = 0; (long long)edges.size() < m && attempts < m * 20; ++attempts) {
+        int u = 0, v = 0;
+        for (int bit = 0; bit < scale; ++bit) {
+            double r = U(rng);
+            int du = r >= a + b, dv = (r >= a && r < a + b) || r >= a + b + c;
+            u |= du << bit;
+            v |= dv << bit;
+        }
+        pushUnique(edges, seen, u, v, directed);
+    }
+    return buildGenerated(n, edges, directed, ws, rng);
+}
+
+// 2D-решётка rows x cols; "дорожная" сеть: часть рёбер удаляется, изредка добавляются диагонали
+Graph generateGrid(int rows, int cols, bool directed, const WeightSpec& ws, unsigned seed,
+                   double dropProb = 0.0, double diagProb = 0.0) {
+    mt19937_64 rng(seed);
+    uniform_real_distribution<double> U(0, 1);
+    vector<pair<int,int>> edges;
+    unordered_map<uint64_t, char> seen;
+    auto id = [&](int r, int c) { return r * cols + c; };
+    for (int r = 0; r < rows; ++r)
+        for (int c = 0; c < cols; ++c) {
+            if (c + 1 < cols && U(rng) >= dropProb) pushUnique(edges, seen, id(r, c), id(r, c + 1), directed);
+            if (r + 1 < rows && U(rng) >= dropProb) pushUnique(edges, seen, id(r, c), id(r + 1, c), directed);
+            if (r + 1 < rows && c + 1 < cols && U(rng) < diagProb)
+                pushUnique(edges, seen, id(r, c), id(r + 1, c + 1), directed);
+            if (directed) {
+                // двусторонние дороги
+                if (c + 1 < cols) pushUnique(edges, seen, id(r, c + 1), id(r, c), directed);
+                if (r + 1 < rows) pushUnique(edges, seen, id(r + 1, c), id(r, c), directed);
+            }
+        }
+    return buildGenerated(rows * cols, edges, directed, ws, rng);
+}
+
+// степенной закон: модель Барабаши–Альберт, каждая новая вершина даёт k рёбер
+Graph generatePowerLaw(int n, int k, bool directed, const WeightSpec& ws, unsigned seed) {
+    mt19937_64 rng(seed);
+    vector<pair<int,int>> edges;
+    unordered_map<uint64_t, char> seen;
+    vector<int> ends; // каждая вершина встречается столько раз, какова её степень
+    int core = min(n, k + 1);
+    for (int i = 0; i < core; ++i)
+        for (int j = i + 1; j < core; ++j) {
+            pushUnique(edges, seen, j, i, directed);
+            ends.push_back(i); ends.push_back(j);
+        }
+    for (int v = core; v < n; ++v) {
+        for (int t = 0; t < k; ++t) {
+            int u = ends[rng() % ends.size()];
+            size_t before = edges.size();
+            pushUnique(edges, seen, v, u, directed);
+            if (edges.size() != before) { ends.push_back(u); ends.push_back(v); }
+        }
+    }
+    return buildGenerated(n, edges, directed, ws, rng);
+}
+
+// длинная цепочка v0 - v1 - ... - v(n-1): худший случай по глубине обходов
+Graph generateChain(int n, bool directed, const WeightSpec& ws, unsigned seed) {
+    mt19937_64 rng(seed);
+    vector<pair<int,int>> edges;
+    for (int i = 0; i + 1 < n; ++i) edges.push_back({i, i + 1});
+    return buildGenerated(n, edges, directed, ws, rng);
+}
+
+// ===== Замеры производительности (--bench) =====
+// Пример: realisation_graph --bench --gen rmat --n 65536 --deg 8 --weights uniform:1:100 --reps 5
+// Результат — JSON (stdout или --out файл) для отслеживания регрессий.
+
+static long peakRssKb() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss; // в Linux — килобайты
+}
+
+static string jsonEscape(const string& s) {
+    string r;
+    for (char c : s) {
+        switch (c) {
+            case '"':  r += "\\\""; break;
+            case '\\': r += "\\\\"; break;
+            case '\n': r += "\\n"; break;
+            case '\t': r += "\\t"; break;
+            case '\r': r += "\\r"; break;
+            case '\b': r += "\\b"; break;
+            case '\f': r += "\\f"; break;
+            default:
+                if ((unsigned char)c < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", (unsigned char)c);
+                    r += buf;
+                } else r += c;
+        }
+    }
+    return r;
+}
+
+int runBenchmark(const vector<string>& args) {
+    // параметры по умолчанию
+    unordered_map<string, string> opt = {
+        {"gen", "er"}, {"n", "10000"}, {"deg", "8"}, {"weights", "uniform:1:100"},
+        {"directed", "0"}, {"reps", "5"}, {"seed", "42"}, {"threads", "0"},
+        {"k", "3"}, {"quad-limit", "2000"}, {"out", ""}, {"save", ""}, {"order", "original"}, {"parts", "0"},
+        {"algos", "load,classify,components,dijkstra,bellman_ford,floyd,kruskal,edmonds_karp,within_k"}
+    };
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i].rfind("--", 0) != 0) continue;
+        string key = args[i].substr(2);
+        if (key == "bench") continue;
+        if (i + 1 >= args.size()) throw runtime_error("Нет значения для --" + key);
+        if (!opt.count(key)) throw runtime_error("Неизвестный параметр --" + key);
+        opt[key] = args[++i];
+    }
+
+    int n = stoi(opt["n"]);
+    int deg = stoi(opt["deg"]);
+    bool directed = opt["directed"] == "1";
+    int reps = max(1, stoi(opt["reps"]));
+    unsigned seed = (unsigned)stoul(opt["seed"]);
+    int quadLimit = stoi(opt["quad-limit"]);
+    WeightSpec ws = parseWeightSpec(opt["weights"]);
+    const string& gen = opt["gen"];
+
+    // 1) генерация
+    auto t0 = chrono::steady_clock::now();
+    Graph g;
+    if (gen == "er") g = generateErdosRenyi(n, (long long)n * deg / (directed ? 1 : 2), directed, ws, seed);
+    else if (gen == "rmat") {
+        int scale = 1;
+        while ((1 << scale) < n) ++scale;
+        g = generateRMAT(scale, (long long)(1 << scale) * deg / (directed ? 1 : 2), directed, ws, seed);
+    }
+    else if (gen == "grid") {
+        int side = max(1, (int)sqrt((double)n));
+        g = generateGrid(side, side, directed, ws, seed);
+    }
+    else if (gen == "road") {
+        int side = max(1, (int)sqrt((double)n));
+        g = generateGrid(side, side, directed, ws, seed, 0.1, 0.05);
+    }
+    else if (gen == "powerlaw") g = generatePowerLaw(n, max(1, deg / 2), directed, ws, seed);
+    else if (gen == "chain") g = generateChain(n, directed, ws, seed);
+    else throw runtime_error("Неизвестный генератор: " + gen);
+    g.setThreads(stoi(opt["threads"]));
+    double genMs = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+
+    n = g.vertexCount();
+    long long m = g.edgeCount();
+    string file = opt["save"].empty() ? "bench_graph_tmp.txt" : opt["save"];
+    g.saveToFile(file);
+
+    // перенумерация вершин (после сохранения: load замеряет загрузку вместе с ней)
+    VertexOrder order = parseVertexOrder(opt["order"]);
+    Relabeling relabel = g.reorder(order, seed);
+
+    // 2) замеры
+    // rssGrowthKb — на сколько прогон поднял пик RSS процесса (ru_maxrss только растёт,
+    // поэтому сам пик после прогона повторял бы наибольшее значение предыдущих алгоритмов)
+    struct Result { string algo; vector<double> ms; string skipped; long rssGrowthKb = 0; };
+    vector<Result> results;
+    mt19937 rng(seed);
+
+    auto measure = [&](const string& algo, const function<void()>& fn) {
+        Result r{algo, {}, "", 0};
+        for (int i = 0; i < reps; ++i) {
+            long before = peakRssKb();
+            auto a = chrono::steady_clock::now();
+            fn();
+            r.ms.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - a).count());
+            r.rssGrowthKb = max(r.rssGrowthKb, peakRssKb() - before);
+        }
+        results.push_back(r);
+    };
+    // рёбра в секунду имеют смысл только для ядер, линейных (почти) по числу рёбер
+    static const set<string> edgeLinear = {
+        "load", "components", "dijkstra", "dijkstra_csr", "bfs", "bfs_topdown", "compress", "bfs_compressed",
+        "dijkstra_compressed", "kruskal", "canonical_edges", "save", "kcore", "bfs_partitioned",
+        "components_partitioned"
+    };
+    auto skip = [&](const string& algo, const string& why) { results.push_back({algo, {}, why, 0}); };
+
+    volatile long long sink = 0; // не даём компилятору выбросить вычисления
+    CSR csr, rcsr;                    // для bfs / dijkstra_csr
+    unique_ptr<CompressedGraph> cg;   // для *_compressed
+    long long dynTouched = 0, dynUpdates = 0;   // для dynamic_sssp
+    unique_ptr<PartitionedGraph> pg;  // для *_partitioned
+    PartitionOptions partOpt;
+    partOpt.parts = stoi(opt["parts"]);
+    size_t graphBytes = graphMemoryBytes(g);
+    stringstream algosList(opt["algos"]);
+    string algo;
+    while (getline(algosList, algo, ',')) {
+        bool quadratic = algo == "floyd" || algo == "edmonds_karp" || algo == "within_k";
+        if (quadratic && n > quadLimit) { skip(algo, "n > quad-limit"); continue; }
+        if (n == 0) { skip(algo, "empty graph"); continue; }
+
+        if (algo == "load") measure(algo, [&]() { Graph h(file, directed, false, order); sink += h.vertexCount(); });
+        else if (algo == "classify") measure(algo, [&]() { sink += g.classify().size(); });
+        else if (algo == "components") measure(algo, [&]() { sink += g.countComponents(); });
+        else if (algo == "dijkstra") {
+            bool negative = false;
+            for (const auto& p : g.adjList) for (const auto& e : p.adj) if (e.weight < 0) negative = true;
+            if (negative) { skip(algo, "negative weights"); continue; }
+            measure(algo, [&]() { sink += g.dijkstraDistances(rng() % n)[0]; });
+        }
+        else if (algo == "bellman_ford") measure(algo, [&]() { vector<long long> d; sink += g.bellmanFordDistances(rng() % n, d); });
+        else if (algo == "floyd") measure(algo, [&]() {
+            AllPairsDistances apsp(g, {}, ApspStrategy::BlockedFloyd, g.threadCount());
+            sink += apsp.dist(0, n - 1);
+        });
+        else if (algo == "kruskal") {
+            if (directed) { skip(algo, "directed graph"); continue; }
+            measure(algo, [&]() { sink += g.kruskalEdges().size(); });
+        }
+        else if (algo == "triangles") measure(algo, [&]() { sink += countTriangles(g).total; });
+        else if (algo == "kcore") measure(algo, [&]() { sink += coreDecomposition(g).degeneracy; });
+        else if (algo == "pagerank") measure(algo, [&]() { sink += pageRank(g).iterations; });
+        else if (algo == "betweenness") measure(algo, [&]() { sink += betweenness(g, 64, seed).sources; });
+        else if (algo == "partition") measure(algo, [&]() { pg.reset(new PartitionedGraph(g, partOpt)); sink += pg->edgeCut(); });
+        else if (algo == "bfs_partitioned" || algo == "components_partitioned" || algo == "pagerank_partitioned") {
+            if (!pg) pg.reset(new PartitionedGraph(g, partOpt));
+            if (algo == "bfs_partitioned") measure(algo, [&]() { sink += pg->bfs(rng() % n)[0]; });
+            else if (algo == "components_partitioned") measure(algo, [&]() { int c = 0; pg->components(&c); sink += c; });
+            else measure(algo, [&]() { sink += pg->pageRank().iterations; });
+        }
+        else if (algo == "canonical_edges") measure(algo, [&]() { sink += g.canonicalEdges(EdgeMerge::Min).size(); });
+        else if (algo == "save") measure(algo, [&]() { g.saveToFile(file); sink += 1; });
+        else if (algo == "edmonds_karp") measure(algo, [&]() { sink += g.maxFlow(0, n - 1); });
+        else if (algo == "within_k") measure(algo, [&]() { sink += g.verticesWithinK(stoi(opt["k"])).size(); });
+        else if (algo == "bfs" || algo == "bfs_topdown" || algo == "dijkstra_csr") {
+            if (csr.offset.empty()) csr = g.toCSR();
+            if (directed && rcsr.offset.empty()) rcsr = g.toCSR(true);
+            const CSR* rev = algo == "bfs_topdown" ? nullptr : directed ? &rcsr : &csr;
+            if (algo == "dijkstra_csr") measure(algo, [&]() { sink += dijkstraCSR(csr, rng() % n, -1); });
+            else measure(algo, [&]() {
+                sink += directionOptimizingBFS(csr, rev, rng() % n, g.threadCount()).reached;
+            });
+        }
+        else if (algo == "compress") measure(algo, [&]() { cg.reset(new CompressedGraph(g)); sink += cg->arcCount(); });
+        else if (algo == "bfs_compressed" || algo == "dijkstra_compressed") {
+            if (!cg) cg.reset(new CompressedGraph(g));
+            if (algo == "bfs_compressed") measure(algo, [&]() { sink += cg->bfs(rng() % n)[0]; });
+            else measure(algo, [&]() { sink += cg->dijkstra(rng() % n)[0]; });
+        }
+        else if (algo == "dynamic_sssp") {
+            bool negative = false;
+            for (const auto& p : g.adjList) for (const auto& e : p.adj) if (e.weight < 0) negative = true;
+            if (negative) { skip(algo, "negative weights"); continue; }
+            // замер: 100 случайных изменений веса на +-10 с поддержкой дерева от вершины 0
+            Graph h(g);
+            h.setVerbose(false);
+            DynamicSSSP dyn(h);
+            dyn.addSource(0);
+            measure(algo, [&]() {
+                for (int k = 0; k < 100; ++k) {
+                    int u = rng() % n;
+                    if (h.adjList[u].adj.empty()) continue;
+                    Edge e = h.adjList[u].adj[rng() % h.adjList[u].adj.size()];
+                    h.setEdgeWeight(h.adjList[u].adress, e.to, max(0, e.weight + (int)(rng() % 21) - 10));
+                    dynTouched += dyn.lastUpdate().touched;
+                    dynUpdates++;
+                }
+            });
+        }
+        else skip(algo, "unknown algorithm");
+    }
+    if (opt["save"].empty()) remove(file.c_str());
+
+    // 3) отчёт
+    ostringstream js;
+    js << "{\"generator\":\"" << jsonEscape(gen) << "\",\"n\":" << n << ",\"m\":" << m
+       << ",\"directed\":" << (directed ? "true" : "false")
+       << ",\"weights\":\"" << jsonEscape(opt["weights"]) << "\",\"threads\":" << g.threadCount()
+       << ",\"reps\":" << reps << ",\"seed\":" << seed << ",\"generate_ms\":" << genMs
+       << ",\"order\":\"" << vertexOrderName(order) << "\",\"reorder_ms\":" << relabel.ms
+       << ",\"avg_edge_gap_before\":" << relabel.gapBefore << ",\"avg_edge_gap_after\":" << relabel.gapAfter
+       << ",\"graph_bytes\":" << graphBytes;
+    if (cg) {
+        js << ",\"compressed_bytes\":" << cg->memoryBytes()
+           << ",\"compression_ratio\":" << (double)graphBytes / max<size_t>(1, cg->memoryBytes())
+           << ",\"weight_coding\":\"" << weightCodingName(cg->weightCoding()) << "\",\"weight_bits\":" << cg->weightBits();
+    }
+    if (dynUpdates) js << ",\"dynamic_touched_avg\":" << (double)dynTouched / dynUpdates;
+    if (pg) {
+        long long boundary = 0;
+        for (int p = 0; p < pg->partCount(); ++p) boundary += pg->shard(p).boundary;
+        js << ",\"parts\":" << pg->partCount() << ",\"numa_nodes\":" << pg->numaNodes()
+           << ",\"edge_cut\":" << pg->edgeCut() << ",\"boundary_vertices\":" << boundary
+           << ",\"partition_build_ms\":" << pg->buildMs();
+    }
+    js << ",\"results\":[";
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto& r = results[i];
+        js << (i ? "," : "") << "{\"algo\":\"" << jsonEscape(r.algo) << "\"";
+        if (!r.skipped.empty()) {
+            js << ",\"skipped\":\"" << jsonEscape(r.skipped) << "\"}";
+            continue;
+        }
+        sort(r.ms.begin(), r.ms.end());
+        double median = r.ms[r.ms.size() / 2];
+        double p99 = r.ms[min(r.ms.size() - 1, (size_t)ceil(r.ms.size() * 0.99) - 1)];
+        js << ",\"median_ms\":" << median << ",\"p99_ms\":" << p99
+           << ",\"min_ms\":" << r.ms.front() << ",\"max_ms\":" << r.ms.back();
+        if (edgeLinear.count(r.algo)) js << ",\"edges_per_sec\":" << (median > 0 ? m / (median / 1000.0) : 0);
+        js << ",\"peak_rss_growth_kb\":" << r.rssGrowthKb << "}";
+    }
+    js << "],\"peak_rss_kb\":" << peakRssKb() << "}\n";
+
+    if (opt["out"].empty()) cout << js.str();
+    else {
+        ofstream fout(opt["out"]);
+        if (!fout.is_open()) throw runtime_error("Не удалось открыть файл");
+        fout << js.str();
+    }
+    return 0;
+}
+
+// ===== Потоковая обработка файлов рёбер (--stream) =====
+// Файл "откуда куда вес" не загружается в Graph: каждый алгоритм — несколько
+// последовательных проходов по файлу. В памяти только словарь имён и O(V)
+// состояние; там, где нужна внешняя сортировка (MST), рёбра сбрасываются
+// на диск отсортированными сериями в пределах бюджета памяти.
+
+class EdgeFileStream {
+public:
+    // первый проход строит словарь вершин (нумерация — как в Graph(filePath))
+    EdgeFileStream(const string& path, bool directed) : path(path), directed(directed) {
+        forEachRaw([&](const string& from, const string& to, int) {
+            intern(from);
+            intern(to);
+            ++edges;
+        });
+    }
+
+    bool isDirected() const { return directed; }
+    int vertexCount() const { return (int)names.size(); }
+    long long edgeCount() const { return edges; }
+    int passCount() const { return passes; }
+    const string& name(int v) const { return names[v]; }
+
+    int findVertex(const string& name) const {
+        auto it = index.find(name);
+        return it == index.end() ? -1 : it->second;
+    }
+
+    // оценка памяти словаря
+    size_t stateBytes() const {
+        size_t b = names.capacity() * sizeof(string) + index.bucket_count() * sizeof(void*);
+        for (const auto& s : names) b += 2 * (s.capacity() + 1) + 32;
+        return b;
+    }
+
+    // один последовательный проход: f(u, v, w) с номерами вершин
+    template <class F>
+    void forEachEdge(F f) {
+        forEachRaw([&](const string& from, const string& to, int w) {
+            f(index.find(from)->second, index.find(to)->second, w);
+        });
+    }
+
+private:
+    string path;
+    bool directed;
+    vector<string> names;
+    unordered_map<string, int> index;
+    long long edges = 0;
+    int passes = 0;
+
+    void intern(const string& s) {
+        if (index.emplace(s, (int)names.size()).second) names.push_back(s);
+    }
+
+    template <class F>
+    void forEachRaw(F f) {
+        STAT_PHASE("stream_pass");
+        // буфер задаётся до open(): после открытия pubsetbuf у filebuf не определён
+        vector<char> buf(1 << 20);
+        filebuf fb;
+        fb.pubsetbuf(buf.data(), buf.size());
+        if (!fb.open(path, ios::in)) throw runtime_error("Не удалось открыть файл");
+        istream fin(&fb);
+        string from, to;
+        int w;
+        while (fin >> from >> to >> w) f(from, to, w);
+        ++passes;
+    }
+};
+
+struct StreamDegreeStats {
+    long long selfLoops = 0;
+    int isolatedOut = 0;              // вершины без исходящих рёбер (для ориентированного)
+    int minDegree = 0, maxDegree = 0;
+    double avgDegree = 0;
+    string maxDegreeVertex;
+    vector<long long> histogram;      // [b] — число вершин со степенью в [2^(b-1), 2^b)
+};
+
+// степени за один проход; для неориентированного петля даёт степень 2, как в printDegrees.
+// Считается каждая строка файла: в отличие от Graph(filePath), повторы не схлопываются,
+// поэтому неориентированный файл, где ребро записано в обе стороны ("a b" и "b a"),
+// даст обеим вершинам вдвое большую степень (для схлопывания нужна O(E) память)
+StreamDegreeStats streamDegrees(EdgeFileStream& es) {
+    int n = es.vertexCount();
+    vector<int> deg(n, 0), outDeg(n, 0);
+    StreamDegreeStats st;
+    es.forEachEdge([&](int u, int v, int) {
+        deg[u]++;
+        deg[v]++;
+        outDeg[u]++;
+        if (u == v) st.selfLoops++;
+    });
+    if (n == 0) return st;
+    st.minDegree = INT_MAX;
+    long long sum = 0;
+    for (int v = 0; v < n; ++v) {
+        sum += deg[v];
+        st.minDegree = min(st.minDegree, deg[v]);
+        if (deg[v] > st.maxDegree) { st.maxDegree = deg[v]; st.maxDegreeVertex = es.name(v); }
+        if (outDeg[v] == 0) st.isolatedOut++;
+        int b = 0;
+        while ((1 << b) <= deg[v]) ++b;
+        if ((int)st.histogram.size() <= b) st.histogram.resize(b + 1, 0);
+        st.histogram[b]++;
+    }
+    st.avgDegree = (double)sum / n;
+    return st;
+}
+
+// DSU с объединением по размеру — O(V) состояния
+struct StreamDSU {
+    vector<int> p, sz;
+    explicit StreamDSU(int n) : p(n), sz(n, 1) { for (int i = 0; i < n; ++i) p[i] = i; }
+    int find(int a) { while (p[a] != a) a = p[a] = p[p[a]]; return a; }
+    bool unite(int a, int b) {
+        a = find(a); b = find(b);
+        if (a == b) return false;
+        if (sz[a] < sz[b]) swap(a, b);
+        p[b] = a;
+        sz[a] += sz[b];
+        STAT_INC(STAT_DSU_UNIONS);
+        return true;
+    }
+};
+
+struct StreamComponents {
+    int count = 0;
+    int largest = 0;
+};
+
+// компоненты (для ориентированного — слабые) за один проход
+StreamComponents streamComponents(EdgeFileStream& es) {
+    int n = es.vertexCount();
+    StreamDSU dsu(n);
+    StreamComponents r;
+    r.count = n;
+    es.forEachEdge([&](int u, int v, int) { if (dsu.unite(u, v)) r.count--; });
+    for (int v = 0; v < n; ++v)
+        if (dsu.find(v) == v) r.largest = max(r.largest, dsu.sz[v]);
+    return r;
+}
+
+struct StreamMST {
+    long long totalWeight = 0;
+    long long edges = 0;
+    int runs = 0;                  // число отсортированных серий на диске
+    long long spilledBytes = 0;
+};
+
+// Полувнешний Краскал: рёбра сортируются сериями не больше memoryBytes и
+// сбрасываются в tmpDir, затем k-путевое слияние подаёт их в DSU по возрастанию
+// веса. В памяти — DSU на V вершин и по небольшому буферу на серию.
+// Дубликаты рёбер не схлопываются: из них в остов попадёт самое лёгкое.
+StreamMST streamMST(EdgeFileStream& es, size_t memoryBytes, const string& tmpDir, const string& outFile = "") {
+    if (es.isDirected()) throw runtime_error("Краскал применим только к неориентированным графам");
+    STAT_PHASE("stream_mst");
+
+    struct Rec { int w, u, v; long long seq; };
+    auto less = [](const Rec& a, const Rec& b) { return a.w != b.w ? a.w < b.w : a.seq < b.seq; };
+    size_t cap = max<size_t>(1024, memoryBytes / sizeof(Rec));
+
+    vector<string> runFiles;
+    vector<Rec> buffer;
+    buffer.reserve(min<size_t>(cap, (size_t)es.edgeCount() + 1));
+    StreamMST r;
+    auto spill = [&]() {
+        sort(buffer.begin(), buffer.end(), less);
+        string file = tmpDir + "/rg_run_" + to_string(getpid()) + "_" + to_string(runFiles.size()) + ".bin";
+        ofstream out(file, ios::binary);
+        if (!out.is_open()) throw runtime_error("Не удалось создать временный файл " + file);
+        out.write((const char*)buffer.data(), buffer.size() * sizeof(Rec));
+        r.spilledBytes += buffer.size() * sizeof(Rec);
+        runFiles.push_back(file);
+        buffer.clear();
+    };
+
+    long long seq = 0;
+    es.forEachEdge([&](int u, int v, int w) {
+        ++seq;
+        if (u == v) return;
+        buffer.push_back({w, u, v, seq});
+        if (buffer.size() >= cap) spill();
+    });
+
+    ofstream mstOut;
+    if (!outFile.empty()) {
+        mstOut.open(outFile);
+        if (!mstOut.is_open()) throw runtime_error("Не удалось открыть файл");
+    }
+    StreamDSU dsu(es.vertexCount());
+    auto take = [&](const Rec& e) {
+        if (!dsu.unite(e.u, e.v)) return;
+        r.totalWeight += e.w;
+        r.edges++;
+        if (mstOut.is_open()) mstOut << es.name(e.u) << " " << es.name(e.v) << " " << e.w << "\n";
+    };
+
+    if (runFiles.empty()) {
+        // всё поместилось в бюджет — сортируем в памяти
+        sort(buffer.begin(), buffer.end(), less);
+        for (const auto& e : buffer) take(e);
+        return r;
+    }
+    if (!buffer.empty()) spill();
+    vector<Rec>().swap(buffer);
+    r.runs = (int)runFiles.size();
+
+    // слияние серий: на каждую — буфер из memoryBytes / (2 * runs) байт
+    struct Run { ifstream in; vector<Rec> buf; size_t pos = 0, len = 0; };
+    size_t perRun = max<size_t>(64, memoryBytes / 2 / sizeof(Rec) / runFiles.size());
+    vector<Run> runs(runFiles.size());
+    auto refill = [&](Run& run) {
+        run.in.read((char*)run.buf.data(), run.buf.size() * sizeof(Rec));
+        run.len = (size_t)run.in.gcount() / sizeof(Rec);
+        run.pos = 0;
+        return run.len > 0;
+    };
+    auto heapCmp = [&](int a, int b) { return less(runs[b].buf[runs[b].pos], runs[a].buf[runs[a].pos]); };
+    priority_queue<int, vector<int>, decltype(heapCmp)> heap(heapCmp);
+    for (size_t i = 0; i < runs.size(); ++i) {
+        runs[i].in.open(runFiles[i], ios::binary);
+        runs[i].buf.resize(perRun);
+        if (refill(runs[i])) heap.push((int)i);
+    }
+    while (!heap.empty()) {
+        int i = heap.top();
+        heap.pop();
+        take(runs[i].buf[runs[i].pos]);
+        if (++runs[i].pos < runs[i].len || refill(runs[i])) heap.push(i);
+    }
+    for (auto& run : runs) run.in.close();
+    for (const auto& f : runFiles) remove(f.c_str());
+    return r;
+}
+
+struct StreamBFS {
+    vector<int> dist;              // -1 — не достигнута за k проходов
+    vector<long long> levelSizes;
+};
+
+// BFS по уровням: проход номер L по файлу продвигает фронт с уровня L на L+1,
+// поэтому k проходов дают все вершины на расстоянии не больше k
+StreamBFS streamBFS(EdgeFileStream& es, int source, int k) {
+    StreamBFS r;
+    r.dist.assign(es.vertexCount(), -1);
+    r.dist[source] = 0;
+    r.levelSizes.push_back(1);
+    for (int level = 0; level < k; ++level) {
+        long long added = 0;
+        es.forEachEdge([&](int u, int v, int) {
+            if (r.dist[u] == level && r.dist[v] == -1) { r.dist[v] = level + 1; ++added; }
+            if (!es.isDirected() && r.dist[v] == level && r.dist[u] == -1) { r.dist[u] = level + 1; ++added; }
+        });
+        if (added == 0) break;
+        r.levelSizes.push_back(added);
+        STAT_ADD(STAT_BFS_VISITED, added);
+    }
+    STAT_INC(STAT_BFS_RUNS);
+    return r;
+}
+
+int runStream(const vector<string>& args) {
+    unordered_map<string, string> opt = {
+        {"stream", ""}, {"directed", "0"}, {"mem", "256"}, {"tmp", "."},
+        {"source", ""}, {"k", "3"}, {"mst-out", ""}, {"algos", "degrees,components,mst,bfs"}
+    };
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i].rfind("--", 0) != 0) continue;
+        string key = args[i].substr(2);
+        if (i + 1 >= args.size()) throw runtime_error("Нет значения для --" + key);
+        if (!opt.count(key)) throw runtime_error("Неизвестный параметр --" + key);
+        opt[key] = args[++i];
+    }
+    if (opt["stream"].empty()) throw runtime_error("Укажите файл: --stream <файл>");
+    size_t memoryBytes = (size_t)stoull(opt["mem"]) << 20;
+    set<string> algos;
+    {
+        stringstream ss(opt["algos"]);
+        string a;
+        while (getline(ss, a, ',')) algos.insert(a);
+    }
+
+    auto ms = [](chrono::steady_clock::time_point t0) {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    };
+    auto t0 = chrono::steady_clock::now();
+    EdgeFileStream es(opt["stream"], opt["directed"] == "1");
+    ostringstream out;
+    out << "{\n  \"file\": \"" << jsonEscape(opt["stream"]) << "\",\n"
+        << "  \"vertices\": " << es.vertexCount() << ",\n  \"edges\": " << es.edgeCount() << ",\n"
+        << "  \"directed\": " << (es.isDirected() ? "true" : "false") << ",\n"
+        << "  \"memory_budget_mb\": " << (memoryBytes >> 20) << ",\n"
+        << "  \"dictionary_bytes\": " << es.stateBytes() << ",\n"
+        << "  \"dictionary_ms\": " << ms(t0);
+
+    if (algos.count("degrees")) {
+        t0 = chrono::steady_clock::now();
+        auto st = streamDegrees(es);
+        out << ",\n  \"degrees\": {\"min\": " << st.minDegree << ", \"max\": " << st.maxDegree
+            << ", \"max_vertex\": \"" << jsonEscape(st.maxDegreeVertex) << "\", \"avg\": " << st.avgDegree
+            << ", \"self_loops\": " << st.selfLoops;
+        if (es.isDirected()) out << ", \"no_out_edges\": " << st.isolatedOut;
+        out << ", \"log2_histogram\": [";
+        for (size_t b = 0; b < st.histogram.size(); ++b) out << (b ? ", " : "") << st.histogram[b];
+        out << "], \"ms\": " << ms(t0) << "}";
+    }
+    if (algos.count("components")) {
+        t0 = chrono::steady_clock::now();
+        auto cc = streamComponents(es);
+        out << ",\n  \"components\": {\"count\": " << cc.count << ", \"largest\": " << cc.largest
+            << ", \"ms\": " << ms(t0) << "}";
+    }
+    if (algos.count("mst") && !es.isDirected()) {
+        t0 = chrono::steady_clock::now();
+        auto mst = streamMST(es, memoryBytes, opt["tmp"], opt["mst-out"]);
+        out << ",\n  \"mst\": {\"total_weight\": " << mst.totalWeight << ", \"edges\": " << mst.edges
+            << ", \"runs\": " << mst.runs << ", \"spilled_bytes\": " << mst.spilledBytes
+            << ", \"ms\": " << ms(t0) << "}";
+    }
+    if (algos.count("bfs") && es.vertexCount() > 0) {
+        int s = opt["source"].empty() ? 0 : es.findVertex(opt["source"]);
+        if (s == -1) throw runtime_error("Вершина \"" + opt["source"] + "\" не найдена");
+        t0 = chrono::steady_clock::now();
+        int passesBefore = es.passCount();
+        auto bfs = streamBFS(es, s, stoi(opt["k"]));
+        long long reached = 0;
+        for (auto x : bfs.levelSizes) reached += x;
+        out << ",\n  \"bfs\": {\"source\": \"" << jsonEscape(es.name(s)) << "\", \"k\": " << opt["k"]
+            << ", \"reached\": " << reached << ", \"passes\": " << es.passCount() - passesBefore
+            << ", \"level_sizes\": [";
+        for (size_t l = 0; l < bfs.levelSizes.size(); ++l) out << (l ? ", " : "") << bfs.levelSizes[l];
+        out << "], \"ms\": " << ms(t0) << "}";
+    }
+    out << ",\n  \"passes\": " << es.passCount() << ",\n  \"peak_rss_kb\": " << peakRssKb() << "\n}\n";
+    cout << out.str();
+    return 0;
+}
+
+// ===== Пакетный режим (--batch) =====
+// Команды читаются из файла: либо строка "команда граф аргументы...",
+// либо JSON-объект {"id": "...", "cmd": "...", "graph": "...", "args": [...]}.
+// Подряд идущие запросы только на чтение выполняются параллельно,
+// изменения графов — барьеры. На каждую команду выводится одна строка JSON.
+
+struct BatchCommand {
+    string id;
+    string cmd;
+    string graph;
+    vector<string> args;
+};
+
+// разбор плоского JSON-объекта: строки, числа, true/false/null и массивы из них
+BatchCommand parseJsonCommand(const string& line) {
+    BatchCommand c;
+    size_t i = 0;
+    auto skipWs = [&]() { while (i < line.size() && isspace((unsigned char)line[i])) ++i; };
+    auto expect = [&](char ch) {
+        skipWs();
+        if (i >= line.size() || line[i] != ch)
+            throw runtime_error(string("JSON: ожидался символ '") + ch + "'");
+        ++i;
+    };
+    auto parseString = [&]() {
+        expect('"');
+        string r;
+        while (i < line.size() && line[i] != '"') {
+            if (line[i] == '\\' && i + 1 < line.size()) {
+                char e = line[++i];
+                r += e == 'n' ? '\n' : e == 't' ? '\t' : e;
+            } else r += line[i];
+            ++i;
+        }
+        if (i >= line.size()) throw runtime_error("JSON: незакрытая строка");
+        ++i;
+        return r;
+    };
+    auto parseScalar = [&]() {
+        skipWs();
+        if (i < line.size() && line[i] == '"') return parseString();
+        size_t start = i;
+        while (i < line.size() && line[i] != ',' && line[i] != ']' && line[i] != '}' && !isspace((unsigned char)line[i])) ++i;
+        if (start == i) throw runtime_error("JSON: ожидалось значение");
+        return line.substr(start, i - start);
+    };
+
+    expect('{');
+    skipWs();
+    while (i < line.size() && line[i] != '}') {
+        string key = parseString();
+        expect(':');
+        skipWs();
+        if (i < line.size() && line[i] == '[') {
+            ++i;
+            vector<string> arr;
+            skipWs();
+            while (i < line.size() && line[i] != ']') {
+                arr.push_back(parseScalar());
+                skipWs();
+                if (i < line.size() && line[i] == ',') ++i;
+                skipWs();
+            }
+            expect(']');
+            if (key == "args") c.args = arr;
+        } else {
+            string val = parseScalar();
+            if (key == "id") c.id = val;
+            else if (key == "cmd") c.cmd = val;
+            else if (key == "graph") c.graph = val;
+        }
+        skipWs();
+        if (i < line.size() && line[i] == ',') { ++i; skipWs(); }
+    }
+    expect('}');
+    return c;
+}
+
+BatchCommand parseScriptCommand(const string& line) {
+    BatchCommand c;
+    istringstream in(line);
+    in >> c.cmd >> c.graph;
+    string a;
+    while (in >> a) c.args.push_back(a);
+    return c;
+}
+
+bool isReadOnlyCommand(const string& cmd) {
+    static const set<string> mutations = {
+        "create", "load", "drop", "add_point", "add_edge", "remove_point", "remove_edge", "set_weight", "threads",
+        "reorder"
+    };
+    return !mutations.count(cmd);
+}
+
+// запросы, которые пишут файлы: выполняются по одному, как барьер между окнами чтения
+bool isSerialCommand(const string& cmd) {
+    return cmd == "save";
+}
+
+static string jsonString(const string& s) { return "\"" + jsonEscape(s) + "\""; }
+
+static string jsonNames(const Graph& g, const vector<int>& ids) {
+    string r = "[";
+    for (size_t i = 0; i < ids.size(); ++i) r += (i ? "," : "") + jsonString(g.adjList[ids[i]].adress);
+    return r + "]";
+}
+
+static string jsonDist(long long d) {
+    return d >= LLONG_MAX / 4 ? "null" : to_string(d);
+}
+
+static int requireVertex(const Graph& g, const string& name) {
+    int v = g.findVertex(name);
+    if (v == -1) throw runtime_error("Вершина \"" + name + "\" не найдена");
+    return v;
+}
+
+static const string& requireArg(const BatchCommand& c, size_t i) {
+    if (i >= c.args.size()) throw runtime_error("Недостаточно аргументов для " + c.cmd);
+    return c.args[i];
+}
+
+// запрос только на чтение; возвращает значение поля "result" (JSON)
+string executeQuery(const Graph& g, const BatchCommand& c) {
+    const long long INF = LLONG_MAX / 4;
+    int n = g.vertexCount();
+    ostringstream r;
+
+    if (c.cmd == "classify") r << jsonString(g.classify());
+    else if (c.cmd == "components") r << g.countComponents();
+    else if (c.cmd == "info") r << "{\"vertices\":" << n << ",\"edges\":" << g.edgeCount()
+                                << ",\"directed\":" << (g.isDirected() ? "true" : "false")
+                                << ",\"avg_edge_gap\":" << g.averageEdgeGap() << "}";
+    else if (c.cmd == "degrees") {
+        auto indeg = g.indegrees();
+        r << "{";
+        for (int v = 0; v < n; ++v) {
+            int out = (int)g.adjList[v].adj.size();
+            r << (v ? "," : "") << jsonString(g.adjList[v].adress) << ":";
+            if (g.isDirected()) r << "{\"in\":" << indeg[v] << ",\"out\":" << out << "}";
+            else {
+                int loops = 0;
+                for (const auto& e : g.adjList[v].adj) if (e.to == g.adjList[v].adress) ++loops;
+                r << out + loops;
+            }
+        }
+        r << "}";
+    }
+    else if (c.cmd == "common_target") {
+        int u = requireVertex(g, requireArg(c, 0)), v = requireVertex(g, requireArg(c, 1));
+        set<string> targets;
+        for (const auto& e : g.adjList[u].adj) targets.insert(e.to);
+        vector<int> common;
+        for (const auto& e : g.adjList[v].adj) if (targets.count(e.to)) common.push_back(g.findVertex(e.to));
+        r << jsonNames(g, common);
+    }
+    else if (c.cmd == "dijkstra" || c.cmd == "bellman_ford") {
+        int s = requireVertex(g, requireArg(c, 0));
+        vector<long long> dist;
+        vector<int> parent;
+        if (c.cmd == "dijkstra") dist = g.dijkstraDistances(s, &parent);
+        else if (!g.bellmanFordDistances(s, dist)) throw runtime_error("Граф содержит цикл отрицательного веса");
+        if (c.args.size() > 1 && c.cmd == "dijkstra") {
+            int t = requireVertex(g, c.args[1]);
+            vector<int> path;
+            if (dist[t] < INF) for (int v = t; v != -1; v = parent[v]) path.push_back(v);
+            reverse(path.begin(), path.end());
+            r << "{\"distance\":" << jsonDist(dist[t]) << ",\"path\":" << jsonNames(g, path) << "}";
+        } else {
+            r << "{";
+            for (int v = 0; v < n; ++v)
+                r << (v ? "," : "") << jsonString(g.adjList[v].adress) << ":" << jsonDist(dist[v]);
+            r << "}";
+        }
+    }
+    else if (c.cmd == "bfs") {
+        // bfs откуда [куда]: уровни или путь с наименьшим числом рёбер
+        int s = requireVertex(g, requireArg(c, 0));
+        auto b = g.bfs(s);
+        if (c.args.size() > 1) {
+            int t = requireVertex(g, c.args[1]);
+            vector<int> path;
+            if (b.dist[t] != -1) for (int v = t; v != -1; v = b.parent[v]) path.push_back(v);
+            reverse(path.begin(), path.end());
+            r << "{\"hops\":" << (b.dist[t] == -1 ? string("null") : to_string(b.dist[t]))
+              << ",\"path\":" << jsonNames(g, path) << "}";
+        } else {
+            r << "{\"reached\":" << b.reached << ",\"level_sizes\":[";
+            for (size_t l = 0; l < b.levelSizes.size(); ++l) r << (l ? "," : "") << b.levelSizes[l];
+            r << "],\"top_down_steps\":" << b.topDownSteps << ",\"bottom_up_steps\":" << b.bottomUpSteps << "}";
+        }
+    }
+    else if (c.cmd == "periphery") {
+        int s = requireVertex(g, requireArg(c, 0));
+        long long N = stoll(requireArg(c, 1));
+        vector<int> periphery;
+        if (!nPeripheryFrom(g, s, N, periphery))
+            throw runtime_error("Из вершины достижим цикл отрицательного веса");
+        r << jsonNames(g, periphery);
+    }
+    else if (c.cmd == "metrics") {
+        AllPairsDistances apsp(g);
+        if (apsp.negativeCycle) throw runtime_error("Граф содержит цикл отрицательного веса");
+        r << "{\"strategy\":" << jsonString(apspStrategyName(apsp.used))
+          << ",\"radius\":" << jsonDist(apsp.radius()) << ",\"diameter\":" << jsonDist(apsp.diameter())
+          << ",\"center\":" << jsonNames(g, apsp.center()) << ",\"periphery\":" << jsonNames(g, apsp.periphery()) << "}";
+    }
+    else if (c.cmd == "approx_diameter") {
+        ApproxBudget budget;
+        if (!c.args.empty()) budget.timeMs = stod(c.args[0]);
+        if (c.args.size() > 1) budget.maxBfs = stoi(c.args[1]);
+        auto d = approxDiameter(g, budget);
+        r << "{\"lower\":" << jsonDist(d.lower) << ",\"upper\":" << jsonDist(d.upper)
+          << ",\"bfs_runs\":" << d.bfsRuns << "}";
+    }
+    else if (c.cmd == "within_k") {
+        auto names = g.verticesWithinK(stoi(requireArg(c, 0)));
+        r << "[";
+        for (size_t i = 0; i < names.size(); ++i) r << (i ? "," : "") << jsonString(names[i]);
+        r << "]";
+    }
+    else if (c.cmd == "kruskal") {
+        if (g.isDirected()) throw runtime_error("Краскал применим только к неориентированным графам");
+        auto edges = g.kruskalEdges();
+        long long total = 0;
+        r << "{\"edges\":[";
+        for (size_t i = 0; i < edges.size(); ++i) {
+            total += edges[i].w;
+            r << (i ? "," : "") << "[" << jsonString(g.adjList[edges[i].u].adress) << ","
+              << jsonString(g.adjList[edges[i].v].adress) << "," << edges[i].w << "]";
+        }
+        r << "],\"total_weight\":" << total << "}";
+    }
+    else if (c.cmd == "max_flow") {
+        int s = requireVertex(g, requireArg(c, 0)), t = requireVertex(g, requireArg(c, 1));
+        r << g.maxFlow(s, t);
+    }
+    else if (c.cmd == "min_cost_flow") {
+        // min_cost_flow источники стоки [ssp|scaling] [файл_стоимостей]
+        auto sources = parseFlowTerminals(g, requireArg(c, 0));
+        auto sinks = parseFlowTerminals(g, requireArg(c, 1));
+        string method = c.args.size() > 2 ? c.args[2] : "ssp";
+        if (method != "ssp" && method != "scaling") throw runtime_error("Неизвестный метод: " + method);
+        FlowCosts costs = c.args.size() > 3 ? FlowCosts::fromFile(c.args[3]) : FlowCosts();
+        auto res = MinCostFlow(g, costs).solve(sources, sinks, method == "ssp"
+            ? MinCostFlow::Method::SuccessiveShortestPaths : MinCostFlow::Method::CostScaling);
+        r << "{\"flow\":" << res.flow << ",\"cost\":" << res.cost << ",\"edges\":[";
+        bool first = true;
+        for (const auto& a : res.arcs) {
+            if (a.flow == 0) continue;
+            r << (first ? "" : ",") << "[" << jsonString(g.adjList[a.from].adress) << ","
+              << jsonString(g.adjList[a.to].adress) << "," << a.flow << "]";
+            first = false;
+        }
+        r << "]}";
+    }
+    else if (c.cmd == "triangles") {
+        auto t = countTriangles(g);
+        r << "{\"total\":" << t.total << ",\"global_clustering\":" << t.globalClustering
+          << ",\"average_clustering\":" << t.averageClustering << ",\"vertices\":{";
+        for (int v = 0; v < n; ++v)
+            r << (v ? "," : "") << jsonString(g.adjList[v].adress) << ":{\"triangles\":" << t.triangles[v]
+              << ",\"clustering\":" << t.clustering[v] << "}";
+        r << "}}";
+    }
+    else if (c.cmd == "kcore") {
+        // kcore [k]: ядерные числа всех вершин или вершины k-ядра
+        auto d = coreDecomposition(g);
+        if (!c.args.empty()) r << jsonNames(g, d.kCore(stoi(c.args[0])));
+        else {
+            r << "{\"degeneracy\":" << d.degeneracy << ",\"core\":{";
+            for (int v = 0; v < n; ++v) r << (v ? "," : "") << jsonString(g.adjList[v].adress) << ":" << d.core[v];
+            r << "}}";
+        }
+    }
+    else if (c.cmd == "pagerank") {
+        // pagerank [вершины телепортации через запятую] — персонализированный, если заданы
+        PageRankOptions po;
+        if (!c.args.empty()) {
+            stringstream ss(c.args[0]);
+            string name;
+            while (getline(ss, name, ',')) po.personalization.push_back(requireVertex(g, name));
+        }
+        auto pr = pageRank(g, po);
+        r << "{\"iterations\":" << pr.iterations << ",\"converged\":" << (pr.converged ? "true" : "false")
+          << ",\"rank\":{";
+        for (int v = 0; v < n; ++v) r << (v ? "," : "") << jsonString(g.adjList[v].adress) << ":" << pr.rank[v];
+        r << "}}";
+    }
+    else if (c.cmd == "betweenness") {
+        // betweenness [число источников] — 0 или больше n: точно
+        auto b = betweenness(g, c.args.empty() ? 0 : stoi(c.args[0]));
+        r << "{\"sources\":" << b.sources << ",\"exact\":" << (b.exact ? "true" : "false") << ",\"score\":{";
+        for (int v = 0; v < n; ++v) r << (v ? "," : "") << jsonString(g.adjList[v].adress) << ":" << b.score[v];
+        r << "}}";
+    }
+    else if (c.cmd == "save") {
+        // пакеты разных клиентов сервера выполняются параллельно — запись файлов по одной
+        static mutex saveLock;
+        lock_guard<mutex> lock(saveLock);
+        g.saveToFile(requireArg(c, 0));
+        r << "true";
+    }
+    else throw runtime_error("Неизвестная команда: " + c.cmd);
+    return r.str();
+}
+
+// изменение существующего графа; сообщения addPoint/addEdge подавлены,
+// поэтому отсутствующие вершины проверяются здесь и возвращаются как ошибка
+string applyMutation(Graph& g, const BatchCommand& c) {
+    if (c.cmd == "add_point") {
+        if (g.findVertex(requireArg(c, 0)) != -1) throw runtime_error("Вершина \"" + c.args[0] + "\" уже существует");
+        g.addPoint(c.args[0]);
+    }
+    else if (c.cmd == "add_edge") {
+        requireVertex(g, requireArg(c, 0));
+        requireVertex(g, requireArg(c, 1));
+        g.addEdge(c.args[0], c.args[1], c.args.size() > 2 ? stoi(c.args[2]) : 1);
+    }
+    else if (c.cmd == "remove_point") {
+        requireVertex(g, requireArg(c, 0));
+        g.removePoint(c.args[0]);
+    }
+    else if (c.cmd == "remove_edge") {
+        requireVertex(g, requireArg(c, 0));
+        requireVertex(g, requireArg(c, 1));
+        g.removeEdge(c.args[0], c.args[1]);
+    }
+    else if (c.cmd == "set_weight") {
+        int i = requireVertex(g, requireArg(c, 0));
+        requireVertex(g, requireArg(c, 1));
+        const auto& adj = g.adjList[i].adj;
+        if (none_of(adj.begin(), adj.end(), [&](const Edge& e) { return e.to == c.args[1]; }))
+            throw runtime_error("Ребро \"" + c.args[0] + " -> " + c.args[1] + "\" не существует");
+        g.setEdgeWeight(c.args[0], c.args[1], stoi(requireArg(c, 2)));
+    }
+    else if (c.cmd == "threads") g.setThreads(stoi(requireArg(c, 0)));
+    else if (c.cmd == "reorder") {
+        auto r = g.reorder(parseVertexOrder(requireArg(c, 0)));
+        ostringstream out;
+        out << "{\"avg_edge_gap_before\":" << r.gapBefore << ",\"avg_edge_gap_after\":" << r.gapAfter
+            << ",\"bandwidth_before\":" << r.bandwidthBefore << ",\"bandwidth_after\":" << r.bandwidthAfter << "}";
+        return out.str();
+    }
+    else throw runtime_error("Неизвестная команда: " + c.cmd);
+    return "{\"vertices\":" + to_string(g.vertexCount()) + ",\"edges\":" + to_string(g.edgeCount()) + "}";
+}
+
+// создать граф командой create/load
+unique_ptr<Graph> createGraph(const BatchCommand& c) {
+    unique_ptr<Graph> g;
+    if (c.cmd == "create") {
+        g.reset(new Graph(c.args.size() > 0 && c.args[0] == "1"));
+        g->setVerbose(false);
+    } else {
+        VertexOrder order = c.args.size() > 2 ? parseVertexOrder(c.args[2]) : VertexOrder::Original;
+        g.reset(new Graph(requireArg(c, 0), c.args.size() > 1 && c.args[1] == "1", false, order));
+    }
+    return g;
+}
+
+// Каталог резидентных графов (RCU). Читатель берёт неизменяемый снимок
+// shared_ptr<const Graph> и работает с ним без блокировок; изменение
+// применяется к копии, которая публикуется с новой эпохой. Старый снимок
+// освобождается, когда его отпустит последний запрос.
+class GraphCatalog {
+public:
+    // exclusive: каталог принадлежит одному потоку-писателю и читатели не работают
+    // одновременно с update (пакетный режим) — тогда мутации применяются на месте
+    explicit GraphCatalog(bool exclusive = false) : exclusive(exclusive) {}
+
+    shared_ptr<const Graph> snapshot(const string& name) const {
+        lock_guard<mutex> lock(m);
+        auto it = graphs.find(name);
+        return it == graphs.end() ? nullptr : it->second;
+    }
+
+    // publish и drop сериализованы с update (мьютекс writers): иначе update, взявший
+    // снимок до них, опубликовал бы устаревшую копию поверх нового графа или вернул удалённый
+    uint64_t publish(const string& name, shared_ptr<const Graph> g) {
+        lock_guard<mutex> writeLock(writers);
+        return publishLocked(name, move(g));
+    }
+
+    bool drop(const string& name) {
+        lock_guard<mutex> writeLock(writers);
+        lock_guard<mutex> lock(m);
+        if (!graphs.erase(name)) return false;
+        ++epochCounter;
+        return true;
+    }
+
+    uint64_t epoch() const { return epochCounter.load(); }
+
+    // apply(Graph&) получает частную копию; писатели сериализованы между собой,
+    // но не блокируют читателей на время копирования и изменения.
+    // В исключительном режиме граф, на который нет других ссылок, меняется без копии
+    template <class F>
+    uint64_t update(const string& name, F apply) {
+        lock_guard<mutex> writeLock(writers);
+        auto current = snapshot(name);
+        if (!current) throw runtime_error("Граф \"" + name + "\" не найден");
+        if (exclusive && current.use_count() == 2) {   // таблица + current
+            Graph& g = const_cast<Graph&>(*current);
+            g.setVerbose(false);
+            apply(g);
+            lock_guard<mutex> lock(m);
+            return ++epochCounter;
+        }
+        shared_ptr<Graph> next = make_shared<Graph>(*current);
+        next->setVerbose(false);
+        apply(*next);
+        return publishLocked(name, next);
+    }
+
+private:
+    mutable mutex m;     // защищает только таблицу указателей
+    mutex writers;
+    const bool exclusive;
+    unordered_map<string, shared_ptr<const Graph>> graphs;
+    atomic<uint64_t> epochCounter{0};
+
+    uint64_t publishLocked(const string& name, shared_ptr<const Graph> g) {
+        lock_guard<mutex> lock(m);
+        graphs[name] = move(g);
+        return ++epochCounter;
+    }
+};
+
+// гистограмма задержек с логарифмическими корзинами: корзина b — [2^(b-1), 2^b) мкс
+class LatencyHistogram {
+public:
+    static const int BUCKETS = 40;
+
+    void record(double us) {
+        int b = 0;
+        while (b + 1 < BUCKETS && (double)(1ULL << b) <= us) ++b;
+        buckets[b].fetch_add(1, memory_order_relaxed);
+        count.fetch_add(1, memory_order_relaxed);
+        totalNs.fetch_add((uint64_t)(us * 1000), memory_order_relaxed);
     }
 
-    // вывод расстояний
-    cout << "\nКратчайшие расстояния от вершины " << startName << ":\n";
-    for (int i = 0; i < n; ++i) {
-        cout << adjList[i].adress << " : ";
-        if (dist[i] == INF) cout << "недостижима\n";
-        else cout << dist[i] << "\n";
+    // верхняя граница корзины, в которую попадает квантиль q
+    double quantile(double q) const {
+        uint64_t n = count.load(), acc = 0;
+        if (n == 0) return 0;
+        uint64_t need = max<uint64_t>(1, (uint64_t)ceil(q * n));
+        for (int b = 0; b < BUCKETS; ++b) {
+            acc += buckets[b].load();
+            if (acc >= need) return (double)(1ULL << b);
+        }
+        return (double)(1ULL << (BUCKETS - 1));
     }
 
-    // если тебе нужно проверить условие "все расстояния <= N",
-    // можно спросить N и проверить:
-    char ask;
-    cout << "\nПроверить, что все расстояния ≤ N? (y/n): ";
-    cin >> ask;
-    if (ask == 'y' || ask == 'Y') {
-        int N;
-        cout << "Введите N: ";
-        cin >> N;
-        bool ok = true;
-        for (int i = 0; i < n; ++i) {
-            if (i == s) continue;
-            if (dist[i] == INF || dist[i] > N) { ok = false; break; }
+    string json() const {
+        uint64_t n = count.load();
+        ostringstream out;
+        out << "{\"count\":" << n << ",\"mean_us\":" << (n ? totalNs.load() / 1000.0 / n : 0.0)
+            << ",\"p50_us\":" << quantile(0.5) << ",\"p90_us\":" << quantile(0.9)
+            << ",\"p99_us\":" << quantile(0.99) << ",\"buckets\":{";
+        bool first = true;
+        for (int b = 0; b < BUCKETS; ++b) {
+            uint64_t c = buckets[b].load();
+            if (!c) continue;
+            out << (first ? "" : ",") << "\"" << (1ULL << b) << "\":" << c;
+            first = false;
         }
-        if (ok) cout << "Все расстояния от " << startName << " до остальных ≤ " << N << "\n";
-        else cout << "Не все расстояния ≤ " << N << "\n";
+        out << "}}";
+        return out.str();
     }
-}
 
-void Graph::bellmanFord(const string& start) {
-    int n = vertexCount();
-    int startIndex = findVertex(start);
+private:
+    atomic<uint64_t> buckets[BUCKETS] = {};
+    atomic<uint64_t> count{0};
+    atomic<uint64_t> totalNs{0};
+};
 
-    if (startIndex == -1) {
-        cout << "Вершина " << start << " не найдена.\n";
-        return;
+// гистограммы по командам (эндпоинтам)
+class EndpointLatencies {
+public:
+    LatencyHistogram& of(const string& cmd) {
+        lock_guard<mutex> lock(m);
+        auto& h = perCommand[cmd];
+        if (!h) h.reset(new LatencyHistogram());
+        return *h;
     }
 
-    const long long INF = LLONG_MAX / 4;
-    vector<long long> dist(n, INF);
-    dist[startIndex] = 0;
+    string json() {
+        lock_guard<mutex> lock(m);
+        string r = "{";
+        bool first = true;
+        for (const auto& kv : perCommand) {
+            r += (first ? "" : ",") + jsonString(kv.first) + ":" + kv.second->json();
+            first = false;
+        }
+        return r + "}";
+    }
 
-    // Алгоритм Беллмана–Форда
-    for (int i = 0; i < n - 1; ++i) {
-        bool updated = false;
-        for (int u = 0; u < n; ++u) {
-            if (dist[u] == INF) continue;
-            for (const auto& e : adjList[u].adj) {
-                int v = findVertex(e.to);
-                if (v == -1) continue;
-                long long w = e.weight;
-                if (dist[u] + w < dist[v]) {
-                    dist[v] = dist[u] + w;
-                    updated = true;
-                }
+private:
+    mutex m;
+    map<string, unique_ptr<LatencyHistogram>> perCommand;
+};
+
+static string batchResultLine(const BatchCommand& c, bool ok, const string& payload, double us) {
+    string line = "{\"id\":" + jsonString(c.id) + ",\"cmd\":" + jsonString(c.cmd)
+                + ",\"graph\":" + jsonString(c.graph) + ",\"ok\":" + (ok ? "true" : "false");
+    line += ok ? ",\"result\":" + payload : ",\"error\":" + jsonString(payload);
+    ostringstream lat;
+    lat << us;
+    return line + ",\"latency_us\":" + lat.str() + "}\n";
+}
+
+// Выполнить список команд над каталогом, results[i] — строка ответа на cmds[i].
+// Подряд идущие запросы на чтение выполняются параллельно над снимками;
+// подряд идущие изменения одного графа применяются к одной копии
+// и публикуются одной эпохой.
+void executeCommands(GraphCatalog& catalog, const vector<BatchCommand>& cmds, int jobs,
+                     vector<string>& results, EndpointLatencies* latencies = nullptr) {
+    results.assign(cmds.size(), string());
+    auto finish = [&](size_t i, bool ok, const string& payload, chrono::steady_clock::time_point t0) {
+        double us = chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count();
+        if (latencies) latencies->of(cmds[i].cmd).record(us);
+        results[i] = batchResultLine(cmds[i], ok, payload, us);
+    };
+
+    auto runQuery = [&](size_t i) {
+        const auto& c = cmds[i];
+        auto t0 = chrono::steady_clock::now();
+        try {
+            if (c.cmd == "parse_error") throw runtime_error(c.args[0]);
+            if (c.cmd == "epoch") return finish(i, true, to_string(catalog.epoch()), t0);
+            if (c.cmd == "latency") {
+                if (!latencies) throw runtime_error("Гистограммы задержек доступны только в режиме сервера");
+                return finish(i, true, latencies->json(), t0);
             }
+            auto g = catalog.snapshot(c.graph);
+            if (!g) throw runtime_error("Граф \"" + c.graph + "\" не найден");
+            finish(i, true, executeQuery(*g, c), t0);
+        } catch (const exception& e) {
+            finish(i, false, e.what(), t0);
         }
-        if (!updated) break; // оптимизация
-    }
+    };
 
-    // Проверка на отрицательные циклы (опционально)
-    for (int u = 0; u < n; ++u) {
-        if (dist[u] == INF) continue;
-        for (const auto& e : adjList[u].adj) {
-            int v = findVertex(e.to);
-            if (v == -1) continue;
-            if (dist[u] + e.weight < dist[v]) {
-                cout << "Граф содержит цикл отрицательного веса!\n";
-                return;
+    size_t i = 0;
+    while (i < cmds.size()) {
+        const auto& c = cmds[i];
+        size_t j = i + 1;
+        if (isSerialCommand(c.cmd)) runQuery(i);
+        else if (isReadOnlyCommand(c.cmd)) {
+            while (j < cmds.size() && isReadOnlyCommand(cmds[j].cmd) && !isSerialCommand(cmds[j].cmd)) ++j;
+            parallelFor(jobs, (int)i, (int)j, [&](int k) { runQuery(k); }, 1);
+        } else if (c.cmd == "create" || c.cmd == "load" || c.cmd == "drop") {
+            auto t0 = chrono::steady_clock::now();
+            try {
+                if (c.cmd == "drop") {
+                    if (!catalog.drop(c.graph)) throw runtime_error("Граф \"" + c.graph + "\" не найден");
+                    finish(i, true, "{\"epoch\":" + to_string(catalog.epoch()) + "}", t0);
+                } else {
+                    shared_ptr<const Graph> g(createGraph(c).release());
+                    int n = g->vertexCount();
+                    uint64_t epoch = catalog.publish(c.graph, g);
+                    finish(i, true, "{\"vertices\":" + to_string(n) + ",\"epoch\":" + to_string(epoch) + "}", t0);
+                }
+            } catch (const exception& e) {
+                finish(i, false, e.what(), t0);
             }
+        } else {
+            while (j < cmds.size() && cmds[j].graph == c.graph && !isReadOnlyCommand(cmds[j].cmd)
+                   && cmds[j].cmd != "create" && cmds[j].cmd != "load" && cmds[j].cmd != "drop") ++j;
+            vector<bool> ok(j - i, true);
+            vector<string> payload(j - i);
+            vector<chrono::steady_clock::time_point> start(j - i, chrono::steady_clock::now());
+            try {
+                uint64_t epoch = catalog.update(c.graph, [&](Graph& g) {
+                    for (size_t k = i; k < j; ++k) {
+                        if (k > i) start[k - i] = chrono::steady_clock::now();
+                        try {
+                            payload[k - i] = applyMutation(g, cmds[k]);
+                        } catch (const exception& e) {
+                            ok[k - i] = false;
+                            payload[k - i] = e.what();
+                        }
+                    }
+                });
+                for (size_t k = i; k < j; ++k)
+                    if (ok[k - i]) payload[k - i].insert(payload[k - i].size() - 1, ",\"epoch\":" + to_string(epoch));
+            } catch (const exception& e) {
+                fill(ok.begin(), ok.end(), false);
+                fill(payload.begin(), payload.end(), string(e.what()));
+            }
+            for (size_t k = i; k < j; ++k) finish(k, ok[k - i], payload[k - i], start[k - i]);
         }
+        i = j;
     }
+}
 
-    // Вывод результатов
-    cout << "Кратчайшие расстояния от вершины " << start << ":\n";
-    for (int i = 0; i < n; ++i) {
-        cout << adjList[i].adress << " : ";
-        if (dist[i] == INF)
-            cout << "недостижима\n";
-        else
-            cout << dist[i] << "\n";
+// строка скрипта или JSON-объект; пустые строки и комментарии дают false
+bool parseCommandLine(const string& line, BatchCommand& c) {
+    size_t p = line.find_first_not_of(" \t\r");
+    if (p == string::npos || line[p] == '#') return false;
+    try {
+        c = line[p] == '{' ? parseJsonCommand(line.substr(p)) : parseScriptCommand(line.substr(p));
+    } catch (const exception& e) {
+        c = BatchCommand();
+        c.cmd = "parse_error";
+        c.args = {e.what()};
     }
+    return true;
 }
 
-void Graph::floydPeriphery(const string& start, int N) const {
-    int n = adjList.size();
-    if (n == 0) {
-        cout << "Граф пуст.\n";
-        return;
+int runBatch(const vector<string>& args) {
+    string input, outFile;
+    int jobs = 0;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "--batch" && i + 1 < args.size()) input = args[++i];
+        else if (args[i] == "--jobs" && i + 1 < args.size()) jobs = stoi(args[++i]);
+        else if (args[i] == "--out" && i + 1 < args.size()) outFile = args[++i];
     }
+    if (input.empty()) throw runtime_error("Укажите файл: --batch <файл>");
 
-    // Сопоставляем вершины индексам
-    unordered_map<string, int> idx;
-    for (int i = 0; i < n; ++i)
-        idx[adjList[i].adress] = i;
+    ifstream fin(input);
+    if (!fin.is_open()) throw runtime_error("Не удалось открыть файл");
 
-    if (!idx.count(start)) {
-        cout << "Вершина " << start << " не найдена в графе.\n";
-        return;
+    vector<BatchCommand> cmds;
+    string line;
+    int lineNo = 0;
+    while (getline(fin, line)) {
+        ++lineNo;
+        BatchCommand c;
+        if (!parseCommandLine(line, c)) continue;
+        if (c.id.empty()) c.id = to_string(lineNo);
+        cmds.push_back(c);
     }
 
-    // Инициализация матрицы расстояний
-    vector<vector<int>> dist(n, vector<int>(n, INT_MAX / 2));
-
-    for (int i = 0; i < n; ++i)
-        dist[i][i] = 0;
-
-    for (int i = 0; i < n; ++i)
-        for (const auto& e : adjList[i].adj)
-            dist[i][idx[e.to]] = min(dist[i][idx[e.to]], e.weight);
-
-    // Алгоритм Флойда–Уоршелла
-    for (int k = 0; k < n; ++k)
-        for (int i = 0; i < n; ++i)
-            for (int j = 0; j < n; ++j)
-                if (dist[i][j] > dist[i][k] + dist[k][j])
-                    dist[i][j] = dist[i][k] + dist[k][j];
-
-    // Определяем N-периферию
-    int s = idx[start];
-    vector<string> periphery;
-    for (int i = 0; i < n; ++i)
-        if (dist[s][i] > N && dist[s][i] < INT_MAX / 2)
-            periphery.push_back(adjList[i].adress);
-
-    // Вывод результата
-    cout << "N-периферия вершины " << start << " (N = " << N << "): ";
-    if (periphery.empty())
-        cout << "пусто\n";
-    else {
-        for (const auto& v : periphery)
-            cout << v << " ";
-        cout << "\n";
+    ios::sync_with_stdio(false);
+    ofstream fout;
+    if (!outFile.empty()) {
+        fout.open(outFile);
+        if (!fout.is_open()) throw runtime_error("Не удалось открыть файл");
     }
+    ostream& out = outFile.empty() ? cout : fout;
+
+    GraphCatalog catalog(true);   // читатели и писатели пакета не пересекаются во времени
+    vector<string> results;
+    executeCommands(catalog, cmds, jobs, results);
+    string buffer;
+    for (auto& r : results) {
+        buffer += r;
+        if (buffer.size() > (1 << 20)) { out << buffer; buffer.clear(); }
+    }
+    out << buffer;
+    return 0;
 }
 
-int Graph::edmondsKarp(const string& sourceName, const string& sinkName) const {
-    int n = vertexCount();
-    int s = findVertex(sourceName);
-    int t = findVertex(sinkName);
-    if (s == -1 || t == -1) {
-        cout << "Ошибка: источник или сток не найдены.\n";
-        return 0;
+// ===== Режим сервера (--serve) =====
+// Графы держатся в памяти в GraphCatalog. Протокол построчный, как в --batch:
+// на каждую строку запроса — строка JSON-ответа. Всё, что клиент успел прислать,
+// выполняется одним пакетом (запросы на чтение — параллельно). Служебные команды:
+// epoch, latency (гистограммы по командам), shutdown.
+
+static atomic<bool> serverStopping{false};
+static mutex serverFdsMutex;
+static set<int> serverOpenFds;    // живые соединения: при остановке будим их, ждущих в recv()
+static condition_variable serverConnectionsDone;
+
+static bool writeAll(int fd, const string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t k = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (k <= 0) return false;
+        sent += (size_t)k;
     }
+    return true;
+}
 
-    // Матрица пропускных способностей
-    vector<vector<int>> capacity(n, vector<int>(n, 0));
-    for (int i = 0; i < n; ++i) {
-        for (const auto& e : adjList[i].adj) {
-            int j = findVertex(e.to);
-            if (j != -1)
-                capacity[i][j] += e.weight; // если несколько рёбер — суммируем
+// предел длины одной строки запроса: клиент, так и не приславший '\n',
+// получает ошибку и отключается, а не копит буфер без ограничения
+static const size_t SERVER_MAX_LINE = 1 << 22;
+
+static void serveConnection(int fd, GraphCatalog& catalog, EndpointLatencies& latencies, int jobs, int listenFd) {
+    string pending;
+    char buf[1 << 16];
+    uint64_t seq = 0;
+    while (!serverStopping.load()) {
+        ssize_t k = ::recv(fd, buf, sizeof(buf), 0);
+        if (k <= 0) break;
+        pending.append(buf, (size_t)k);
+
+        // добираем всё, что уже пришло, чтобы выполнить одним пакетом
+        pollfd pfd{fd, POLLIN, 0};
+        while (pending.size() < SERVER_MAX_LINE && ::poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN)) {
+            k = ::recv(fd, buf, sizeof(buf), 0);
+            if (k <= 0) break;
+            pending.append(buf, (size_t)k);
         }
-    }
-
-    vector<vector<int>> flow(n, vector<int>(n, 0));
-    int maxFlow = 0;
-
-    while (true) {
-        // BFS для поиска пути с остаточной ёмкостью
-        vector<int> parent(n, -1);
-        queue<int> q;
-        q.push(s);
-        parent[s] = s;
 
-        while (!q.empty() && parent[t] == -1) {
-            int u = q.front();
-            q.pop();
-            for (int v = 0; v < n; ++v) {
-                if (parent[v] == -1 && capacity[u][v] - flow[u][v] > 0) {
-                    parent[v] = u;
-                    q.push(v);
-                }
+        vector<BatchCommand> cmds;
+        bool shutdownRequested = false;
+        size_t start = 0, nl;
+        while ((nl = pending.find('\n', start)) != string::npos) {
+            BatchCommand c;
+            ++seq;
+            if (parseCommandLine(pending.substr(start, nl - start), c)) {
+                if (c.id.empty()) c.id = to_string(seq);
+                if (c.cmd == "shutdown") shutdownRequested = true;
+                else cmds.push_back(c);
             }
+            start = nl + 1;
         }
-
-        // если пути нет — всё, закончили
-        if (parent[t] == -1)
+        pending.erase(0, start);
+        bool overlong = pending.size() > SERVER_MAX_LINE;
+
+        vector<string> results;
+        executeCommands(catalog, cmds, jobs, results, &latencies);
+        string out;
+        for (auto& r : results) out += r;
+        if (overlong) {
+            BatchCommand c;
+            c.id = to_string(++seq);
+            c.cmd = "parse_error";
+            out += batchResultLine(c, false, "Строка запроса длиннее " + to_string(SERVER_MAX_LINE)
+                                   + " байт, соединение закрыто", 0);
+            writeAll(fd, out);
             break;
-
-        // находим минимальную пропускную способность по пути
-        int increment = INT_MAX;
-        for (int v = t; v != s; v = parent[v]) {
-            int u = parent[v];
-            increment = min(increment, capacity[u][v] - flow[u][v]);
         }
-
-        // обновляем потоки вдоль пути
-        for (int v = t; v != s; v = parent[v]) {
-            int u = parent[v];
-            flow[u][v] += increment;
-            flow[v][u] -= increment; // обратное ребро
+        if (shutdownRequested) out += "{\"cmd\":\"shutdown\",\"ok\":true}\n";
+        if (!writeAll(fd, out)) break;
+        if (shutdownRequested) {
+            serverStopping = true;
+            ::shutdown(listenFd, SHUT_RDWR);
+            break;
         }
-
-        maxFlow += increment;
     }
+    // закрываем под мьютексом: иначе accept() может выдать тот же номер новому
+    // соединению раньше, чем мы удалим старый из serverOpenFds
+    lock_guard<mutex> lock(serverFdsMutex);
+    serverOpenFds.erase(fd);
+    ::close(fd);
+    serverConnectionsDone.notify_all();
+}
 
-    cout << "Максимальный поток из " << sourceName << " в " << sinkName << " = " << maxFlow << "\n";
-    return maxFlow;
+int runServer(const vector<string>& args) {
+    string socketPath;
+    int port = -1, jobs = 0;
+    vector<BatchCommand> preload;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "--socket" && i + 1 < args.size()) socketPath = args[++i];
+        else if (args[i] == "--port" && i + 1 < args.size()) port = stoi(args[++i]);
+        else if (args[i] == "--jobs" && i + 1 < args.size()) jobs = stoi(args[++i]);
+        else if (args[i] == "--load" && i + 1 < args.size()) {
+            // --load имя=файл[:d] — d означает ориентированный граф
+            string spec = args[++i];
+            size_t eq = spec.find('=');
+            if (eq == string::npos) throw runtime_error("Ожидалось --load имя=файл");
+            BatchCommand c;
+            c.cmd = "load";
+            c.graph = spec.substr(0, eq);
+            string file = spec.substr(eq + 1);
+            bool dir = file.size() > 2 && file.compare(file.size() - 2, 2, ":d") == 0;
+            if (dir) file.resize(file.size() - 2);
+            c.args = {file, dir ? "1" : "0"};
+            preload.push_back(c);
+        }
+    }
+    if (socketPath.empty() && port < 0) throw runtime_error("Укажите --socket <путь> или --port <порт>");
+
+    GraphCatalog catalog;
+    EndpointLatencies latencies;
+    vector<string> results;
+    executeCommands(catalog, preload, jobs, results);
+    for (auto& r : results) cerr << r;
+
+    int listenFd;
+    if (!socketPath.empty()) {
+        listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(addr.sun_path)) throw runtime_error("Слишком длинный путь сокета");
+        strcpy(addr.sun_path, socketPath.c_str());
+        ::unlink(socketPath.c_str());
+        if (listenFd < 0 || ::bind(listenFd, (sockaddr*)&addr, sizeof(addr)) < 0)
+            throw runtime_error("Не удалось открыть сокет " + socketPath);
+    } else {
+        listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        ::setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (listenFd < 0 || ::bind(listenFd, (sockaddr*)&addr, sizeof(addr)) < 0)
+            throw runtime_error("Не удалось открыть порт " + to_string(port));
+    }
+    if (::listen(listenFd, 128) < 0) throw runtime_error("Ошибка listen()");
+    cerr << "Сервер запущен: " << (socketPath.empty() ? "127.0.0.1:" + to_string(port) : socketPath) << "\n";
+
+    // потоки соединений отсоединены, чтобы не копить завершившиеся; при остановке
+    // ждём, пока serverOpenFds опустеет
+    while (!serverStopping.load()) {
+        int fd = ::accept(listenFd, nullptr, nullptr);
+        if (fd < 0) break;
+        {
+            lock_guard<mutex> lock(serverFdsMutex);
+            serverOpenFds.insert(fd);
+        }
+        thread(serveConnection, fd, ref(catalog), ref(latencies), jobs, listenFd).detach();
+    }
+    serverStopping = true;
+    {
+        unique_lock<mutex> lock(serverFdsMutex);
+        for (int fd : serverOpenFds) ::shutdown(fd, SHUT_RDWR);
+        serverConnectionsDone.wait(lock, [] { return serverOpenFds.empty(); });
+    }
+    ::close(listenFd);
+    if (!socketPath.empty()) ::unlink(socketPath.c_str());
+    cerr << latencies.json() << "\n";
+    return 0;
 }
 
 struct GraphRecord {
     string name;
     Graph* g;
+    DynamicSSSP* dyn = nullptr;   // создаётся при регистрации первого источника (пункт 29)
+    GraphStore* store = nullptr;  // при запуске с --data каталог
 };
 
 
 
-int main() {
+int main(int argc, char** argv) {
+    vector<string> args(argv + 1, argv + argc);
+    // --stats-memory=фаза1,фаза2 (или *): замерять память этих фаз; в любом режиме
+    for (auto it = args.begin(); it != args.end();) {
+        if (it->rfind("--stats-memory=", 0) != 0) { ++it; continue; }
+        stringstream ss(it->substr(15));
+        string phase;
+        while (getline(ss, phase, ',')) if (!phase.empty()) Stats::trackMemory(phase);
+        it = args.erase(it);
+    }
+    if (!args.empty() && (args[0] == "--bench" || args[0] == "--batch" || args[0] == "--serve"
+                           || args[0] == "--stream")) {
+        try {
+            if (args[0] == "--serve") return runServer(args);
+            if (args[0] == "--stream") return runStream(args);
+            return args[0] == "--bench" ? runBenchmark(args) : runBatch(args);
+        } catch (const exception& e) {
+            cerr << "Ошибка: " << e.what() << "\n";
+            return 1;
+        }
+    }
+
+    // --stats[=файл]: при выходе выгрузить метрики (по умолчанию в stdout)
+    // --data каталог: графы сохраняются в хранилище (снимки + журнал) и восстанавливаются при запуске
+    bool statsOnExit = false;
+    string statsFile, dataDir;
+    for (size_t i = 0; i < args.size(); ++i) {
+        const auto& a = args[i];
+        if (a == "--stats") statsOnExit = true;
+        else if (a.rfind("--stats=", 0) == 0) { statsOnExit = true; statsFile = a.substr(8); }
+        else if (a == "--data" && i + 1 < args.size()) dataDir = args[++i];
+    }
+
     vector<GraphRecord> graphs;
     Graph* current = nullptr;
     string currentName;
     int choice;
 
+    // с --data имя графа — имя его файлов в хранилище: два графа с одним именем
+    // писали бы в один снимок и журнал, поэтому повтор имени запрещён
+    auto nameTaken = [&](const string& name) {
+        if (dataDir.empty()) return false;
+        bool taken = any_of(graphs.begin(), graphs.end(), [&](const GraphRecord& r) { return r.name == name; });
+        if (!taken) {
+            auto stored = GraphStore::list(dataDir);
+            taken = binary_search(stored.begin(), stored.end(), name);
+        }
+        if (taken) cout << "Граф \"" << name << "\" уже есть в хранилище " << dataDir << ". Выберите другое имя.\n";
+        return taken;
+    };
+
+    // подключить хранилище к новому графу (или продолжить восстановленный — resume);
+    // ошибка хранилища не мешает работе с графом
+    auto persist = [&](GraphRecord& rec, const GraphStore::Recovery* resume = nullptr) {
+        if (dataDir.empty()) return;
+        try {
+            rec.store = new GraphStore(*rec.g, dataDir, rec.name, StoreOptions(), resume);
+        } catch (const exception& e) {
+            cout << "Хранилище недоступно для графа \"" << rec.name << "\": " << e.what() << "\n";
+        }
+    };
+    for (const auto& name : dataDir.empty() ? vector<string>() : GraphStore::list(dataDir)) {
+        try {
+            GraphStore::Recovery info;
+            Graph* g = GraphStore::load(dataDir, name, &info);
+            graphs.push_back({name, g});
+            persist(graphs.back(), &info);
+            current = g;
+            currentName = name;
+            cout << "Граф \"" << name << "\" восстановлен: вершин " << info.vertices << ", записей журнала "
+                 << info.replayed << (info.truncatedBytes ? ", отброшен повреждённый хвост журнала" : "")
+                 << " (" << info.ms << " мс)\n";
+        } catch (const exception& e) {
+            cout << "Не удалось восстановить граф \"" << name << "\": " << e.what() << "\n";
+        }
+    }
+
     do {
         cout << "\n=== Меню ===\n";
         cout << "1. Создать новый пустой граф\n";
@@ -882,8 +7424,23 @@ int main() {
         cout << "15. Построить минимальный остров (Краскал)\n";
         cout << "16. Найти вершины, из которых все минимальные пути до остальных ≤ N (Дейкстра)\n";
         cout << "17. Найти кратчайшие пути из заданной вершины (Беллман–Форд)\n";
-        cout << "18. Определить N-периферию для заданной вершины (Флойд–Уоршелл)\n";
+        cout << "18. Определить N-периферию для заданной вершины\n";
         cout << "19. Найти максимальный поток (Эдмондс–Карп)\n";
+        cout << "20. Построить иерархию сокращений (CH) и сравнить с Дейкстрой\n";
+        cout << "21. Кратчайший путь по иерархии сокращений\n";
+        cout << "22. Эксцентриситеты, радиус, диаметр, центр и периферия (APSP)\n";
+        cout << "23. Приближённые диаметр, эксцентриситеты и k-достижимость\n";
+        cout << "24. Задать число потоков для алгоритмов\n";
+        cout << "25. Показать метрики производительности\n";
+        cout << "26. Перенумеровать вершины (RCM / степень / BFS / Gorder)\n";
+        cout << "27. Сжатое представление: размер и скорость BFS/Дейкстры\n";
+        cout << "28. Поток минимальной стоимости (несколько источников и стоков)\n";
+        cout << "29. Динамические кратчайшие пути: источники, изменение веса, расстояния\n";
+        cout << "30. Снимок текущего графа в хранилище (--data) и статистика журнала\n";
+        cout << "31. Утка против фермеров: решить игру ретроградным анализом\n";
+        cout << "32. Треугольники, коэффициенты кластеризации и k-ядра\n";
+        cout << "33. PageRank (в том числе персонализированный) и посредничество вершин\n";
+        cout << "34. Разбить граф на части и сравнить BFS, компоненты и PageRank по частям\n";
         cout << "0. Выход\n";
         cout << "Введите ваш выбор: ";
         cin >> choice;
@@ -898,8 +7455,10 @@ int main() {
                 cin >> name;
                 cout << "Ориентированный? (1 = да, 0 = нет): ";
                 cin >> directed;
+                if (nameTaken(name)) break;
                 Graph* g = new Graph(directed);
                 graphs.push_back({name, g});
+                persist(graphs.back());
                 current = g;
                 currentName = name;
                 cout << "Граф \"" << name << "\" создан и выбран как текущий.\n";
@@ -913,8 +7472,10 @@ int main() {
                 cin >> fileName;
                 cout << "Ориентированный? (1 = да, 0 = нет): ";
                 cin >> directed;
+                if (nameTaken(name)) break;
                 Graph* g = new Graph(fileName, directed);
                 graphs.push_back({name, g});
+                persist(graphs.back());
                 current = g;
                 currentName = name;
                 cout << "Граф \"" << name << "\" загружен из " << fileName << " и выбран как текущий.\n";
@@ -1111,6 +7672,388 @@ int main() {
                 break;
             }
 
+            case 20: {
+                if (!current) { cout << "Нет активного графа.\n"; break; }
+                int queries;
+                cout << "Число тестовых запросов: ";
+                cin >> queries;
+                try {
+                    benchmarkContractionHierarchy(*current, currentName + "_ch.bin", max(queries, 1));
+                } catch (const exception& e) {
+                    cout << "Ошибка: " << e.what() << "\n";
+                }
+                break;
+            }
+
+            case 21: {
+                if (!current) { cout << "Нет активного графа.\n"; break; }
+                try {
+                    // иерархия строится офлайн (пункт 20) и читается из файла
+                    ContractionHierarchy ch = ContractionHierarchy::loadFromFile(currentName + "_ch.bin");
+                    if (ch.vertexCount() != current->vertexCount())
+                        cout << "Внимание: граф изменился после построения иерархии, пересоберите её (пункт 20).\n";
+                    cout << "Введите начальную вершину: ";
+                    cin >> from;
+                    cout << "Введите конечную вершину: ";
+                    cin >> to;
+                    int s = ch.findVertex(from), t = ch.findVertex(to);
+                    if (s == -1 || t == -1) { cout << "Вершина не найдена.\n"; break; }
+                    auto t0 = chrono::steady_clock::now();
+                    auto p = ch.path(s, t);
+                    double us = chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count();
+                    if (p.empty()) {
+                        cout << "Путь из " << from << " в " << to << " не существует.\n";
+                    } else {
+                        cout << "Расстояние: " << ch.distance(s, t) << "\nПуть: ";
+                        for (size_t i = 0; i < p.size(); ++i) cout << (i ? " -> " : "") << ch.names[p[i]];
+                        cout << "\nВремя запроса: " << us << " мкс\n";
+                    }
+                } catch (const exception& e) {
+                    cout << "Ошибка: " << e.what() << "\n";
+                }
+                break;
+            }
+
+            case 22:
+                if (!current) { cout << "Нет активного графа.\n"; break; }
+                printGraphMetrics(*current);
+                break;
+
+            case 23: {
+                if (!current) { cout << "Нет активного графа.\n"; break; }
+                ApproxBudget budget;
+                int k;
+                cout << "Введите k: ";
+                cin >> k;
+                cout << "Лимит времени на каждую оценку, мс: ";
+                cin >> budget.timeMs;
+                cout << "Максимум обходов BFS: ";
+                cin >> budget.maxBfs;
+                cout << "Допустимая относительная погрешность (например 0.05): ";
+                cin >> budget.relError;
+                printApproxMetrics(*current, k, budget);
+                break;
+            }
+
+            case 24: {
+                if (!current) { cout << "Нет активного графа.\n"; break; }
+                int t;
+                cout << "Число потоков (0 = по числу ядер, сейчас " << current->threadCount() << "): ";
+                cin >> t;
+                current->setThreads(t);
+                cout << "Граф \"" << currentName << "\" использует потоков: " << current->threadCount() << "\n";
+                break;
+            }
+
+            case 25:
+                Stats::dump(cout);
+                break;
+
+            case 26: {
+                if (!current) { cout << "Нет активного графа.\n"; break; }
+                string method;
+                cout << "Порядок (rcm, degree, bfs, gorder, random): ";
+                cin >> method;
+                try {
+                    Relabeling r = current->reorder(parseVertexOrder(method));
+                    cout << "Вершины графа \"" << currentName << "\" перенумерованы (" << vertexOrderName(r.order)
+                         << ") за " << r.ms << " мс.\n";
+                    cout << "Средний разрыв индексов по рёбрам: " << r.gapBefore << " -> " << r.gapAfter << "\n";
+                    cout << "Ширина ленты: " << r.bandwidthBefore << " -> " << r.bandwidthAfter << "\n";
+                } catch (const exception& e) {
+                    cout << "Ошибка: " << e.what() << "\n";
+                }
+                break;
+            }
+
+            case 27: {
+                if (!current) { cout << "Нет активного графа.\n"; break; }
+                if (current->vertexCount() == 0) { cout << "Граф пуст.\n"; break; }
+                string start;
+                cout << "Стартовая вершина: ";
+                cin >> start;
+                int s = current->findVertex(start);
+                if (s == -1) { cout << "Вершина \"" << start << "\" не найдена.\n"; break; }
+
+                auto t0 = chrono::steady_clock::now();
+                CompressedGraph cg(*current);
+                auto ms = [](chrono::steady_clock::time_point a) {
+                    return chrono::duration<double, milli>(chrono::steady_clock::now() - a).count();
+                };
+                double buildMs = ms(t0);
+                size_t before = graphMemoryBytes(*current), after = cg.memoryBytes();
+                cout << "Граф \"" << currentName << "\": " << before << " байт, сжатый: " << after
+                     << " байт (в " << (double)before / max<size_t>(1, after) << " раз), построение " << buildMs << " мс\n";
+                cout << "Кодирование весов: " << weightCodingName(cg.weightCoding())
+                     << ", бит на вес: " << cg.weightBits() << "\n";
+
+                CSR csr = current->toCSR();
+                t0 = chrono::steady_clock::now();
+                vector<int> hops;
+                bfsHops(csr, s, hops);
+                double bfsMs = ms(t0);
+                t0 = chrono::steady_clock::now();
+                bool same = cg.bfs(s) == hops;
+                double bfsCompMs = ms(t0);
+                cout << "BFS: CSR " << bfsMs << " мс, сжатый " << bfsCompMs << " мс"
+                     << (same ? "" : " (РАСХОЖДЕНИЕ!)") << "\n";
+
+                bool negative = any_of(csr.weight.begin(), csr.weight.end(), [](int w) { return w < 0; });
+                if (negative) { cout << "Есть отрицательные веса — Дейкстра пропущена.\n"; break; }
+                t0 = chrono::steady_clock::now();
+                auto dist = current->dijkstraDistances(s);
+                double dijMs = ms(t0);
+                t0 = chrono::steady_clock::now();
+                same = cg.dijkstra(s) == dist;
+                double dijCompMs = ms(t0);
+                cout << "Дейкстра: список смежности " << dijMs << " мс, сжатый " << dijCompMs << " мс"
+                     << (same ? "" : " (РАСХОЖДЕНИЕ!)") << "\n";
+                break;
+            }
+
+            case 28: {
+                if (!current) { cout << "Нет активного графа.\n"; break; }
+                string srcList, sinkList, costFile;
+                int method;
+                cout << "Источники (имя[:запас] через запятую, например A:5,B): ";
+                cin >> srcList;
+                cout << "Стоки (имя[:спрос] через запятую): ";
+                cin >> sinkList;
+                cout << "Файл стоимостей (\"откуда куда стоимость\", '-' — все стоимости 1): ";
+                cin >> costFile;
+                cout << "Метод (1 — последовательные кратчайшие пути, 2 — масштабирование стоимостей): ";
+                cin >> method;
+                try {
+                    auto sources = parseFlowTerminals(*current, srcList);
+                    auto sinks = parseFlowTerminals(*current, sinkList);
+                    FlowCosts costs = costFile == "-" ? FlowCosts() : FlowCosts::fromFile(costFile);
+                    auto r = MinCostFlow(*current, costs).solve(sources, sinks, method == 2
+                        ? MinCostFlow::Method::CostScaling : MinCostFlow::Method::SuccessiveShortestPaths);
+                    cout << "Поток: " << r.flow << ", стоимость: " << r.cost
+                         << " (" << r.ms << " мс, итераций: " << r.iterations << ")\n";
+                    for (const auto& a : r.arcs)
+                        if (a.flow > 0)
+                            cout << "  " << current->adjList[a.from].adress << " -> " << current->adjList[a.to].adress
+                                 << ": " << a.flow << "/" << a.capacity << " (стоимость " << a.cost << ")\n";
+                } catch (const exception& e) {
+                    cout << "Ошибка: " << e.what() << "\n";
+                }
+                break;
+            }
+
+            case 29: {
+                if (!current) { cout << "Нет активного графа.\n"; break; }
+                auto rec = find_if(graphs.begin(), graphs.end(), [&](const GraphRecord& r) { return r.g == current; });
+                int action;
+                cout << "1 — добавить источник, 2 — изменить вес ребра, 3 — расстояния от источника: ";
+                cin >> action;
+                try {
+                    if (action == 1) {
+                        cout << "Вершина-источник: ";
+                        cin >> from;
+                        int s = current->findVertex(from);
+                        if (s == -1) { cout << "Вершина \"" << from << "\" не найдена.\n"; break; }
+                        if (!rec->dyn) rec->dyn = new DynamicSSSP(*current);
+                        rec->dyn->addSource(s);
+                        cout << "Источник \"" << from << "\" зарегистрирован (" << rec->dyn->lastUpdate().ms << " мс).\n";
+                    } else if (action == 2) {
+                        cout << "Введите вершину-источник ребра: ";
+                        cin >> from;
+                        cout << "Введите вершину-назначение: ";
+                        cin >> to;
+                        cout << "Новый вес: ";
+                        cin >> weight;
+                        current->setEdgeWeight(from, to, weight);
+                        if (rec->dyn)
+                            cout << "Пересчитано вершин: " << rec->dyn->lastUpdate().touched
+                                 << " (" << rec->dyn->lastUpdate().ms << " мс)\n";
+                    } else if (action == 3) {
+                        if (!rec->dyn || rec->dyn->sources().empty()) { cout << "Источники не зарегистрированы.\n"; break; }
+                        cout << "Вершина-источник: ";
+                        cin >> from;
+                        int s = current->findVertex(from);
+                        if (s == -1) { cout << "Вершина \"" << from << "\" не найдена.\n"; break; }
+                        for (int v = 0; v < current->vertexCount(); ++v) {
+                            cout << current->adjList[v].adress << ": ";
+                            if (rec->dyn->distance(s, v) == DynamicSSSP::INF) { cout << "недостижима\n"; continue; }
+                            cout << rec->dyn->distance(s, v) << " (путь:";
+                            for (int x : rec->dyn->path(s, v)) cout << " " << current->adjList[x].adress;
+                            cout << ")\n";
+                        }
+                        cout << "Последнее изменение графа: пересчитано вершин " << rec->dyn->lastUpdate().touched
+                             << ", всего с начала " << rec->dyn->totalTouched() << "\n";
+                    } else cout << "Неверный выбор.\n";
+                } catch (const exception& e) {
+                    cout << "Ошибка: " << e.what() << "\n";
+                }
+                break;
+            }
+
+            case 30: {
+                if (!current) { cout << "Нет активного графа.\n"; break; }
+                auto rec = find_if(graphs.begin(), graphs.end(), [&](const GraphRecord& r) { return r.g == current; });
+                if (!rec->store) { cout << "Хранилище не подключено (запуск с --data каталог).\n"; break; }
+                try {
+                    rec->store->checkpoint();
+                    auto c = rec->store->counters();
+                    cout << "Снимок записан за " << c.lastSnapshotMs << " мс. Журнал с запуска: записей " << c.records
+                         << ", групп фиксации " << c.commits << ", байт " << c.bytes << ", снимков " << c.snapshots << "\n";
+                } catch (const exception& e) {
+                    cout << "Ошибка: " << e.what() << "\n";
+                }
+                break;
+            }
+
+            case 31: {
+                if (!current) { cout << "Нет активного графа.\n"; break; }
+                string lakeName, duckName;
+                int k;
+                cout << "Вершина-озеро: ";
+                cin >> lakeName;
+                cout << "Стартовая вершина утки: ";
+                cin >> duckName;
+                cout << "Число фермеров (1-4): ";
+                cin >> k;
+                vector<string> farmerNames(max(0, min(k, 4)));
+                cout << "Стартовые вершины фермеров (через пробел): ";
+                for (auto& f : farmerNames) cin >> f;
+                try {
+                    auto vertex = [&](const string& name) {
+                        int v = current->findVertex(name);
+                        if (v == -1) throw runtime_error("Вершина \"" + name + "\" не найдена");
+                        return v;
+                    };
+                    PursuitGame::Position p{vertex(duckName), {}, true};
+                    for (const auto& f : farmerNames) p.farmers.push_back(vertex(f));
+                    PursuitGame game(*current, vertex(lakeName), k, current->threadCount());
+                    const auto& s = game.solve();
+                    cout << "Позиций: " << s.states << " (таблицы " << game.tableBytes() << " байт), слоёв: "
+                         << s.layerSizes.size() << ", решено за " << s.ms << " мс\n";
+                    cout << "Утка выигрывает в " << s.duckWins << ", фермеры — в " << s.farmersWin
+                         << ", ничьих: " << s.draws << "\n";
+
+                    auto o = game.outcome(p);
+                    cout << "Исход при лучшей игре: " << PursuitGame::outcomeName(o);
+                    if (o != PursuitGame::DRAW) cout << " (полуходов: " << game.plies(p) << ")";
+                    cout << "\n";
+                    auto where = [&](const PursuitGame::Position& q) {
+                        string r = "утка " + current->adjList[q.duck].adress + ", фермеры";
+                        for (int f : q.farmers) r += " " + current->adjList[f].adress;
+                        return r;
+                    };
+                    for (int ply = 0; ply < 40 && game.finished(p) == PursuitGame::DRAW; ++ply) {
+                        p = game.bestMove(p);
+                        cout << "  " << (p.duckToMove ? "ход фермеров: " : "ход утки: ") << where(p) << "\n";
+                    }
+                    if (game.finished(p) != PursuitGame::DRAW) cout << "Итог: " << PursuitGame::outcomeName(game.finished(p)) << "\n";
+                } catch (const exception& e) {
+                    cout << "Ошибка: " << e.what() << "\n";
+                }
+                break;
+            }
+
+            case 32: {
+                if (!current) { cout << "Нет активного графа.\n"; break; }
+                auto t = countTriangles(*current);
+                auto d = coreDecomposition(*current);
+                cout << "Треугольников: " << t.total << ", вилок: " << t.wedges << " (" << t.ms << " мс)\n";
+                cout << "Глобальный коэффициент кластеризации: " << t.globalClustering
+                     << ", средний локальный: " << t.averageClustering << "\n";
+                cout << "Вырожденность (наибольшее k-ядро): " << d.degeneracy << " (" << d.ms << " мс)\n";
+                cout << "Вершина: треугольники, локальный коэффициент, ядерное число\n";
+                for (int v = 0; v < current->vertexCount(); ++v)
+                    cout << "  " << current->adjList[v].adress << ": " << t.triangles[v] << ", "
+                         << t.clustering[v] << ", " << d.core[v] << "\n";
+                break;
+            }
+
+            case 33: {
+                if (!current) { cout << "Нет активного графа.\n"; break; }
+                string seeds;
+                int samples, top;
+                cout << "Вершины телепортации через запятую ('-' — обычный PageRank): ";
+                cin >> seeds;
+                cout << "Число источников для посредничества (0 — все): ";
+                cin >> samples;
+                cout << "Сколько лучших вершин показать: ";
+                cin >> top;
+                try {
+                    PageRankOptions po;
+                    if (seeds != "-") {
+                        stringstream ss(seeds);
+                        string s;
+                        while (getline(ss, s, ',')) {
+                            int v = current->findVertex(s);
+                            if (v == -1) throw runtime_error("Вершина \"" + s + "\" не найдена");
+                            po.personalization.push_back(v);
+                        }
+                    }
+                    auto pr = pageRank(*current, po);
+                    auto bc = betweenness(*current, samples);
+                    cout << "PageRank: итераций " << pr.iterations << (pr.converged ? "" : " (не сошёлся)")
+                         << ", невязка " << pr.delta << ", " << pr.ms << " мс\n";
+                    cout << "Посредничество: источников " << bc.sources << (bc.exact ? " (точно)" : " (оценка)")
+                         << ", " << bc.ms << " мс\n";
+                    auto show = [&](const vector<double>& score, const char* title) {
+                        vector<int> ids(current->vertexCount());
+                        for (int v = 0; v < (int)ids.size(); ++v) ids[v] = v;
+                        stable_sort(ids.begin(), ids.end(), [&](int a, int b) { return score[a] > score[b]; });
+                        cout << title << ":\n";
+                        for (int i = 0; i < min(top, (int)ids.size()); ++i)
+                            cout << "  " << current->adjList[ids[i]].adress << ": " << score[ids[i]] << "\n";
+                    };
+                    show(pr.rank, "PageRank");
+                    show(bc.score, "Посредничество");
+                } catch (const exception& e) {
+                    cout << "Ошибка: " << e.what() << "\n";
+                }
+                break;
+            }
+
+            case 34: {
+                if (!current) { cout << "Нет активного графа.\n"; break; }
+                if (current->vertexCount() == 0) { cout << "Граф пуст.\n"; break; }
+                PartitionOptions po;
+                string start;
+                cout << "Число частей (0 — по числу узлов NUMA и потоков): ";
+                cin >> po.parts;
+                cout << "Стартовая вершина BFS: ";
+                cin >> start;
+                int s = current->findVertex(start);
+                if (s == -1) { cout << "Вершина \"" << start << "\" не найдена.\n"; break; }
+                try {
+                    PartitionedGraph pg(*current, po);
+                    cout << "Частей: " << pg.partCount() << ", узлов NUMA: " << pg.numaNodes()
+                         << ", разрезано рёбер: " << pg.edgeCut() << ", построение " << pg.buildMs() << " мс\n";
+                    for (int p = 0; p < pg.partCount(); ++p)
+                        cout << "  часть " << p << ": вершин " << pg.shard(p).localCount()
+                             << ", граничных " << pg.shard(p).boundary << ", дуг наружу " << pg.shard(p).crossArcs << "\n";
+                    auto ms = [](chrono::steady_clock::time_point a) {
+                        return chrono::duration<double, milli>(chrono::steady_clock::now() - a).count();
+                    };
+                    auto t0 = chrono::steady_clock::now();
+                    auto b = current->bfs(s);
+                    double flat = ms(t0);
+                    t0 = chrono::steady_clock::now();
+                    bool same = pg.bfs(s) == b.dist;
+                    cout << "BFS: целиком " << flat << " мс, по частям " << ms(t0) << " мс"
+                         << (same ? "" : " (РАСХОЖДЕНИЕ!)") << "\n";
+                    int comps = 0;
+                    t0 = chrono::steady_clock::now();
+                    pg.components(&comps);
+                    cout << "Слабых компонент: " << comps << " (" << ms(t0) << " мс)\n";
+                    auto pr = pageRank(*current);
+                    auto ppr = pg.pageRank();
+                    double diff = 0;
+                    for (int v = 0; v < current->vertexCount(); ++v) diff = max(diff, fabs(pr.rank[v] - ppr.rank[v]));
+                    cout << "PageRank: целиком " << pr.ms << " мс, по частям " << ppr.ms
+                         << " мс, наибольшее расхождение " << diff << "\n";
+                } catch (const exception& e) {
+                    cout << "Ошибка: " << e.what() << "\n";
+                }
+                break;
+            }
+
             case 0:
                 cout << "Выход...\n";
                 break;
@@ -1121,10 +8064,21 @@ int main() {
 
     } while (choice != 0);
 
-    // очистка памяти
+    // очистка памяти; хранилище при закрытии дописывает журнал
     for (auto& rec : graphs) {
+        delete rec.store;
+        delete rec.dyn;
         delete rec.g;
     }
 
+    if (statsOnExit) {
+        if (statsFile.empty()) Stats::dump(cout);
+        else {
+            ofstream fout(statsFile);
+            if (fout.is_open()) Stats::dump(fout);
+            else cerr << "Не удалось открыть файл " << statsFile << "\n";
+        }
+    }
+
     return 0;
 }
\ No newline at end of file